@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Minimal timing helpers shared by the benchmark suites.
+
+// Record a result for --json output and --baseline comparison. `name` is
+// unique within the running suite; `higher_is_better` marks throughput-like
+// metrics, so a drop rather than a rise counts as a regression.
+void report(const std::string& name, double value, const std::string& unit, bool higher_is_better = false);
+
+// Record a sanity check of the running suite, e.g. that a mechanism under
+// measurement behaved as intended. memoraxx_bench exits with status 3 if
+// any check failed.
+void check(bool condition, const std::string& what);
+
+// Heap allocations (operator new calls) made by the process so far
+size_t allocation_count();
+// Bytes requested from operator new so far
+size_t allocated_bytes();
+
+// The `p`th percentile (0-100) of `samples`; sorts them in place
+inline double percentile(std::vector<double>& samples, double p) {
+    if (samples.empty()) return 0.0;
+    std::sort(samples.begin(), samples.end());
+    size_t index = static_cast<size_t>(p / 100.0 * (samples.size() - 1) + 0.5);
+    return samples[std::min(index, samples.size() - 1)];
+}
+
+// Keep the optimizer from discarding a benchmarked result
+template <typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(_MSC_VER)
+    static const void* volatile sink;
+    sink = &value;
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+// Average nanoseconds per call of `fn` over `iterations` calls
+template <typename Fn>
+double ns_per_op(size_t iterations, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+// Deterministic filler text of roughly `length` bytes
+inline std::string filler_text(size_t length, unsigned seed) {
+    static const char* WORDS[] = {"memory", "context", "token", "llama", "request",
+                                  "stream", "the", "a", "of", "model", "\"quoted\"", "line\n"};
+    std::string out;
+    while (out.size() < length) {
+        seed = seed * 1103515245u + 12345u;
+        out += WORDS[(seed >> 16) % (sizeof(WORDS) / sizeof(WORDS[0]))];
+        out += ' ';
+    }
+    return out;
+}
@@ -0,0 +1,139 @@
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "turn_archive.hpp"
+
+namespace {
+
+size_t env_size(const char* name, size_t fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::strtoul(value, nullptr, 10) : fallback;
+}
+
+// Deterministic vocabulary of pronounceable words
+std::vector<std::string> make_vocabulary(size_t size) {
+    static const char* SYLLABLES[] = {"ka", "lo", "mi", "ra", "te", "su", "no", "vi", "de", "pa", "zu", "qe",
+                                      "bo", "fi", "gu", "ha", "je", "wy", "xo", "ce"};
+    const size_t count = sizeof(SYLLABLES) / sizeof(SYLLABLES[0]);
+    std::vector<std::string> words;
+    for (size_t i = 0; i < size; ++i) {
+        std::string word;
+        for (size_t n = i + count; n > 0; n /= count) word += SYLLABLES[n % count];
+        words.push_back(std::move(word));
+    }
+    return words;
+}
+
+// Word counts follow a power law, like natural text: rank r appears
+// about 1/r as often as the most common word
+struct TextSource {
+    std::vector<std::string> vocabulary;
+    unsigned seed;
+
+    size_t rank() {
+        seed = seed * 1103515245u + 12345u;
+        const double u = ((seed >> 8) & 0xffff) / 65536.0;
+        return std::min(vocabulary.size() - 1, static_cast<size_t>(std::exp(u * std::log(vocabulary.size()))) - 1);
+    }
+    std::string text(size_t words) {
+        std::string out;
+        for (size_t i = 0; i < words; ++i) {
+            out += vocabulary[rank()];
+            out += ' ';
+        }
+        return out;
+    }
+};
+
+} // namespace
+
+// Full-history archive at scale: append MEMORAXX_ARCHIVE_TURNS synthetic
+// turns (20-word prompt, 60-word response over a power-law vocabulary),
+// then reopen it and time the startup, keyword searches of two and three
+// words, and a full scan of the archive file for comparison. Every 50000th
+// turn carries a unique word that must come back as the top hit.
+void bench_archive() {
+    const size_t turns = env_size("MEMORAXX_ARCHIVE_TURNS", 1000000);
+    const size_t queries = env_size("MEMORAXX_ARCHIVE_QUERIES", 200);
+    const auto dir = std::filesystem::temp_directory_path() / ("memoraxx_archive_" + std::to_string(::getpid()));
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    const std::string path = (dir / "memory.json.archive").string();
+
+    TextSource source{make_vocabulary(50000), 12345u};
+    const size_t needle_every = 50000;
+    {
+        TurnArchive archive(path);
+        archive.open();
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < turns; ++i) {
+            Interaction interaction{source.text(20), source.text(60), 100};
+            if (i % needle_every == 0) interaction.prompt += "needle" + std::to_string(i);
+            archive.append(interaction, 1700000000 + static_cast<int64_t>(i));
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        report("append_rate", turns / seconds, "turns/s", true);
+        std::cout << std::fixed << std::setprecision(1) << turns << " turns appended at " << turns / seconds
+                  << " turns/s, " << archive.segment_count() << " segments\n";
+    }
+
+    uint64_t archive_bytes = 0, index_bytes = 0;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(dir)) {
+        if (!entry.is_regular_file()) continue;
+        (entry.path().string() == path ? archive_bytes : index_bytes) += entry.file_size();
+    }
+
+    auto open_start = std::chrono::steady_clock::now();
+    TurnArchive archive(path);
+    archive.open();
+    const double open_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open_start).count();
+
+    size_t found = 0, needles = 0;
+    for (size_t i = 0; i < turns; i += needle_every, ++needles) {
+        auto hits = archive.search("needle" + std::to_string(i), 1);
+        if (!hits.empty() && hits[0].id == i) ++found;
+    }
+
+    std::vector<double> two_words, three_words;
+    source.seed = 777u;
+    for (size_t i = 0; i < queries; ++i) {
+        for (auto* samples : {&two_words, &three_words}) {
+            const std::string query = source.text(samples == &two_words ? 2 : 3);
+            const auto start = std::chrono::steady_clock::now();
+            auto hits = archive.search(query, 10);
+            samples->push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            do_not_optimize(hits);
+        }
+    }
+
+    // What a search costs without an index: read every turn once
+    const auto scan_start = std::chrono::steady_clock::now();
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    do_not_optimize(data.find("needle" + std::to_string(turns - 1)));
+    const double scan_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scan_start).count();
+    data.clear();
+    data.shrink_to_fit();
+    std::filesystem::remove_all(dir);
+
+    report("open_ms", open_ms, "ms");
+    report("search_p50/2_words", percentile(two_words, 50), "ms");
+    report("search_p99/2_words", percentile(two_words, 99), "ms");
+    report("search_p50/3_words", percentile(three_words, 50), "ms");
+    report("search_p99/3_words", percentile(three_words, 99), "ms");
+    report("scan_ms", scan_ms, "ms");
+    report("index_bytes_per_turn", static_cast<double>(index_bytes) / turns, "bytes");
+    std::cout << std::fixed << std::setprecision(2) << "archive " << archive_bytes / 1048576.0 << " MiB, index "
+              << index_bytes / 1048576.0 << " MiB in " << archive.segment_count() << " segments\n"
+              << "open " << open_ms << " ms, needles found " << found << "/" << needles << "\n"
+              << "search p50/p99: 2 words " << percentile(two_words, 50) << "/" << percentile(two_words, 99)
+              << " ms, 3 words " << percentile(three_words, 50) << "/" << percentile(three_words, 99) << " ms\n"
+              << "full scan of the archive " << scan_ms << " ms\n";
+}
@@ -0,0 +1,121 @@
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "bench.hpp"
+#include "context_renderer.hpp"
+#include "request_body.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+const std::string PREAMBLE = "You have access to the following tools:\n" + filler_text(600, 7) +
+                             "You are a highly knowledgeable and friendly AI assistant.\n\n";
+
+// Context assembly as it was before ContextRenderer: re-render every turn
+// with operator+ temporaries, then escape the whole prompt via dump().
+std::string legacy_payload(const std::deque<Interaction>& memory, const std::string& prompt) {
+    std::string context = PREAMBLE;
+    for (const auto& interaction : memory) {
+        context += "User: " + interaction.prompt + "\nAssistant: " + interaction.response + "\n\n";
+    }
+    context += "User: " + prompt + "\nAssistant:";
+    json payload = {{"model", "llama3.2"}, {"prompt", context}, {"stream", false}};
+    return payload.dump();
+}
+
+std::string incremental_payload(const ContextRenderer& context, const std::string& prompt) {
+    const std::string turn = ContextRenderer::render_prompt(prompt);
+    std::string payload;
+    payload.reserve(context.preamble().size() + context.history().size() + turn.size() + 64);
+    payload += "{\"model\":\"llama3.2\",\"prompt\":\"";
+    payload.append(context.preamble());
+    payload.append(context.history());
+    payload += turn;
+    payload += "\",\"stream\":false}";
+    return payload;
+}
+
+// The same request as borrowed pieces, as LlamaStack streams it to cURL
+void streamed_payload(RequestBody& body, const ContextRenderer& context, const std::string& prompt) {
+    body.clear();
+    body.append("{\"model\":\"llama3.2\",\"prompt\":\"");
+    body.borrow(context.preamble());
+    body.borrow(context.history());
+    body.append(ContextRenderer::render_prompt(prompt));
+    body.append("\",\"stream\":false}");
+}
+
+} // namespace
+
+// Per-turn context cost at different history sizes. "update" is the
+// append-one/evict-one bookkeeping ContextRenderer does per turn; "payload"
+// additionally copies the rendered history into one request body, and
+// "body" builds the streamed RequestBody instead. The byte columns are heap
+// bytes allocated per request by the two ways of building the body.
+void bench_context() {
+    std::cout << std::left << std::setw(8) << "turns" << std::setw(12) << "legacy ns" << std::setw(12)
+              << "update ns" << std::setw(12) << "payload ns" << std::setw(12) << "body ns" << std::setw(10)
+              << "speedup" << std::setw(16) << "payload bytes" << "body bytes\n";
+    for (size_t turns : {10, 100, 1000}) {
+        std::deque<Interaction> memory;
+        for (size_t i = 0; i < turns; ++i) {
+            memory.push_back({filler_text(80, i), filler_text(400, i + 1), 0});
+        }
+        ContextRenderer context;
+        context.set_preamble(PREAMBLE);
+        context.rebuild(memory);
+        const std::string prompt = filler_text(80, 42);
+
+        // Every path must produce the same request
+        RequestBody body;
+        streamed_payload(body, context, prompt);
+        if (json::parse(legacy_payload(memory, prompt)) != json::parse(incremental_payload(context, prompt)) ||
+            body.str() != incremental_payload(context, prompt)) {
+            std::cerr << "context mismatch at " << turns << " turns\n";
+            return;
+        }
+
+        const size_t iterations = 20000 / turns + 20;
+        double legacy = ns_per_op(iterations, [&]() {
+            do_not_optimize(legacy_payload(memory, prompt));
+        });
+        const Interaction turn = {filler_text(80, 3), filler_text(400, 4), 0};
+        double update = ns_per_op(iterations, [&]() {
+            context.append(turn);
+            context.evict_front();
+        });
+        double payload = ns_per_op(iterations, [&]() {
+            context.append(turn);
+            context.evict_front();
+            do_not_optimize(incremental_payload(context, prompt));
+        });
+        double streamed = ns_per_op(iterations, [&]() {
+            context.append(turn);
+            context.evict_front();
+            streamed_payload(body, context, prompt);
+            do_not_optimize(body);
+        });
+
+        size_t before = allocated_bytes();
+        do_not_optimize(incremental_payload(context, prompt));
+        const size_t payload_bytes = allocated_bytes() - before;
+        before = allocated_bytes();
+        streamed_payload(body, context, prompt);
+        const size_t body_bytes = allocated_bytes() - before;
+
+        const std::string suffix = '/' + std::to_string(turns);
+        report("legacy" + suffix, legacy, "ns");
+        report("update" + suffix, update, "ns");
+        report("payload" + suffix, payload, "ns");
+        report("body" + suffix, streamed, "ns");
+        report("payload_bytes" + suffix, static_cast<double>(payload_bytes), "bytes");
+        report("body_bytes" + suffix, static_cast<double>(body_bytes), "bytes");
+        std::cout << std::left << std::setw(8) << turns << std::setw(12) << std::fixed << std::setprecision(0)
+                  << legacy << std::setw(12) << update << std::setw(12) << payload << std::setw(12) << streamed
+                  << std::setw(10) << std::setprecision(1) << legacy / payload << std::setw(16) << payload_bytes
+                  << body_bytes << "\n";
+    }
+}
@@ -0,0 +1,95 @@
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "mock_ollama.hpp"
+#include "multi_client.hpp"
+#include "session_server.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+size_t env_size(const char* name, size_t fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::strtoul(value, nullptr, 10) : fallback;
+}
+
+} // namespace
+
+// Load test of daemon mode: an in-process SessionServer on a local TCP port
+// in front of the mock server, driven by one MultiClient that keeps every
+// session's next turn in flight at once. The session budget is set below
+// the working set, so sessions are unloaded and reloaded from their
+// journals during the run. The suite fails unless every request is
+// answered with 200. MEMORAXX_DAEMON_SESSIONS and
+// MEMORAXX_DAEMON_TURNS set the load, MEMORAXX_MOCK_LATENCY_MS the backend
+// delay.
+void bench_daemon() {
+    MockOllamaConfig mock_config;
+    mock_config.latency_ms = static_cast<int>(env_size("MEMORAXX_MOCK_LATENCY_MS", 20));
+    mock_config.response_tokens = 64;
+    MockOllama backend(mock_config);
+    const size_t session_count = env_size("MEMORAXX_DAEMON_SESSIONS", 200);
+    const size_t turns = env_size("MEMORAXX_DAEMON_TURNS", 5);
+    const auto dir = std::filesystem::temp_directory_path() / ("memoraxx_daemon_" + std::to_string(::getpid()));
+    std::filesystem::remove_all(dir);
+
+    DaemonOptions options;
+    options.listen = "127.0.0.1:0";
+    options.workers = 32;
+    options.session_dir = (dir / "sessions").string();
+    options.memory_bytes = 256 << 10; // About a quarter of 200 five-turn sessions
+    options.idle_seconds = 0;
+    LlamaOptions stack_options;
+    stack_options.stream = false;
+    SessionServer server(options, [&](const std::string& memory_file) {
+        return std::make_unique<LlamaStack>(backend.generate_url(), "mock", 1 << 20, memory_file, stack_options);
+    });
+    server.start();
+    const std::string base = "http://127.0.0.1:" + std::to_string(server.port()) + "/v1/sessions/";
+
+    ConnectionPool pool;
+    MultiClient client(pool, session_count);
+    std::vector<double> latencies;
+    size_t failures = 0;
+    std::function<void(size_t, size_t)> send = [&](size_t session, size_t turn) {
+        const auto start = std::chrono::steady_clock::now();
+        client.post(base + "s" + std::to_string(session) + "/completion",
+                    RequestBody(json{{"prompt", filler_text(80, static_cast<unsigned>(session * 31 + turn))}}.dump()),
+                    [&, session, turn, start](MultiClient::Response& response) {
+                        latencies.push_back(std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start).count());
+                        if (response.result != CURLE_OK || response.http_code != 200) ++failures;
+                        if (turn + 1 < turns) send(session, turn + 1);
+                    });
+    };
+    const auto started = std::chrono::steady_clock::now();
+    for (size_t session = 0; session < session_count; ++session) send(session, 0);
+    client.run();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    const SessionServer::Counters counters = server.counters();
+    server.stop();
+    std::filesystem::remove_all(dir);
+
+    const double rate = latencies.size() / seconds;
+    const double p50 = percentile(latencies, 50);
+    const double p99 = percentile(latencies, 99);
+    report("request_p50", p50, "ms");
+    report("request_p99", p99, "ms");
+    report("requests_per_sec", rate, "req/s", true);
+    std::cout << std::fixed << std::setprecision(1) << session_count << " sessions x " << turns << " turns, "
+              << options.workers << " workers, mock latency " << mock_config.latency_ms << " ms\n"
+              << "request p50 " << p50 << " ms, p99 " << p99 << " ms, " << rate << " req/s, " << failures
+              << " failed\n"
+              << "session loads " << counters.session_loads << ", unloads " << counters.session_unloads
+              << ", connections " << counters.connections << "\n";
+    check(failures == 0, std::to_string(failures) + " of " + std::to_string(latencies.size()) + " requests failed");
+    check(latencies.size() == session_count * turns, std::to_string(latencies.size()) + " of " +
+                                                         std::to_string(session_count * turns) + " requests answered");
+    check(counters.session_unloads > 0, "no session was unloaded, expected the budget to be below the working set");
+}
@@ -0,0 +1,89 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "llama_stack.hpp"
+#include "mock_ollama.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+size_t env_size(const char* name, size_t fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::strtoul(value, nullptr, 10) : fallback;
+}
+
+// Memory file holding `turns` earlier interactions, imported on first use
+void write_history(const std::string& path, size_t turns) {
+    json memory_json = json::array();
+    for (size_t i = 0; i < turns; ++i) {
+        memory_json.push_back({{"prompt", filler_text(80, i)}, {"response", filler_text(400, i + 1)},
+                               {"token_count", 120}});
+    }
+    std::ofstream(path) << memory_json.dump();
+}
+
+} // namespace
+
+// Whole-turn latency through LlamaStack::completion() against an in-process
+// mock server, so the numbers are client overhead (payload build, HTTP,
+// decoding, journaling) plus the configured mock latency. History is
+// prefilled with 0, 100 and 1000 turns. MEMORAXX_BENCH_TURNS sets the turns
+// measured per case and MEMORAXX_MOCK_LATENCY_MS the server delay.
+void bench_e2e() {
+    MockOllamaConfig config;
+    config.latency_ms = static_cast<int>(env_size("MEMORAXX_MOCK_LATENCY_MS", 0));
+    config.response_tokens = 64;
+    MockOllama server(config);
+    const size_t turns = env_size("MEMORAXX_BENCH_TURNS", 200);
+    const auto dir = std::filesystem::temp_directory_path() / ("memoraxx_e2e_" + std::to_string(::getpid()));
+
+    std::cout << "mock latency " << config.latency_ms << " ms, " << turns << " turns per case\n";
+    std::cout << std::left << std::setw(10) << "history" << std::setw(10) << "mode" << std::setw(12) << "p50 ms"
+              << std::setw(12) << "p99 ms" << "turns/s\n";
+    for (size_t history : {0, 100, 1000}) {
+        for (bool stream : {false, true}) {
+            std::filesystem::remove_all(dir);
+            std::filesystem::create_directories(dir);
+            const std::string memory_file = (dir / "memory.json").string();
+            write_history(memory_file, history);
+
+            LlamaOptions options;
+            options.stream = stream;
+            LlamaStack stack(server.generate_url(), "mock", 1 << 20, memory_file, options);
+            std::vector<double> latencies;
+            size_t tokens = 0;
+            const auto started = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < turns; ++i) {
+                const std::string prompt = filler_text(80, 1000 + i);
+                const auto start = std::chrono::steady_clock::now();
+                std::string response = stack.completion(prompt, [&](const std::string&) { ++tokens; });
+                latencies.push_back(
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                if (stack.last_stats().failed) {
+                    std::cerr << "turn failed: " << response << "\n";
+                    return;
+                }
+            }
+            const double seconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            do_not_optimize(tokens);
+
+            const std::string name = std::to_string(history) + (stream ? "/stream" : "/single");
+            const double p50 = percentile(latencies, 50);
+            const double p99 = percentile(latencies, 99);
+            report("turn_p50/" + name, p50, "ms");
+            report("turn_p99/" + name, p99, "ms");
+            std::cout << std::left << std::setw(10) << history << std::setw(10) << (stream ? "stream" : "single")
+                      << std::fixed << std::setprecision(3) << std::setw(12) << p50 << std::setw(12) << p99
+                      << std::setprecision(0) << turns / seconds << "\n";
+        }
+    }
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,272 @@
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "bench.hpp"
+
+#ifndef MEMORAXX_GIT_REVISION
+#define MEMORAXX_GIT_REVISION ""
+#endif
+#ifndef MEMORAXX_BUILD_TYPE
+#define MEMORAXX_BUILD_TYPE ""
+#endif
+
+using json = nlohmann::json;
+
+// Benchmark suites
+void bench_archive();
+void bench_context();
+void bench_daemon();
+void bench_e2e();
+void bench_memory();
+void bench_protocol();
+void bench_retrieval();
+void bench_routing();
+void bench_startup();
+void bench_summary();
+void bench_tokenizer();
+void bench_turnstore();
+
+struct Suite {
+    const char* name;
+    void (*run)();
+};
+
+static const Suite SUITES[] = {
+    {"context", bench_context},
+    {"tokenizer", bench_tokenizer},
+    {"memory", bench_memory},
+    {"protocol", bench_protocol},
+    {"e2e", bench_e2e},
+    {"retrieval", bench_retrieval},
+    {"daemon", bench_daemon},
+    {"routing", bench_routing},
+    {"archive", bench_archive},
+    {"startup", bench_startup},
+    {"summary", bench_summary},
+    {"turnstore", bench_turnstore},
+};
+
+// Every allocation of the bench binary is counted, so suites can report
+// allocations and allocated bytes per operation. All forms of operator
+// new and delete are replaced, so every allocation is counted and every
+// pointer is freed by the allocator it came from.
+static std::atomic<size_t> allocations{0};
+static std::atomic<size_t> allocated{0};
+
+namespace {
+
+// Null on failure
+void* counted_alloc(std::size_t size, std::size_t alignment = 0) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+    // aligned_alloc() wants a multiple of the alignment
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void counted_free(void* memory) noexcept {
+    std::free(memory);
+}
+
+void* counted_new(std::size_t size, std::size_t alignment = 0) {
+    if (void* memory = counted_alloc(size, alignment)) return memory;
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return counted_new(size); }
+void* operator new[](std::size_t size) { return counted_new(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return counted_new(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return counted_new(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept { counted_free(memory); }
+void operator delete[](void* memory) noexcept { counted_free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { counted_free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { counted_free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { counted_free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { counted_free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { counted_free(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { counted_free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { counted_free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { counted_free(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(memory); }
+
+size_t allocation_count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+size_t allocated_bytes() {
+    return allocated.load(std::memory_order_relaxed);
+}
+
+namespace {
+
+struct Result {
+    std::string suite;
+    std::string name;
+    double value;
+    std::string unit;
+    bool higher_is_better;
+};
+
+std::vector<Result> results;
+const char* current_suite = "";
+size_t failed_checks = 0;
+
+json results_json(const std::string& label) {
+    char timestamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    json out = {
+        {"schema", 1},
+        {"label", label},
+        {"revision", MEMORAXX_GIT_REVISION},
+        {"build_type", MEMORAXX_BUILD_TYPE},
+        {"timestamp", timestamp},
+        {"results", json::array()}
+    };
+    for (const auto& result : results) {
+        out["results"].push_back({
+            {"suite", result.suite},
+            {"name", result.name},
+            {"value", result.value},
+            {"unit", result.unit},
+            {"higher_is_better", result.higher_is_better}
+        });
+    }
+    return out;
+}
+
+// Print the change of every result also present in `baseline`; returns the
+// number of results that got worse by more than `max_regression` percent
+size_t compare(const json& baseline, double max_regression) {
+    size_t regressions = 0;
+    std::cout << "== baseline: " << baseline.value("label", "") << " " << baseline.value("revision", "") << " ==\n";
+    std::cout << std::left << std::setw(44) << "result" << std::right << std::setw(14) << "baseline"
+              << std::setw(14) << "current" << std::setw(10) << "change" << "\n";
+    for (const auto& result : results) {
+        for (const auto& old : baseline.value("results", json::array())) {
+            if (old.value("suite", "") != result.suite || old.value("name", "") != result.name) continue;
+            const double before = old.value("value", 0.0);
+            if (before == 0.0) break;
+            const double change = (result.value - before) / before * 100.0;
+            const double worse = result.higher_is_better ? -change : change;
+            const bool regressed = max_regression >= 0 && worse > max_regression;
+            regressions += regressed;
+            std::cout << std::left << std::setw(44) << (result.suite + "/" + result.name) << std::right
+                      << std::fixed << std::setprecision(2) << std::setw(14) << before << std::setw(14)
+                      << result.value << std::setw(9) << std::showpos << change << "%" << std::noshowpos
+                      << (regressed ? "  REGRESSION" : "") << "\n";
+            break;
+        }
+    }
+    return regressions;
+}
+
+void usage(const char* program) {
+    std::cerr << "Usage: " << program
+              << " [suite...] [--json FILE] [--label NAME] [--baseline FILE] [--max-regression PCT]\nSuites:";
+    for (const auto& suite : SUITES) std::cerr << " " << suite.name;
+    std::cerr << std::endl;
+}
+
+} // namespace
+
+void report(const std::string& name, double value, const std::string& unit, bool higher_is_better) {
+    results.push_back({current_suite, name, value, unit, higher_is_better});
+}
+
+void check(bool condition, const std::string& what) {
+    if (condition) return;
+    ++failed_checks;
+    std::cerr << "CHECK FAILED (" << current_suite << "): " << what << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> selected;
+    std::string json_path;
+    std::string baseline_path;
+    std::string label = MEMORAXX_GIT_REVISION;
+    double max_regression = -1.0; // Negative: report changes without failing
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--json" && has_value) {
+            json_path = argv[++i];
+        } else if (arg == "--label" && has_value) {
+            label = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            baseline_path = argv[++i];
+        } else if (arg == "--max-regression" && has_value) {
+            max_regression = std::atof(argv[++i]);
+        } else if (arg.rfind("--", 0) == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            selected.push_back(arg);
+        }
+    }
+
+    for (const auto& name : selected) {
+        bool known = false;
+        for (const auto& suite : SUITES) known |= name == suite.name;
+        if (!known) {
+            std::cerr << "Unknown suite: " << name << "\n";
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    for (const auto& suite : SUITES) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), suite.name) == selected.end()) continue;
+        std::cout << "== " << suite.name << " ==\n";
+        current_suite = suite.name;
+        suite.run();
+    }
+
+    if (!json_path.empty()) {
+        std::ofstream out(json_path);
+        if (!out.is_open()) {
+            std::cerr << "Cannot write " << json_path << std::endl;
+            return 1;
+        }
+        out << results_json(label).dump(2) << "\n";
+    }
+    if (!baseline_path.empty()) {
+        std::ifstream in(baseline_path);
+        if (!in.is_open()) {
+            std::cerr << "Cannot read " << baseline_path << std::endl;
+            return 1;
+        }
+        json baseline = json::parse(in);
+        if (compare(baseline, max_regression) > 0) return 2;
+    }
+    return failed_checks > 0 ? 3 : 0;
+}
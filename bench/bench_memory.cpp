@@ -0,0 +1,99 @@
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "memory_journal.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Whole-history save as memory_file was written before the journal
+void save_json(const std::string& path, const std::deque<Interaction>& memory) {
+    json memory_json = json::array();
+    for (const auto& interaction : memory) {
+        memory_json.push_back({
+            {"prompt", interaction.prompt},
+            {"response", interaction.response},
+            {"token_count", interaction.token_count}
+        });
+    }
+    std::ofstream ofs(path);
+    ofs << memory_json.dump(2);
+}
+
+size_t load_json(const std::string& path, std::deque<Interaction>& memory) {
+    std::ifstream ifs(path);
+    json memory_json;
+    ifs >> memory_json;
+    memory.clear();
+    for (const auto& item : memory_json) {
+        memory.push_back({item["prompt"].get<std::string>(), item["response"].get<std::string>(),
+                          item["token_count"].get<int>()});
+    }
+    return memory.size();
+}
+
+} // namespace
+
+// Persistence cost per turn at different history sizes: the legacy
+// whole-file JSON save/load against MemoryJournal append, replay and
+// compaction. Files go to a scratch directory under the system temp dir.
+void bench_memory() {
+    const auto dir = std::filesystem::temp_directory_path() / ("memoraxx_bench_" + std::to_string(::getpid()));
+    std::filesystem::create_directories(dir);
+    const std::string json_path = (dir / "memory.json").string();
+    const std::string journal_path = (dir / "memory.jsonl").string();
+
+    std::cout << std::left << std::setw(8) << "turns" << std::setw(14) << "save us" << std::setw(14)
+              << "append us" << std::setw(14) << "load ms" << std::setw(14) << "replay ms" << "compact ms\n";
+    for (size_t turns : {10, 100, 1000}) {
+        std::deque<Interaction> memory;
+        for (size_t i = 0; i < turns; ++i) {
+            memory.push_back({filler_text(80, i), filler_text(400, i + 1), 120});
+        }
+        const Interaction turn = {filler_text(80, 3), filler_text(400, 4), 120};
+        const size_t iterations = 2000 / turns + 5;
+
+        double save = ns_per_op(iterations, [&]() { save_json(json_path, memory); });
+        double load = ns_per_op(iterations, [&]() {
+            std::deque<Interaction> loaded;
+            do_not_optimize(load_json(json_path, loaded));
+        });
+
+        std::filesystem::remove(journal_path);
+        double append, replay, compact;
+        {
+            MemoryJournal journal(journal_path);
+            journal.compact(std::vector<Interaction>(memory.begin(), memory.end()));
+            append = ns_per_op(200, [&]() {
+                journal.append(turn);
+                journal.record_eviction();
+            });
+            std::vector<Interaction> snapshot(memory.begin(), memory.end());
+            compact = ns_per_op(iterations, [&]() { journal.compact(snapshot); });
+        }
+        replay = ns_per_op(iterations, [&]() {
+            MemoryJournal journal(journal_path);
+            std::deque<Interaction> loaded;
+            journal.replay(loaded);
+            do_not_optimize(loaded.size());
+        });
+
+        const std::string suffix = '/' + std::to_string(turns);
+        report("save_json" + suffix, save / 1e3, "us");
+        report("journal_append" + suffix, append / 1e3, "us");
+        report("load_json" + suffix, load / 1e6, "ms");
+        report("journal_replay" + suffix, replay / 1e6, "ms");
+        report("journal_compact" + suffix, compact / 1e6, "ms");
+        std::cout << std::left << std::setw(8) << turns << std::fixed << std::setprecision(1) << std::setw(14)
+                  << save / 1e3 << std::setw(14) << append / 1e3 << std::setprecision(3) << std::setw(14)
+                  << load / 1e6 << std::setw(14) << replay / 1e6 << compact / 1e6 << "\n";
+    }
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,114 @@
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "bench.hpp"
+#include "response_cache.hpp"
+#include "response_decoder.hpp"
+#include "stream_decoder.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Final object of a response carrying a KV `context` of `context_size` tokens
+json final_chunk(size_t context_size) {
+    return {{"model", "llama3.2"}, {"response", ""}, {"done", true}, {"prompt_eval_count", 512},
+            {"eval_count", 256}, {"eval_duration", 1000000000LL},
+            {"context", std::vector<int>(context_size, 128000)}};
+}
+
+// Heap allocations per call of `fn`
+template <typename Fn>
+double allocations_per_op(size_t iterations, Fn&& fn) {
+    const size_t before = allocation_count();
+    for (size_t i = 0; i < iterations; ++i) fn();
+    return static_cast<double>(allocation_count() - before) / iterations;
+}
+
+} // namespace
+
+// Wire format cost per request: serializing the /api/generate payload,
+// decoding a non-streamed response (against a json::parse tree, with and
+// without keeping its context), decoding a streamed NDJSON body fed in
+// network-sized chunks, and answering the payload from the response cache.
+// Sizes match a long conversation: a 32 KB prompt and an 8k-token KV
+// context. Decoding also reports heap allocations per response.
+void bench_protocol() {
+    const size_t context_size = 8192;
+    const std::string prompt = filler_text(32 << 10, 5);
+    const std::vector<int> session(context_size, 128000);
+
+    double payload_ns = ns_per_op(500, [&]() {
+        json payload = {{"model", "llama3.2"}, {"prompt", prompt}, {"stream", true}, {"context", session}};
+        do_not_optimize(payload.dump());
+    });
+
+    json response = final_chunk(context_size);
+    response["response"] = filler_text(2048, 9);
+    const std::string body = response.dump();
+    auto dom_parse = [&]() {
+        json parsed = json::parse(body);
+        do_not_optimize(parsed["response"].get<std::string>());
+        do_not_optimize(parsed["context"].get<std::vector<int>>());
+    };
+    auto decode = [&](bool keep_context) {
+        GenerateResponse decoded;
+        decode_generate_response(body.data(), body.data() + body.size(), decoded, keep_context);
+        do_not_optimize(decoded);
+    };
+    const double dom_ns = ns_per_op(500, dom_parse);
+    const double parse_ns = ns_per_op(500, [&]() { decode(false); });
+    const double context_ns = ns_per_op(500, [&]() { decode(true); });
+    const double dom_allocs = allocations_per_op(10, dom_parse);
+    const double parse_allocs = allocations_per_op(10, [&]() { decode(false); });
+    const double context_allocs = allocations_per_op(10, [&]() { decode(true); });
+
+    // 256 streamed tokens, then the final chunk, fed 1400 bytes at a time
+    std::string stream;
+    for (int i = 0; i < 256; ++i) {
+        stream += json{{"model", "llama3.2"}, {"response", filler_text(6, i)}, {"done", false}}.dump() + "\n";
+    }
+    stream += final_chunk(context_size).dump() + "\n";
+    auto stream_decode = [&]() {
+        StreamDecoder decoder;
+        decoder.keep_context = false;
+        for (size_t offset = 0; offset < stream.size(); offset += 1400) {
+            decoder.feed(stream.data() + offset, std::min<size_t>(1400, stream.size() - offset));
+        }
+        decoder.finish();
+        do_not_optimize(decoder.assembled);
+    };
+    const double stream_ns = ns_per_op(200, stream_decode);
+    const double stream_allocs = allocations_per_op(10, stream_decode);
+
+    // Hashing the whole body dominates a hit; the entry copy is the rest
+    const std::string payload = json{{"model", "llama3.2"}, {"prompt", prompt}, {"stream", true}}.dump();
+    ResponseCache cache("", 64 << 20);
+    cache.put(ResponseCache::key("http://localhost:11434/api/generate", payload), {filler_text(2048, 9), session});
+    double cache_ns = ns_per_op(2000, [&]() {
+        ResponseCache::Entry entry;
+        cache.get(ResponseCache::key("http://localhost:11434/api/generate", payload), entry);
+        do_not_optimize(entry.response);
+    });
+
+    report("payload_serialize", payload_ns / 1e3, "us");
+    report("response_parse", parse_ns / 1e3, "us");
+    report("response_parse/context", context_ns / 1e3, "us");
+    report("response_parse/json_dom", dom_ns / 1e3, "us");
+    report("response_parse_allocs", parse_allocs, "allocs");
+    report("response_parse_allocs/context", context_allocs, "allocs");
+    report("response_parse_allocs/json_dom", dom_allocs, "allocs");
+    report("stream_decode", stream_ns / 1e3, "us");
+    report("stream_decode_allocs", stream_allocs, "allocs");
+    report("cache_hit", cache_ns / 1e3, "us");
+    std::cout << std::fixed << std::setprecision(1)
+              << "payload serialize (" << prompt.size() / 1024 << " KB prompt, " << context_size
+              << " context): " << payload_ns / 1e3 << " us\n"
+              << "response parse (" << body.size() / 1024 << " KB): " << parse_ns / 1e3 << " us, " << parse_allocs
+              << " allocs; keeping context " << context_ns / 1e3 << " us, " << context_allocs << " allocs; json::parse "
+              << dom_ns / 1e3 << " us, " << dom_allocs << " allocs\n"
+              << "stream decode (" << stream.size() / 1024 << " KB, 257 lines): " << stream_ns / 1e3 << " us, "
+              << stream_allocs << " allocs\n"
+              << "response cache hit (" << payload.size() / 1024 << " KB payload): " << cache_ns / 1e3 << " us\n";
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bench.hpp"
+#include "vector_index.hpp"
+
+namespace {
+
+// Embedding-like vectors: points around random topic centres in a
+// low-dimensional latent space, projected up to `dim` with a little noise.
+// Real embeddings have a low intrinsic dimension; isotropic noise in all
+// `dim` coordinates would make every neighbour equally far away.
+std::vector<float> clustered_vectors(size_t count, size_t dim, size_t clusters, unsigned seed) {
+    const size_t latent = 32;
+    std::mt19937 fixed(7); // Topics and projection are shared by data and queries
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<float> centres(clusters * latent);
+    for (auto& value : centres) value = normal(fixed);
+    std::vector<float> projection(dim * latent);
+    for (auto& value : projection) value = normal(fixed);
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(0, clusters - 1);
+    std::vector<float> point(latent);
+    std::vector<float> out(count * dim);
+    for (size_t i = 0; i < count; ++i) {
+        const float* centre = centres.data() + pick(rng) * latent;
+        for (size_t l = 0; l < latent; ++l) point[l] = centre[l] + 0.5f * normal(rng);
+        for (size_t d = 0; d < dim; ++d) {
+            out[i * dim + d] = dot_product(projection.data() + d * latent, point.data(), latent) + 0.1f * normal(rng);
+        }
+    }
+    return out;
+}
+
+size_t env_size(const char* name, size_t fallback) {
+    const char* value = std::getenv(name);
+    return value ? static_cast<size_t>(std::strtoull(value, nullptr, 10)) : fallback;
+}
+
+} // namespace
+
+// HNSW build time, query latency percentiles and recall@10 against an
+// exhaustive scan. $MEMORAXX_BENCH_VECTORS and $MEMORAXX_BENCH_DIM override
+// the default 100k x 384 corpus.
+void bench_retrieval() {
+    const size_t count = env_size("MEMORAXX_BENCH_VECTORS", 100000);
+    const size_t dim = env_size("MEMORAXX_BENCH_DIM", 384);
+    const size_t queries = 200;
+    const size_t k = 10;
+
+    std::vector<float> data = clustered_vectors(count, dim, 256, 1);
+    std::vector<float> probes = clustered_vectors(queries, dim, 256, 2);
+
+    HnswIndex index(dim);
+    auto build_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        index.add(data.data() + i * dim);
+    }
+    double build_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count();
+
+    report("build", count / build_s, "inserts/s", true);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "vectors " << count << " x " << dim << ", build " << build_s << " s ("
+              << count / build_s << " inserts/s)\n";
+    std::cout << std::setw(6) << "ef" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us"
+              << std::setw(12) << "recall@10" << "\n";
+
+    for (size_t ef : {32, 64, 128}) {
+        std::vector<double> latencies;
+        size_t found = 0;
+        for (size_t q = 0; q < queries; ++q) {
+            const float* query = probes.data() + q * dim;
+            auto start = std::chrono::steady_clock::now();
+            auto hits = index.search(query, k, ef);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            do_not_optimize(hits);
+
+            auto exact = index.search_exact(query, k);
+            for (const auto& hit : hits) {
+                found += std::any_of(exact.begin(), exact.end(), [&](const auto& e) { return e.second == hit.second; });
+            }
+        }
+        const double p50 = percentile(latencies, 50);
+        const double p99 = percentile(latencies, 99);
+        const double recall = double(found) / (queries * k);
+        const std::string suffix = "/ef" + std::to_string(ef);
+        report("search_p50" + suffix, p50, "us");
+        report("search_p99" + suffix, p99, "us");
+        report("recall@10" + suffix, recall, "ratio", true);
+        std::cout << std::setw(6) << ef
+                  << std::setw(12) << p50
+                  << std::setw(12) << p99
+                  << std::setw(12) << std::setprecision(3) << recall
+                  << std::setprecision(1) << "\n";
+    }
+
+    double exact_ns = ns_per_op(20, [&] { do_not_optimize(index.search_exact(probes.data(), k)); });
+    report("exact_scan", exact_ns / 1000.0, "us");
+    std::cout << "exact scan " << exact_ns / 1000.0 << " us/query\n";
+}
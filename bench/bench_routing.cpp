@@ -0,0 +1,112 @@
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <tuple>
+
+#include "bench.hpp"
+#include "llama_stack.hpp"
+#include "mock_ollama.hpp"
+
+namespace {
+
+size_t env_size(const char* name, size_t fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::strtoul(value, nullptr, 10) : fallback;
+}
+
+struct RunResult {
+    std::vector<double> latencies;
+    size_t failed = 0;
+    size_t hedges = 0;
+    size_t hedge_wins = 0;
+};
+
+// Serial turns through one stack routed over `pool`, without memory files
+RunResult run_turns(const std::shared_ptr<BackendPool>& pool, bool stream, size_t turns) {
+    LlamaOptions options;
+    options.stream = stream;
+    options.backends = pool;
+    LlamaStack stack(pool->url(0), "mock", 512, "", options);
+    RunResult run;
+    for (size_t i = 0; i < turns; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        stack.completion(filler_text(80, 2000 + i), [](const std::string&) {});
+        run.latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        const CompletionStats& stats = stack.last_stats();
+        run.failed += stats.failed;
+        run.hedges += stats.hedges;
+        run.hedge_wins += stats.hedge_wins;
+    }
+    return run;
+}
+
+std::vector<BackendConfig> configs(const std::vector<const MockOllama*>& servers) {
+    std::vector<BackendConfig> backends;
+    for (const MockOllama* server : servers) backends.push_back({server->generate_url(), 1.0, {}});
+    return backends;
+}
+
+} // namespace
+
+// Routing over several in-process mock servers, one turn at a time.
+// "failover": one of two backends answers every request with 503; turns
+// must still succeed, and the failing backend should be ejected after a
+// few failures. "tail": two backends with a base latency of 10 ms where
+// every 25th or 30th request takes 200 ms longer, first without hedging and then
+// hedged at the p95 delay, single-body and streamed. Hedges must stay
+// near the slow fraction of requests (about 7%); hedging nearly every
+// request means the first-byte latency the delay is derived from is
+// wrong. MEMORAXX_ROUTING_TURNS sets the turns per case.
+void bench_routing() {
+    const size_t turns = env_size("MEMORAXX_ROUTING_TURNS", 300);
+    RoutingOptions routing;
+    routing.health_interval_ms = 0; // Keep the failing backend out for the whole run
+    routing.eject_ms = 60000;
+
+    {
+        MockOllamaConfig healthy_config;
+        healthy_config.latency_ms = 10;
+        MockOllamaConfig failing_config = healthy_config;
+        failing_config.error_every = 1;
+        MockOllama healthy(healthy_config);
+        MockOllama failing(failing_config);
+        auto pool = std::make_shared<BackendPool>(configs({&failing, &healthy}), routing);
+        RunResult run = run_turns(pool, false, turns);
+        const double p99 = percentile(run.latencies, 99);
+        report("failover_failed", static_cast<double>(run.failed), "turns");
+        report("failover_p99", p99, "ms");
+        std::cout << std::fixed << std::setprecision(1) << "failover: " << turns << " turns, " << run.failed
+                  << " failed, p99 " << p99 << " ms, " << failing.requests() << " requests to the failing backend\n";
+    }
+
+    MockOllamaConfig tail_config;
+    tail_config.latency_ms = 10;
+    tail_config.slow_every = 25;
+    tail_config.slow_ms = 200;
+    std::cout << std::left << std::setw(18) << "tail" << std::setw(12) << "p50 ms" << std::setw(12) << "p99 ms"
+              << "hedges (won)\n";
+    for (const auto& [name, hedge, stream] : {std::tuple{"unhedged", false, false}, std::tuple{"hedged", true, false},
+                                              std::tuple{"hedged/stream", true, true}}) {
+        // Different periods, so the slow requests of the two servers do not line up
+        MockOllama first(tail_config);
+        MockOllamaConfig second_config = tail_config;
+        second_config.slow_every = 30;
+        MockOllama second(second_config);
+        RoutingOptions tail_routing = routing;
+        tail_routing.hedge = hedge;
+        tail_routing.hedge_min_ms = 5;
+        auto pool = std::make_shared<BackendPool>(configs({&first, &second}), tail_routing);
+        RunResult run = run_turns(pool, stream, turns);
+        const double p50 = percentile(run.latencies, 50);
+        const double p99 = percentile(run.latencies, 99);
+        report(std::string("tail_p50/") + name, p50, "ms");
+        report(std::string("tail_p99/") + name, p99, "ms");
+        check(run.hedges <= turns / 5, std::string(name) + ": " + std::to_string(run.hedges) + " of " +
+                                           std::to_string(turns) + " turns hedged, expected at most " +
+                                           std::to_string(turns / 5));
+        std::cout << std::left << std::setw(18) << name << std::fixed << std::setprecision(1) << std::setw(12) << p50
+                  << std::setw(12) << p99 << run.hedges << " (" << run.hedge_wins << ")"
+                  << (run.failed ? ", " + std::to_string(run.failed) + " failed" : "") << "\n";
+    }
+}
@@ -0,0 +1,102 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <thread>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "llama_stack.hpp"
+#include "mock_ollama.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+size_t env_size(const char* name, size_t fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::strtoul(value, nullptr, 10) : fallback;
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+// Startup of the REPL up to its first answer, against a mock server whose
+// first request pays a model load of MEMORAXX_MOCK_LOAD_MS. Cold builds the
+// stack before showing the prompt and leaves the load to the first turn;
+// warm builds it in the background while the model loads, as main() does.
+// The user types for MEMORAXX_THINK_MS (and, for comparison, not at all)
+// before sending the first prompt. Memory is the journal left by importing
+// MEMORAXX_STARTUP_TURNS turns into an 8192-token window.
+void bench_startup() {
+    const int load_ms = static_cast<int>(env_size("MEMORAXX_MOCK_LOAD_MS", 1000));
+    const size_t think_ms = env_size("MEMORAXX_THINK_MS", 500);
+    const size_t history = env_size("MEMORAXX_STARTUP_TURNS", 10000);
+    const auto dir = std::filesystem::temp_directory_path() / ("memoraxx_startup_" + std::to_string(::getpid()));
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    const std::string memory_file = (dir / "memory.json").string();
+    {
+        json memory_json = json::array();
+        for (size_t i = 0; i < history; ++i) {
+            memory_json.push_back({{"prompt", filler_text(80, i)}, {"response", filler_text(400, i + 1)},
+                                   {"token_count", 120}});
+        }
+        std::ofstream(memory_file) << memory_json.dump();
+        // Import once, so every case starts from the journal like a second run
+        LlamaOptions options;
+        options.archive = false;
+        LlamaStack import("http://127.0.0.1:9/api/generate", "mock", 8192, memory_file, options);
+    }
+
+    std::cout << "model load " << load_ms << " ms, " << history << " turns of memory\n";
+    std::cout << std::left << std::setw(8) << "mode" << std::setw(10) << "think ms" << std::setw(12) << "ready ms"
+              << "first turn ms\n";
+    for (size_t think : {size_t(0), think_ms}) {
+        for (bool warm : {false, true}) {
+            MockOllamaConfig config;
+            config.latency_ms = 20;
+            config.load_ms = load_ms;
+            MockOllama server(config);
+            LlamaOptions options;
+            options.archive = false;
+            options.warm_up = warm;
+
+            // Until the prompt accepts input
+            const auto launch = std::chrono::steady_clock::now();
+            std::unique_ptr<LlamaStack> stack;
+            std::future<std::unique_ptr<LlamaStack>> loading;
+            if (warm) {
+                loading = std::async(std::launch::async, [&] {
+                    return std::make_unique<LlamaStack>(server.generate_url(), "mock", 8192, memory_file, options);
+                });
+            } else {
+                stack = std::make_unique<LlamaStack>(server.generate_url(), "mock", 8192, memory_file, options);
+            }
+            const double ready_ms = ms_since(launch);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(think));
+            const auto start = std::chrono::steady_clock::now();
+            if (!stack) stack = loading.get();
+            std::string response = stack->completion(filler_text(80, 7));
+            const double first_turn_ms = ms_since(start);
+            if (stack->last_stats().failed) {
+                std::cerr << "turn failed: " << response << "\n";
+                break;
+            }
+
+            const std::string name = std::string(warm ? "warm" : "cold") + "/think_" + std::to_string(think);
+            report("ready_ms/" + name, ready_ms, "ms");
+            report("first_turn_ms/" + name, first_turn_ms, "ms");
+            std::cout << std::left << std::setw(8) << (warm ? "warm" : "cold") << std::setw(10) << think << std::fixed
+                      << std::setprecision(1) << std::setw(12) << ready_ms << first_turn_ms << "\n";
+        }
+    }
+    std::filesystem::remove_all(dir);
+}
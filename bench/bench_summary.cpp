@@ -0,0 +1,85 @@
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include "bench.hpp"
+#include "llama_stack.hpp"
+#include "mock_ollama.hpp"
+
+namespace {
+
+size_t env_size(const char* name, size_t fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::strtoul(value, nullptr, 10) : fallback;
+}
+
+} // namespace
+
+// A long session with and without the summary tier, against an in-process
+// mock server that counts a request's body bytes / 4 as its prompt tokens.
+// "full" keeps all MEMORAXX_SUMMARY_TURNS turns (default 400) in a window
+// big enough for them, as a huge max_tokens does; "window" and "summary"
+// use a 2048-token window, and "summary" folds evicted turns into a
+// 256-token summary in the background. Reported per mode: mean prompt
+// tokens of the second half of the session, turn p50/p99 (the summary
+// requests must not show up here) and the evicted turns covered by the
+// summary at the end. MEMORAXX_MOCK_LATENCY_MS (default 20) delays both
+// turns and summary requests.
+void bench_summary() {
+    MockOllamaConfig config;
+    config.latency_ms = static_cast<int>(env_size("MEMORAXX_MOCK_LATENCY_MS", 20));
+    config.response_tokens = 64;
+    MockOllama server(config);
+    const size_t turns = env_size("MEMORAXX_SUMMARY_TURNS", 400);
+
+    std::cout << "mock latency " << config.latency_ms << " ms, " << turns << " turns\n";
+    std::cout << std::left << std::setw(10) << "mode" << std::setw(16) << "prompt tokens" << std::setw(12) << "p50 ms"
+              << std::setw(12) << "p99 ms" << "summarized turns\n";
+    double full_tokens = 0.0;
+    for (const char* mode : {"full", "window", "summary"}) {
+        const std::string name = mode;
+        LlamaOptions options;
+        options.stream = false;
+        options.archive = false;
+        options.summarize = name == "summary";
+        options.summary_tokens = 256;
+        LlamaStack stack(server.generate_url(), "mock", name == "full" ? 1 << 20 : 2048, "", options);
+
+        std::vector<double> latencies;
+        double prompt_tokens = 0.0;
+        size_t summarized = 0;
+        bool failed = false;
+        for (size_t i = 0; i < turns; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            std::string response = stack.completion(filler_text(80, static_cast<unsigned>(i)));
+            latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                                    .count());
+            const CompletionStats& stats = stack.last_stats();
+            if (stats.failed) {
+                std::cerr << "turn failed: " << response << "\n";
+                failed = true;
+                break;
+            }
+            if (i >= turns / 2) prompt_tokens += static_cast<double>(stats.prompt_eval_count);
+            summarized = stats.summary_turns;
+        }
+        if (failed) continue;
+        prompt_tokens /= static_cast<double>(turns - turns / 2);
+        if (name == "full") full_tokens = prompt_tokens;
+
+        const double p50 = percentile(latencies, 50);
+        const double p99 = percentile(latencies, 99);
+        report("prompt_tokens/" + name, prompt_tokens, "tokens");
+        report("p50_ms/" + name, p50, "ms");
+        report("p99_ms/" + name, p99, "ms");
+        report("summarized_turns/" + name, static_cast<double>(summarized), "turns", true);
+        std::cout << std::left << std::setw(10) << name << std::setw(16) << std::fixed << std::setprecision(0)
+                  << prompt_tokens << std::setw(12) << std::setprecision(2) << p50 << std::setw(12) << p99
+                  << summarized;
+        if (name != "full" && full_tokens > 0) {
+            std::cout << " (" << std::setprecision(0) << 100.0 * (1.0 - prompt_tokens / full_tokens)
+                      << "% fewer prompt tokens than full)";
+        }
+        std::cout << "\n";
+    }
+}
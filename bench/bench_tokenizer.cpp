@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+
+#include "bench.hpp"
+#include "llama_stack.hpp"
+#include "tokenizer.hpp"
+
+namespace {
+
+// Mixed prose, numbers, punctuation and code, roughly `length` bytes
+std::string corpus(size_t length) {
+    static const char* SYLLABLES[] = {"th", "e", "in", "er", "an", "re", "on", "at", "en", "nd",
+                                      "ti", "es", "or", "te", "of", "ed", "is", "it", "al", "ar"};
+    static const char* SEPARATORS[] = {" ", " ", " ", " ", ", ", ". ", "\n", "'s ", " (", ") ", " 2024 ", " == ", "\n\n    "};
+    std::string out;
+    unsigned seed = 12345;
+    while (out.size() < length) {
+        seed = seed * 1103515245u + 12345u;
+        int syllables = 1 + (seed >> 16) % 4;
+        for (int k = 0; k < syllables; ++k) {
+            seed = seed * 1103515245u + 12345u;
+            out += SYLLABLES[(seed >> 16) % 20];
+        }
+        seed = seed * 1103515245u + 12345u;
+        out += SEPARATORS[(seed >> 16) % 13];
+    }
+    return out;
+}
+
+// Vocabulary of all bytes plus the most frequent substrings of the
+// corpus pieces, ordered by frequency like a trained BPE vocabulary.
+std::vector<std::string> synthetic_vocab(const std::string& text, size_t size) {
+    std::vector<std::string_view> pieces;
+    BpeTokenizer::pre_tokenize(text, pieces);
+    std::map<std::string, size_t> frequency;
+    for (auto piece : pieces) {
+        for (size_t len = 2; len <= std::min<size_t>(piece.size(), 8); ++len) {
+            for (size_t i = 0; i + len <= piece.size(); ++i) {
+                ++frequency[std::string(piece.substr(i, len))];
+            }
+        }
+    }
+    std::vector<std::pair<size_t, std::string>> ranked;
+    for (auto& [token, count] : frequency) ranked.emplace_back(count, token);
+    std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second.size() < b.second.size();
+    });
+    std::vector<std::string> vocab;
+    for (int b = 0; b < 256; ++b) vocab.push_back(std::string(1, static_cast<char>(b)));
+    for (size_t i = 0; i < ranked.size() && vocab.size() < size; ++i) vocab.push_back(ranked[i].second);
+    return vocab;
+}
+
+} // namespace
+
+// Tokenizer throughput in MB/s. Uses the vocabulary in $MEMORAXX_TOKENIZER
+// when set, otherwise a synthetic one built from the benchmark corpus.
+void bench_tokenizer() {
+    const std::string text = corpus(4 << 20);
+    std::unique_ptr<BpeTokenizer> tokenizer;
+    std::vector<std::string> vocab;
+    if (const char* path = std::getenv("MEMORAXX_TOKENIZER")) {
+        tokenizer = BpeTokenizer::load(path);
+        std::cout << "vocabulary: " << path << "\n";
+    } else {
+        vocab = synthetic_vocab(text.substr(0, 1 << 20), 8192);
+        tokenizer = BpeTokenizer::from_ranks(vocab);
+        std::cout << "vocabulary: synthetic\n";
+    }
+    std::cout << "tokens in vocabulary: " << tokenizer->vocab_size() << "\n";
+
+    // Round trip: the tokens must reassemble the input exactly
+    if (!vocab.empty()) {
+        std::string decoded;
+        for (int id : tokenizer->encode(text.substr(0, 65536))) decoded += vocab[id];
+        if (decoded != text.substr(0, 65536)) {
+            std::cerr << "round trip mismatch\n";
+            return;
+        }
+    }
+
+    std::vector<std::string_view> pieces;
+    double pre_ns = ns_per_op(3, [&]() {
+        pieces.clear();
+        BpeTokenizer::pre_tokenize(text, pieces);
+        do_not_optimize(pieces.size());
+    });
+    size_t tokens = 0;
+    double count_ns = ns_per_op(3, [&]() {
+        tokens = tokenizer->count(text);
+        do_not_optimize(tokens);
+    });
+    int estimate = 0;
+    double estimate_ns = ns_per_op(3, [&]() {
+        estimate = count_tokens(text);
+        do_not_optimize(estimate);
+    });
+    const double mb = text.size() / 1e6;
+    report("pre_tokenize", mb / (pre_ns / 1e9), "MB/s", true);
+    report("count", mb / (count_ns / 1e9), "MB/s", true);
+    report("count_estimate", mb / (estimate_ns / 1e9), "MB/s", true);
+    std::cout << std::fixed << std::setprecision(1)
+              << "input: " << mb << " MB, " << tokens << " tokens (" << double(text.size()) / tokens << " bytes/token)\n"
+              << "pre-tokenize: " << mb / (pre_ns / 1e9) << " MB/s\n"
+              << "count: " << mb / (count_ns / 1e9) << " MB/s\n"
+              << "count (word estimate): " << mb / (estimate_ns / 1e9) << " MB/s, " << estimate << " tokens\n";
+}
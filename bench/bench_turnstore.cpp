@@ -0,0 +1,122 @@
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "bench.hpp"
+#include "metrics.hpp"
+#include "turn_store.hpp"
+
+namespace {
+
+size_t env_size(const char* name, size_t fallback) {
+    const char* value = std::getenv(name);
+    return value ? std::strtoul(value, nullptr, 10) : fallback;
+}
+
+// Hand freed pages back, so the next mode's RSS growth is its own
+void release_free_memory() {
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
+
+// Turn `i` of the workload: every fourth response is one of eight long
+// tool outputs, as when the same file or command output is read again
+Interaction make_turn(size_t i, const std::vector<std::string>& tool_outputs) {
+    const unsigned seed = static_cast<unsigned>(i);
+    if (i % 4 == 3) return {filler_text(120, seed), tool_outputs[i / 4 % tool_outputs.size()], 1200};
+    return {filler_text(240, seed), filler_text(960, seed + 1), 300};
+}
+
+// Heap held by a deque of turns: the strings' buffers beyond SSO and the
+// Interaction records
+size_t deque_bytes(const std::deque<Interaction>& memory) {
+    const std::string empty;
+    size_t bytes = memory.size() * sizeof(Interaction);
+    for (const auto& interaction : memory) {
+        if (interaction.prompt.capacity() > empty.capacity()) bytes += interaction.prompt.capacity() + 1;
+        if (interaction.response.capacity() > empty.capacity()) bytes += interaction.response.capacity() + 1;
+    }
+    return bytes;
+}
+
+struct Result {
+    double append_ns = 0.0; // Filling the history, per turn
+    double churn_ns = 0.0; // Appending one turn and evicting the oldest at full size
+    size_t stored_bytes = 0;
+    size_t rss_bytes = 0; // Process RSS growth while filling
+    size_t allocations = 0; // Per appended turn
+};
+
+template <typename Memory, typename Bytes>
+Result run(Memory& memory, size_t turns, const std::vector<Interaction>& workload, Bytes&& bytes) {
+    Result result;
+    release_free_memory();
+    const size_t rss_before = process_rss_bytes();
+    const size_t allocations_before = allocation_count();
+    result.append_ns = ns_per_op(turns, [&, i = size_t{0}]() mutable {
+        memory.push_back(workload[i++ % workload.size()]);
+    });
+    result.allocations = (allocation_count() - allocations_before) / turns;
+    result.rss_bytes = process_rss_bytes() - std::min(rss_before, process_rss_bytes());
+    result.stored_bytes = bytes(memory);
+    const size_t churn = std::min<size_t>(turns, 20000);
+    result.churn_ns = ns_per_op(churn, [&, i = turns]() mutable {
+        memory.push_back(workload[i++ % workload.size()]);
+        memory.pop_front();
+    });
+    return result;
+}
+
+} // namespace
+
+// Holding the recent history in RAM: a deque of Interaction (two heap
+// strings per turn, as before TurnStore) against TurnStore plain and with
+// zstd compression. Each size is filled, then churned by appending a turn
+// and evicting the oldest, as trim_history() does at full budget. A
+// quarter of the responses repeat one of eight 4 KiB tool outputs; the
+// rest are ~1.2 KiB turns. MEMORAXX_STORE_TURNS sets the largest size
+// (default 100000). The filler text uses a 12-word vocabulary, so it
+// compresses far better than real conversation; read the compressed
+// column as an upper bound.
+void bench_turnstore() {
+    std::vector<std::string> tool_outputs;
+    for (unsigned i = 0; i < 8; ++i) tool_outputs.push_back(filler_text(4096, 1000 + i));
+    std::vector<Interaction> workload;
+    for (size_t i = 0; i < 4096; ++i) workload.push_back(make_turn(i, tool_outputs));
+    const size_t largest = env_size("MEMORAXX_STORE_TURNS", 100000);
+
+    std::cout << std::left << std::setw(9) << "turns" << std::setw(12) << "mode" << std::setw(12) << "append ns"
+              << std::setw(12) << "churn ns" << std::setw(14) << "allocs/turn" << std::setw(13) << "stored MiB"
+              << "rss MiB\n";
+    for (size_t turns : {largest / 10, largest}) {
+        if (turns == 0) continue;
+        for (const char* mode : {"deque", "store", "zstd"}) {
+            const std::string name = mode;
+            if (name == "zstd" && !TurnStore::compression_available()) continue;
+            Result result;
+            if (name == "deque") {
+                std::deque<Interaction> memory;
+                result = run(memory, turns, workload, deque_bytes);
+            } else {
+                TurnStore memory(name == "zstd");
+                result = run(memory, turns, workload, [](const TurnStore& store) { return store.bytes(); });
+            }
+
+            const std::string suffix = "/" + name + "/" + std::to_string(turns);
+            const double stored_mib = static_cast<double>(result.stored_bytes) / (1 << 20);
+            const double rss_mib = static_cast<double>(result.rss_bytes) / (1 << 20);
+            report("append_ns" + suffix, result.append_ns, "ns");
+            report("churn_ns" + suffix, result.churn_ns, "ns");
+            report("stored_mib" + suffix, stored_mib, "MiB");
+            report("rss_mib" + suffix, rss_mib, "MiB");
+            std::cout << std::left << std::setw(9) << turns << std::setw(12) << name << std::setw(12) << std::fixed
+                      << std::setprecision(0) << result.append_ns << std::setw(12) << result.churn_ns << std::setw(14)
+                      << result.allocations << std::setw(13) << std::setprecision(1) << stored_mib << rss_mib << "\n";
+        }
+    }
+}
@@ -0,0 +1,254 @@
+#include "mock_ollama.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS; a closed client then raises SIGPIPE
+#endif
+
+namespace {
+
+const char* WORDS[] = {" the", " model", " memory", " context", " token", " of", " a",
+                       " response", ",", ".", " \"quoted\"", "\n"};
+
+bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool send_chunk(int fd, const std::string& data) {
+    char size[32];
+    std::snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    return send_all(fd, size + data + "\r\n");
+}
+
+std::string lowercase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+    return text;
+}
+
+// Value of `name` in a raw header block, or "" when absent
+std::string header_value(const std::string& headers, const std::string& name) {
+    const std::string lower = lowercase(headers);
+    size_t pos = lower.find("\r\n" + name + ":");
+    if (pos == std::string::npos) return "";
+    pos += name.size() + 3;
+    size_t end = headers.find("\r\n", pos);
+    std::string value = headers.substr(pos, end - pos);
+    value.erase(0, value.find_first_not_of(' '));
+    return value;
+}
+
+std::string http_response(int status, const char* reason, const std::string& body) {
+    return "HTTP/1.1 " + std::to_string(status) + " " + reason +
+           "\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+} // namespace
+
+MockOllama::MockOllama(const MockOllamaConfig& config) : config(config) {
+    listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw std::runtime_error("mock server: socket() failed");
+    }
+    int yes = 1;
+    ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(config.port));
+    socklen_t len = sizeof(addr);
+    if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listen_fd, 128) != 0 ||
+        ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+        ::close(listen_fd);
+        throw std::runtime_error("mock server: cannot listen on port " + std::to_string(config.port));
+    }
+    bound_port = ntohs(addr.sin_port);
+    acceptor = std::thread(&MockOllama::accept_loop, this);
+}
+
+MockOllama::~MockOllama() {
+    stopping = true;
+    acceptor.join();
+    ::close(listen_fd);
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        for (int fd : connection_fds) ::shutdown(fd, SHUT_RDWR);
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+std::string MockOllama::generate_url() const {
+    return "http://127.0.0.1:" + std::to_string(bound_port) + "/api/generate";
+}
+
+void MockOllama::accept_loop() {
+    while (!stopping) {
+        // Poll so the destructor is noticed without platform-specific wakeups
+        pollfd pfd{listen_fd, POLLIN, 0};
+        if (::poll(&pfd, 1, 50) <= 0) continue;
+        int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+        int yes = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        connection_fds.push_back(fd);
+        workers.emplace_back(&MockOllama::serve, this, fd);
+    }
+}
+
+void MockOllama::serve(int fd) {
+    std::string buffer;
+    char chunk[65536];
+    bool open = true;
+    while (open && !stopping) {
+        // Read one request: headers, then Content-Length bytes of body
+        size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                open = false;
+                break;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+        if (!open) break;
+        const std::string headers = buffer.substr(0, header_end);
+        const std::string length = header_value(headers, "content-length");
+        const size_t body_size = length.empty() ? 0 : std::stoul(length);
+        const size_t request_size = header_end + 4 + body_size;
+        while (buffer.size() < request_size) {
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                open = false;
+                break;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+        if (!open) break;
+        const std::string body = buffer.substr(header_end + 4, body_size);
+        buffer.erase(0, request_size);
+        const std::string request_line = headers.substr(0, headers.find("\r\n"));
+        open = lowercase(header_value(headers, "connection")) != "close";
+        ++request_count;
+
+        if (request_line.find(" /api/embeddings ") != std::string::npos ||
+            request_line.find(" /api/embed ") != std::string::npos) {
+            // Deterministic per prompt, so equal prompts retrieve each other
+            std::mt19937 rng(static_cast<unsigned>(std::hash<std::string>{}(body)));
+            std::normal_distribution<float> normal;
+            std::vector<float> embedding(config.embedding_dim);
+            for (auto& value : embedding) value = normal(rng);
+            if (!send_all(fd, http_response(200, "OK", json{{"embedding", embedding}}.dump()))) break;
+            continue;
+        }
+        if (request_line.find(" /api/tags ") != std::string::npos) {
+            json tags = {{"models", json::array({{{"name", "mock"}, {"model", "mock"}}})}};
+            if (!send_all(fd, http_response(200, "OK", tags.dump()))) break;
+            continue;
+        }
+        if (request_line.find(" /api/generate ") == std::string::npos) {
+            if (!send_all(fd, http_response(404, "Not Found", "{\"error\":\"not found\"}"))) break;
+            continue;
+        }
+
+        // The request is not parsed: its size stands in for the prompt
+        // length, so large histories do not slow the mock down
+        const bool stream = body.find("\"stream\":true") != std::string::npos ||
+                            body.find("\"stream\": true") != std::string::npos;
+        const bool load_only = body.find("\"prompt\":\"\"") != std::string::npos ||
+                               body.find("\"prompt\": \"\"") != std::string::npos;
+        // Requests wait for the model like in Ollama: the first starts the
+        // load, the ones arriving meanwhile wait for its end
+        long long load_ns = 0;
+        if (config.load_ms > 0) {
+            std::chrono::steady_clock::time_point ready;
+            const auto now = std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> lock(load_mutex);
+                if (!load_started) {
+                    load_started = true;
+                    loaded_at = now + std::chrono::milliseconds(config.load_ms);
+                }
+                ready = loaded_at;
+            }
+            if (ready > now) {
+                std::this_thread::sleep_until(ready);
+                load_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(ready - now).count();
+            }
+        }
+        if (load_only) {
+            json loaded = {{"model", "mock"}, {"response", ""}, {"done", true}, {"load_duration", load_ns},
+                           {"total_duration", load_ns}};
+            if (!send_all(fd, http_response(200, "OK", loaded.dump()))) break;
+            continue;
+        }
+        const long long prompt_tokens = static_cast<long long>(body_size / 4);
+        const long long eval_count = static_cast<long long>(config.response_tokens);
+        json done = {
+            {"model", "mock"},
+            {"done", true},
+            {"prompt_eval_count", prompt_tokens},
+            {"eval_count", eval_count},
+            {"eval_duration", eval_count * std::max(config.token_delay_us, 1) * 1000LL},
+            {"prompt_eval_duration", config.latency_ms * 1000000LL},
+            {"load_duration", load_ns},
+            {"total_duration", load_ns + config.latency_ms * 1000000LL + eval_count * config.token_delay_us * 1000LL},
+            {"context", std::vector<int>(std::min<long long>(prompt_tokens + eval_count, 8192), 1)}
+        };
+        const size_t generated = ++generate_count;
+        if (config.error_every > 0 && generated % config.error_every == 0) {
+            if (!send_all(fd, http_response(503, "Service Unavailable", "{\"error\":\"injected failure\"}"))) break;
+            continue;
+        }
+        int latency_ms = config.latency_ms;
+        if (config.slow_every > 0 && generated % config.slow_every == 0) latency_ms += config.slow_ms;
+        std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms));
+
+        if (!stream) {
+            std::string text;
+            for (size_t i = 0; i < config.response_tokens; ++i) text += WORDS[i % std::size(WORDS)];
+            done["response"] = text;
+            if (!send_all(fd, http_response(200, "OK", done.dump()))) break;
+            continue;
+        }
+
+        bool ok = send_all(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\nTransfer-Encoding: chunked\r\n\r\n");
+        for (size_t i = 0; ok && i < config.response_tokens; ++i) {
+            if (i > 0 && config.token_delay_us > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(config.token_delay_us));
+            }
+            json token = {{"model", "mock"}, {"response", WORDS[i % std::size(WORDS)]}, {"done", false}};
+            ok = send_chunk(fd, token.dump() + "\n");
+        }
+        done["response"] = "";
+        if (!ok || !send_chunk(fd, done.dump() + "\n") || !send_all(fd, "0\r\n\r\n")) break;
+    }
+
+    std::lock_guard<std::mutex> lock(connections_mutex);
+    connection_fds.erase(std::remove(connection_fds.begin(), connection_fds.end(), fd), connection_fds.end());
+    ::close(fd);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Settings of the mock server; every request is answered the same way,
+// apart from the injected slow responses and errors
+struct MockOllamaConfig {
+    int port = 0; // 0 picks a free port
+    int latency_ms = 0; // Delay before the first response byte
+    size_t response_tokens = 32; // Tokens in each generated response
+    int token_delay_us = 0; // Delay between streamed tokens
+    size_t embedding_dim = 384; // Length of /api/embeddings vectors
+    size_t slow_every = 0; // Every Nth generate request waits `slow_ms` longer; 0 never
+    int slow_ms = 0;
+    size_t error_every = 0; // Every Nth generate request fails with 503; 0 never
+    int load_ms = 0; // Model load paid once, by the first generate request and any arriving during it
+};
+
+// Minimal stand-in for an Ollama server on 127.0.0.1, for measuring
+// client-side overhead without a model. Serves /api/generate (streamed
+// NDJSON or a single JSON body, as requested), /api/embeddings and
+// /api/tags over HTTP/1.1 keep-alive, one thread per connection. A generate
+// request with an empty prompt only loads the model, as in Ollama. POSIX only.
+class MockOllama {
+public:
+    explicit MockOllama(const MockOllamaConfig& config);
+    ~MockOllama();
+    MockOllama(const MockOllama&) = delete;
+    MockOllama& operator=(const MockOllama&) = delete;
+
+    int port() const { return bound_port; }
+    std::string generate_url() const;
+    size_t requests() const { return request_count; }
+
+private:
+    void accept_loop();
+    void serve(int fd);
+
+    MockOllamaConfig config;
+    int listen_fd = -1;
+    int bound_port = 0;
+    std::atomic<bool> stopping{false};
+    std::atomic<size_t> request_count{0};
+    std::atomic<size_t> generate_count{0};
+    std::mutex load_mutex;
+    bool load_started = false;
+    std::chrono::steady_clock::time_point loaded_at; // When the model is loaded, once `load_started`
+    std::thread acceptor;
+    std::mutex connections_mutex;
+    std::vector<int> connection_fds; // Open client sockets, shut down on stop
+    std::vector<std::thread> workers;
+};
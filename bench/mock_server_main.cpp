@@ -0,0 +1,62 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "mock_ollama.hpp"
+
+namespace {
+
+volatile std::sig_atomic_t stop = 0;
+
+void on_signal(int) {
+    stop = 1;
+}
+
+} // namespace
+
+// Standalone mock Ollama server, e.g. to point memoraxx or e2e.sh at
+// without a model: memoraxx_mock --port 11435 --latency-ms 50 --tokens 64.
+// --slow-every and --error-every inject tail latency and 503s, e.g. to try
+// routing over several backends; --load-ms makes the first request pay a
+// model load.
+int main(int argc, char** argv) {
+    MockOllamaConfig config;
+    config.port = 11435;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string flag = argv[i];
+        const long value = std::strtol(argv[i + 1], nullptr, 10);
+        if (flag == "--port") config.port = static_cast<int>(value);
+        else if (flag == "--latency-ms") config.latency_ms = static_cast<int>(value);
+        else if (flag == "--tokens") config.response_tokens = static_cast<size_t>(value);
+        else if (flag == "--token-delay-us") config.token_delay_us = static_cast<int>(value);
+        else if (flag == "--embedding-dim") config.embedding_dim = static_cast<size_t>(value);
+        else if (flag == "--slow-every") config.slow_every = static_cast<size_t>(value);
+        else if (flag == "--slow-ms") config.slow_ms = static_cast<int>(value);
+        else if (flag == "--error-every") config.error_every = static_cast<size_t>(value);
+        else if (flag == "--load-ms") config.load_ms = static_cast<int>(value);
+        else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--port N] [--latency-ms N] [--tokens N] [--token-delay-us N] [--embedding-dim N]\n"
+                      << "       [--slow-every N --slow-ms N] [--error-every N] [--load-ms N]\n";
+            return 1;
+        }
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    try {
+        MockOllama server(config);
+        std::cout << "Mock Ollama listening on " << server.generate_url() << std::endl;
+        while (!stop) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        std::cout << "Served " << server.requests() << " requests" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -82,9 +82,9 @@ bash -c 'echo -e "test prompt\nexit" | ./build/memoraxx' > config_test.txt 2>&1
 CONFIG_PID=$!
 wait $CONFIG_PID 2>/dev/null || true
 
-if [ -f "test_memory.json" ]; then
+if [ -f "test_memory.json.journal" ]; then
     echo "✓ Config and memory persistence test passed"
-    rm test_memory.json
+    rm -f test_memory.json test_memory.json.journal
 else
     echo "✗ Config and memory persistence test failed"
     exit 1
@@ -0,0 +1,271 @@
+#include "backend_pool.hpp"
+
+#include <curl/curl.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+const size_t BACKEND_WINDOW = 64; // Latencies kept per backend
+const size_t POOL_WINDOW = 256; // Latencies kept for the hedge delay
+const size_t MIN_SAMPLES = 16; // Before latency drives hedging or ejection
+const double SLOW_MARGIN_MS = 50.0; // Smaller gaps never count as slow
+
+void add_sample(std::vector<double>& ring, size_t& next, size_t capacity, double value) {
+    if (ring.size() < capacity) {
+        ring.push_back(value);
+    } else {
+        ring[next] = value;
+        next = (next + 1) % capacity;
+    }
+}
+
+double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) return 0.0;
+    const size_t rank = std::min(samples.size() - 1, static_cast<size_t>(p / 100.0 * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+// Ollama lists its models at /api/tags on the same origin as /api/generate
+std::string probe_url(const std::string& url) {
+    const size_t scheme = url.find("://");
+    const size_t path = url.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+    return url.substr(0, path) + "/api/tags";
+}
+
+size_t discard(void*, size_t size, size_t nmemb, void*) {
+    return size * nmemb;
+}
+
+} // namespace
+
+BackendPool::BackendPool(std::vector<BackendConfig> configs, RoutingOptions options) : options(options) {
+    if (configs.empty()) {
+        throw std::invalid_argument("no backends configured");
+    }
+    for (auto& config : configs) {
+        if (config.url.empty()) throw std::invalid_argument("backend without a url");
+        if (config.weight <= 0) throw std::invalid_argument("backend weight must be positive: " + config.url);
+        Backend backend;
+        backend.probe_url = probe_url(config.url);
+        backend.config = std::move(config);
+        backends.push_back(std::move(backend));
+    }
+    if (options.health_interval_ms > 0) {
+        prober = std::thread(&BackendPool::probe_loop, this);
+    }
+}
+
+BackendPool::~BackendPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (prober.joinable()) prober.join();
+}
+
+bool BackendPool::serves(const Backend& backend, const std::string& model) const {
+    const auto& models = backend.config.models;
+    return models.empty() || std::find(models.begin(), models.end(), model) != models.end();
+}
+
+size_t BackendPool::acquire(const std::string& model, size_t avoid) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto now = Clock::now();
+    if (options.health_interval_ms == 0) {
+        // Without probes, an ejected backend is tried again once its time is up
+        for (auto& backend : backends) {
+            if (backend.ejected && now >= backend.ejected_until) {
+                backend.ejected = false;
+                backend.consecutive_failures = 0;
+            }
+        }
+    }
+
+    // Least outstanding requests per weight; ties go to the backend that
+    // has served the least for its weight, so serial requests follow weights
+    auto pick = [&](bool allow_ejected, bool allow_avoided) {
+        size_t best = NONE;
+        double best_load = 0.0, best_share = 0.0;
+        for (size_t i = 0; i < backends.size(); ++i) {
+            const Backend& backend = backends[i];
+            if (!serves(backend, model) || (backend.ejected && !allow_ejected) || (i == avoid && !allow_avoided)) {
+                continue;
+            }
+            const double load = (backend.outstanding + 1) / backend.config.weight;
+            const double share = backend.requests / backend.config.weight;
+            if (best == NONE || load < best_load || (load == best_load && share < best_share)) {
+                best = i;
+                best_load = load;
+                best_share = share;
+            }
+        }
+        return best;
+    };
+    size_t chosen = pick(false, false);
+    if (chosen == NONE) chosen = pick(true, false);
+    if (chosen == NONE) chosen = pick(true, true);
+    if (chosen != NONE) {
+        ++backends[chosen].outstanding;
+        ++backends[chosen].requests;
+    }
+    return chosen;
+}
+
+void BackendPool::finish(size_t index, Outcome outcome, double first_byte_ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Backend& backend = backends[index];
+    --backend.outstanding;
+    switch (outcome) {
+    case Outcome::Success:
+        backend.consecutive_failures = 0;
+        if (first_byte_ms >= 0) {
+            add_sample(backend.latencies, backend.next_latency, BACKEND_WINDOW, first_byte_ms);
+            add_sample(latencies, next_latency, POOL_WINDOW, first_byte_ms);
+            check_slow(backend);
+        }
+        break;
+    case Outcome::Failure:
+        ++backend.failures;
+        if (++backend.consecutive_failures >= options.eject_failures && !backend.ejected) {
+            eject(backend, std::to_string(backend.consecutive_failures) + " consecutive failures");
+        }
+        break;
+    case Outcome::Cancelled:
+        // The wait so far is a lower bound of its latency, which still
+        // exposes a backend that keeps losing hedge races
+        if (first_byte_ms >= 0) {
+            add_sample(backend.latencies, backend.next_latency, BACKEND_WINDOW, first_byte_ms);
+            check_slow(backend);
+        }
+        break;
+    }
+}
+
+void BackendPool::eject(Backend& backend, const std::string& reason) {
+    backend.ejected = true;
+    backend.ejected_until = Clock::now() + std::chrono::milliseconds(options.eject_ms);
+    ++backend.ejections;
+    // Readmitted backends start over, so old samples cannot eject them again
+    backend.latencies.clear();
+    backend.next_latency = 0;
+    std::cerr << "Warning: Backend " << backend.config.url << " ejected for at least " << options.eject_ms / 1000.0
+              << "s: " << reason << std::endl;
+}
+
+void BackendPool::check_slow(Backend& backend) {
+    if (backend.ejected || backend.latencies.size() < MIN_SAMPLES) return;
+    std::vector<double> others;
+    for (const auto& other : backends) {
+        if (&other == &backend || other.ejected || other.latencies.size() < MIN_SAMPLES) continue;
+        others.push_back(percentile(other.latencies, 50));
+    }
+    // Only relative to healthy peers; a lone slow backend is still the best there is
+    if (others.empty()) return;
+    const double median = percentile(others, 50);
+    const double own = percentile(backend.latencies, 50);
+    if (own > options.slow_factor * median && own - median > SLOW_MARGIN_MS) {
+        std::ostringstream reason;
+        reason << std::fixed << std::setprecision(0) << "median first byte " << own << " ms against " << median
+               << " ms on other backends";
+        eject(backend, reason.str());
+    }
+}
+
+size_t BackendPool::available(const std::string& model, size_t exclude) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+    for (size_t i = 0; i < backends.size(); ++i) {
+        if (i != exclude && !backends[i].ejected && serves(backends[i], model)) ++count;
+    }
+    return count;
+}
+
+std::chrono::milliseconds BackendPool::hedge_delay() const {
+    if (!options.hedge || backends.size() < 2) return std::chrono::milliseconds(0);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (latencies.size() < MIN_SAMPLES) return std::chrono::milliseconds(0);
+    const double p95 = percentile(latencies, 95);
+    return std::chrono::milliseconds(std::max<long long>(options.hedge_min_ms, static_cast<long long>(p95 + 1)));
+}
+
+void BackendPool::probe_loop() {
+    CURL* handle = curl_easy_init();
+    if (!handle) {
+        std::cerr << "Warning: Failed to initialize cURL; backend health checks disabled." << std::endl;
+        return;
+    }
+    const long timeout_ms = static_cast<long>(std::min<size_t>(options.health_interval_ms, 2000));
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        wake.wait_for(lock, std::chrono::milliseconds(options.health_interval_ms), [&] { return stopping; });
+        if (stopping) break;
+        for (auto& backend : backends) {
+            // Probe without the lock; the list of backends never changes
+            const std::string url = backend.probe_url;
+            lock.unlock();
+            curl_easy_reset(handle);
+            curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, timeout_ms);
+            curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS, std::min(timeout_ms, 1000L));
+            curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+            curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, discard);
+            long http_code = 0;
+            const bool healthy = curl_easy_perform(handle) == CURLE_OK &&
+                                 curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &http_code) == CURLE_OK &&
+                                 http_code == 200;
+            lock.lock();
+            if (stopping) break;
+            if (!healthy && !backend.ejected) {
+                eject(backend, "health check failed");
+            } else if (healthy && backend.ejected && Clock::now() >= backend.ejected_until) {
+                backend.ejected = false;
+                backend.consecutive_failures = 0;
+            }
+        }
+    }
+    lock.unlock();
+    curl_easy_cleanup(handle);
+}
+
+std::string BackendPool::summary() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    const auto now = Clock::now();
+    for (const auto& backend : backends) {
+        out << "backend " << backend.config.url << ": ";
+        if (backend.ejected) {
+            const double left = std::chrono::duration<double>(backend.ejected_until - now).count();
+            out << "ejected";
+            if (left > 0) {
+                out << " (" << static_cast<long>(std::ceil(left)) << "s left)";
+            } else if (options.health_interval_ms > 0) {
+                out << " (until a health check passes)";
+            }
+        } else {
+            out << "healthy";
+        }
+        out << ", " << backend.outstanding << " in flight, " << backend.requests << " requests, " << backend.failures
+            << " failed, " << backend.ejections << " ejections";
+        if (!backend.latencies.empty()) {
+            out << ", first byte p50 " << percentile(backend.latencies, 50) << " ms";
+        }
+        out << "\n";
+    }
+    if (options.hedge) {
+        out << "hedge delay: ";
+        if (latencies.size() >= MIN_SAMPLES) {
+            out << std::max<double>(options.hedge_min_ms, percentile(latencies, 95) + 1) << " ms\n";
+        } else {
+            out << "waiting for " << MIN_SAMPLES << " responses\n";
+        }
+    }
+    return out.str();
+}
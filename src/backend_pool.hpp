@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One model server, from the "backends" list in config.json
+struct BackendConfig {
+    std::string url; // Generate endpoint, like base_url
+    double weight = 1.0; // Relative share of requests
+    std::vector<std::string> models; // Models it serves; empty serves any
+};
+
+// Health and hedging settings of a BackendPool, set from config.json
+struct RoutingOptions {
+    size_t health_interval_ms = 5000; // Probe period; 0 disables probes
+    size_t eject_failures = 3; // Consecutive failed requests that eject a backend
+    size_t eject_ms = 30000; // Least time an ejected backend sits out
+    double slow_factor = 3.0; // Eject a backend whose median latency is this many times the others'
+    bool hedge = false; // Send a second request to another backend when the first is slow
+    size_t hedge_min_ms = 50; // Lower bound of the hedge delay
+};
+
+// Routes requests over several model servers. Each request goes to the
+// healthy backend serving the model with the fewest requests outstanding
+// for its weight; equally loaded backends take turns by weight. Backends
+// are ejected after consecutive failures, a failed health probe, or a
+// median time to first byte far above the others'. A background thread
+// probes each backend's /api/tags and readmits it once `eject_ms` has
+// passed. The recent latencies of all backends set the hedge delay.
+// Thread-safe; stacks of one process share a pool.
+class BackendPool {
+public:
+    static constexpr size_t NONE = SIZE_MAX;
+
+    enum class Outcome {
+        Success,
+        Failure, // Transport error or error status
+        Cancelled // Lost a hedge race; says nothing about the backend's health
+    };
+
+    BackendPool(std::vector<BackendConfig> backends, RoutingOptions options);
+    ~BackendPool();
+    BackendPool(const BackendPool&) = delete;
+    BackendPool& operator=(const BackendPool&) = delete;
+
+    // Pick a backend serving `model` and count the request as outstanding
+    // until finish(). `avoid` is only picked when nothing else serves the
+    // model, and ejected backends only when no healthy one does. Returns
+    // NONE when no backend serves the model.
+    size_t acquire(const std::string& model, size_t avoid = NONE);
+
+    // Report how a request to `backend` ended. `first_byte_ms` is its time
+    // to first byte, or, for a cancelled request, how long it had waited;
+    // negative when unknown.
+    void finish(size_t backend, Outcome outcome, double first_byte_ms = -1.0);
+
+    const std::string& url(size_t backend) const { return backends[backend].config.url; }
+    size_t size() const { return backends.size(); }
+    bool serves(size_t backend, const std::string& model) const { return serves(backends[backend], model); }
+
+    // Healthy backends serving `model`, not counting `exclude`
+    size_t available(const std::string& model, size_t exclude = NONE) const;
+
+    // How long a request may wait for its first byte before it is hedged:
+    // the 95th percentile of recent latencies, at least `hedge_min_ms`.
+    // Zero while hedging is off or too few requests have finished.
+    std::chrono::milliseconds hedge_delay() const;
+
+    // Table of backend health and load for the `stats` command
+    std::string summary() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Backend {
+        BackendConfig config; // Immutable
+        std::string probe_url; // Immutable
+        size_t outstanding = 0;
+        size_t requests = 0;
+        size_t failures = 0;
+        size_t consecutive_failures = 0;
+        size_t ejections = 0;
+        bool ejected = false;
+        Clock::time_point ejected_until;
+        std::vector<double> latencies; // Ring of recent first byte times
+        size_t next_latency = 0;
+    };
+
+    bool serves(const Backend& backend, const std::string& model) const;
+    // Needs `mutex`
+    void eject(Backend& backend, const std::string& reason);
+    void check_slow(Backend& backend);
+    void probe_loop();
+
+    RoutingOptions options;
+    std::vector<Backend> backends; // Fixed after construction
+    mutable std::mutex mutex; // Guards the Backend state and `latencies`
+    std::vector<double> latencies; // Ring of recent first byte times of every backend
+    size_t next_latency = 0;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread prober;
+};
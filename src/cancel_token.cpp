@@ -0,0 +1,34 @@
+#include "cancel_token.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+int abort_if_cancelled(void* token, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return static_cast<const CancelToken*>(token)->cancelled() ? 1 : 0;
+}
+
+} // namespace
+
+bool CancelToken::sleep_until(std::chrono::steady_clock::time_point until) const {
+    // Short naps rather than a condition variable, which a signal handler
+    // could not notify
+    while (!cancelled()) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= until) return true;
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(until - now,
+                                                                                  std::chrono::milliseconds(POLL_MS)));
+    }
+    return false;
+}
+
+void CancelToken::watch(CURL* handle, const CancelToken* token) {
+    if (!token) {
+        curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 1L);
+        return;
+    }
+    curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, abort_if_cancelled);
+    curl_easy_setopt(handle, CURLOPT_XFERINFODATA, const_cast<CancelToken*>(token));
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+}
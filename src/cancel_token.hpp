@@ -0,0 +1,30 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <atomic>
+#include <chrono>
+
+// Lets another thread or a signal handler abort a request in progress.
+// cancel() is a single lock-free store, so it is async-signal-safe.
+class CancelToken {
+public:
+    void cancel() { flag.store(true); }
+    void reset() { flag.store(false); }
+    bool cancelled() const { return flag.load(); }
+
+    // Sleep until `until`, waking within a few milliseconds of cancel().
+    // Returns false if cancelled.
+    bool sleep_until(std::chrono::steady_clock::time_point until) const;
+
+    // Make `handle` abort its transfer with CURLE_ABORTED_BY_CALLBACK once
+    // `token` is cancelled; a null token turns the check off. cURL runs the
+    // check whenever the transfer is driven, so callers waiting in
+    // curl_multi_poll() should wake up every POLL_MS while a token is set.
+    static void watch(CURL* handle, const CancelToken* token);
+
+    static constexpr int POLL_MS = 20;
+
+private:
+    static_assert(std::atomic<bool>::is_always_lock_free, "cancel() must be async-signal-safe");
+    std::atomic<bool> flag{false};
+};
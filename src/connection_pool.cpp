@@ -0,0 +1,90 @@
+#include "connection_pool.hpp"
+
+#include <stdexcept>
+
+ConnectionPool::ConnectionPool() {
+    share = curl_share_init();
+    if (!share) {
+        throw std::runtime_error("Failed to initialize cURL share handle");
+    }
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_cb);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_cb);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    headers = curl_slist_append(nullptr, "Content-Type: application/json");
+    // Send large bodies at once instead of waiting for 100-continue
+    curl_slist* with_expect = headers ? curl_slist_append(headers, "Expect:") : nullptr;
+    if (!with_expect) {
+        curl_slist_free_all(headers);
+        curl_share_cleanup(share);
+        throw std::runtime_error("Failed to allocate cURL headers");
+    }
+    headers = with_expect;
+}
+
+ConnectionPool::~ConnectionPool() {
+    // Easy handles must go before the share handle they are attached to
+    for (CURL* handle : all) {
+        curl_easy_cleanup(handle);
+    }
+    curl_share_cleanup(share);
+    curl_slist_free_all(headers);
+}
+
+ConnectionPool::Lease ConnectionPool::acquire() {
+    CURL* handle = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        if (!idle.empty()) {
+            handle = idle.back();
+            idle.pop_back();
+        }
+    }
+    if (handle) {
+        // Drops per-request options but keeps the live connection and caches
+        curl_easy_reset(handle);
+    } else {
+        handle = curl_easy_init();
+        if (!handle) {
+            throw std::runtime_error("Failed to initialize cURL");
+        }
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        all.push_back(handle);
+    }
+    curl_easy_setopt(handle, CURLOPT_SHARE, share);
+    // Fallback limits; requests with a deadline of their own replace them
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, 30L);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 5L);
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L); // Handles may be used off the main thread
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
+    return Lease(*this, handle);
+}
+
+void ConnectionPool::release(CURL* handle) {
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    idle.push_back(handle);
+}
+
+void ConnectionPool::record_transfer(CURL* handle) {
+    long new_conns = 0;
+    if (curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &new_conns) != CURLE_OK) return;
+    if (new_conns > 0) {
+        connects += new_conns;
+    } else {
+        ++reuses;
+    }
+}
+
+void ConnectionPool::lock_cb(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+    static_cast<ConnectionPool*>(userptr)->share_locks[data].lock();
+}
+
+void ConnectionPool::unlock_cb(CURL*, curl_lock_data data, void* userptr) {
+    static_cast<ConnectionPool*>(userptr)->share_locks[data].unlock();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Reusable HTTP connection layer.
+// Easy handles are kept alive between requests and share one DNS cache,
+// TLS session cache and connection cache, so only the first request to a
+// host pays for name resolution and the TCP/TLS handshake.
+class ConnectionPool {
+public:
+    // RAII handle borrowed from the pool; returned on destruction.
+    class Lease {
+    public:
+        Lease(ConnectionPool& pool, CURL* handle) : pool(&pool), handle(handle) {}
+        Lease(Lease&& other) noexcept : pool(other.pool), handle(other.handle) {
+            other.handle = nullptr;
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+        ~Lease() {
+            if (handle) pool->release(handle);
+        }
+        CURL* get() const { return handle; }
+
+    private:
+        ConnectionPool* pool;
+        CURL* handle;
+    };
+
+    ConnectionPool();
+    ~ConnectionPool();
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // Borrow an idle handle, or create a new one attached to the shared caches
+    Lease acquire();
+
+    // Shared "Content-Type: application/json" header list
+    curl_slist* json_headers() const { return headers; }
+
+    // Record whether the last transfer on `handle` opened a new connection
+    void record_transfer(CURL* handle);
+
+    size_t new_connections() const { return connects; }
+    size_t reused_connections() const { return reuses; }
+
+private:
+    void release(CURL* handle);
+
+    static void lock_cb(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr);
+    static void unlock_cb(CURL* handle, curl_lock_data data, void* userptr);
+
+    CURLSH* share;
+    curl_slist* headers;
+    std::mutex idle_mutex;
+    std::vector<CURL*> idle; // Handles ready for reuse
+    std::vector<CURL*> all; // Every handle created, for cleanup
+    std::mutex share_locks[CURL_LOCK_DATA_LAST];
+    std::atomic<size_t> connects{0};
+    std::atomic<size_t> reuses{0};
+};
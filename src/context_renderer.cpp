@@ -0,0 +1,96 @@
+#include "context_renderer.hpp"
+
+void ContextRenderer::append_escaped(std::string& out, std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    size_t run_start = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        // Copy the unescaped run in one go, then the escape sequence
+        out.append(text.data() + run_start, i - run_start);
+        run_start = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                out += "\\u00";
+                out += HEX[c >> 4];
+                out += HEX[c & 0xf];
+        }
+    }
+    out.append(text.data() + run_start, text.size() - run_start);
+}
+
+void ContextRenderer::set_preamble(std::string_view text) {
+    escaped_preamble.clear();
+    append_escaped(escaped_preamble, text);
+}
+
+void ContextRenderer::append(const Interaction& interaction) {
+    append(interaction.prompt, interaction.response);
+}
+
+void ContextRenderer::append(std::string_view prompt, std::string_view response) {
+    offsets.push_back(buffer.size());
+    render_interaction(buffer, prompt, response);
+}
+
+void ContextRenderer::evict_front() {
+    if (offsets.empty()) return;
+    offsets.pop_front();
+    head = offsets.empty() ? buffer.size() : offsets.front();
+    // Reclaim dead bytes once they outweigh the live history (amortized O(1))
+    if (head > buffer.size() - head) {
+        buffer.erase(0, head);
+        for (auto& offset : offsets) offset -= head;
+        head = 0;
+        // Give back what a burst of long turns left behind
+        if (buffer.capacity() > 64 * 1024 && buffer.capacity() > 4 * buffer.size()) {
+            buffer.shrink_to_fit();
+        }
+    }
+}
+
+void ContextRenderer::clear() {
+    buffer.clear();
+    offsets.clear();
+    head = 0;
+}
+
+void ContextRenderer::rebuild(const std::deque<Interaction>& memory) {
+    clear();
+    for (const auto& interaction : memory) {
+        append(interaction);
+    }
+}
+
+void ContextRenderer::rebuild(const TurnStore& memory) {
+    clear();
+    memory.for_each([this](std::string_view prompt, std::string_view response, int) { append(prompt, response); });
+}
+
+void ContextRenderer::render_interaction(std::string& out, const Interaction& interaction) {
+    render_interaction(out, interaction.prompt, interaction.response);
+}
+
+void ContextRenderer::render_interaction(std::string& out, std::string_view prompt, std::string_view response) {
+    out += "User: ";
+    append_escaped(out, prompt);
+    out += "\\nAssistant: ";
+    append_escaped(out, response);
+    out += "\\n\\n";
+}
+
+std::string ContextRenderer::render_prompt(std::string_view prompt) {
+    std::string out;
+    out.reserve(prompt.size() + 24);
+    out += "User: ";
+    append_escaped(out, prompt);
+    out += "\\nAssistant:";
+    return out;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+
+#include "interaction.hpp"
+#include "turn_store.hpp"
+
+// Incrementally maintained, JSON-escaped rendering of the prompt context.
+// The tool/system preamble is rendered once, each stored interaction is
+// appended as one "User: ...\nAssistant: ...\n\n" segment, and evicting the
+// oldest interaction only advances an offset. Building a request therefore
+// costs O(new turn) instead of re-rendering the whole history.
+class ContextRenderer {
+public:
+    // Render and store the preamble that precedes the history
+    void set_preamble(std::string_view text);
+
+    void append(const Interaction& interaction);
+    void append(std::string_view prompt, std::string_view response);
+    void evict_front();
+    void clear();
+
+    // Re-render the history from scratch, e.g. after loading memory
+    void rebuild(const std::deque<Interaction>& memory);
+    void rebuild(const TurnStore& memory);
+
+    // Escaped preamble and history, ready to be placed inside a JSON string
+    std::string_view preamble() const { return escaped_preamble; }
+    std::string_view history() const {
+        return std::string_view(buffer).substr(head);
+    }
+
+    // Append one escaped history segment to `out`
+    static void render_interaction(std::string& out, const Interaction& interaction);
+    static void render_interaction(std::string& out, std::string_view prompt, std::string_view response);
+
+    // Escaped "User: <prompt>\nAssistant:" for the turn being asked
+    static std::string render_prompt(std::string_view prompt);
+
+    size_t turns() const { return offsets.size(); }
+
+    // Append `text` to `out` with JSON string escaping
+    static void append_escaped(std::string& out, std::string_view text);
+
+private:
+    std::string escaped_preamble;
+    std::string buffer; // Escaped history segments; bytes before `head` are dead
+    size_t head = 0;
+    std::deque<size_t> offsets; // Start of each live segment in `buffer`
+};
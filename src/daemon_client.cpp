@@ -0,0 +1,129 @@
+#include "daemon_client.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+namespace {
+
+size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
+    userp->append(static_cast<char*>(contents), size * nmemb);
+    return size * nmemb;
+}
+
+} // namespace
+
+DaemonClient::DaemonClient(const std::string& endpoint, std::string session_id)
+    : session(std::move(session_id)), curl(curl_easy_init()) {
+    if (!curl) throw std::runtime_error("failed to initialize cURL");
+    Endpoint parsed = Endpoint::parse(endpoint);
+    if (!parsed.unix_path.empty()) {
+        unix_path = parsed.unix_path;
+        base = "http://localhost";
+    } else {
+        const bool ipv6 = parsed.host.find(':') != std::string::npos;
+        base = "http://" + (ipv6 ? "[" + parsed.host + "]" : parsed.host) + ":" + std::to_string(parsed.port);
+    }
+}
+
+DaemonClient::~DaemonClient() {
+    curl_easy_cleanup(curl);
+}
+
+json DaemonClient::call(const char* method, const std::string& path, const std::string& body, long& status,
+                        const CancelToken* cancel) {
+    std::string response;
+    std::string url = base + path;
+    curl_easy_reset(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    if (!unix_path.empty()) curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, unix_path.c_str());
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+    curl_slist* headers = nullptr;
+    if (std::string(method) == "POST") {
+        headers = curl_slist_append(headers, "Content-Type: application/json");
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(body.size()));
+    }
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    CancelToken::watch(curl, cancel);
+    CURLcode res = curl_easy_perform(curl);
+    curl_slist_free_all(headers);
+    if (res != CURLE_OK) {
+        throw std::runtime_error("cannot reach daemon: " + std::string(curl_easy_strerror(res)));
+    }
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    json parsed = json::parse(response, nullptr, false);
+    if (parsed.is_discarded()) throw std::runtime_error("malformed daemon response (HTTP " + std::to_string(status) + ")");
+    return parsed;
+}
+
+std::string DaemonClient::completion(const std::string& prompt, bool use_cache, CompletionStats& stats,
+                                     const RequestControl& control) {
+    json body = {{"prompt", prompt}, {"cache", use_cache}};
+    if (control.timeout.count() > 0) body["timeout_ms"] = control.timeout.count();
+    long status = 0;
+    json reply;
+    try {
+        reply = call("POST", "/v1/sessions/" + session + "/completion", body.dump(), status, control.cancel);
+    } catch (const std::runtime_error&) {
+        if (!control.cancel || !control.cancel->cancelled()) throw;
+        // Stop the turn on the daemon too, so it does not reach the session's memory
+        try {
+            call("POST", "/v1/sessions/" + session + "/cancel", "{}", status);
+        } catch (const std::exception&) {
+            // The daemon finishes the turn
+        }
+        stats = CompletionStats{};
+        stats.failed = true;
+        stats.cancelled = true;
+        return "Error: Request cancelled";
+    }
+    stats = reply.contains("stats") ? reply["stats"].get<CompletionStats>() : CompletionStats{};
+    if (reply.contains("response")) return reply["response"].get<std::string>();
+    stats.failed = true;
+    return reply.value("error", "Error: HTTP " + std::to_string(status));
+}
+
+std::vector<ArchiveHit> DaemonClient::search_archive(const std::string& query, size_t k) {
+    long status = 0;
+    json reply = call("POST", "/v1/sessions/" + session + "/search", json{{"query", query}, {"k", k}}.dump(), status);
+    if (status != 200) throw std::runtime_error(reply.value("error", "HTTP " + std::to_string(status)));
+    return reply.value("hits", json::array()).get<std::vector<ArchiveHit>>();
+}
+
+size_t DaemonClient::recall_archived(const std::vector<uint32_t>& ids) {
+    long status = 0;
+    json reply = call("POST", "/v1/sessions/" + session + "/recall", json{{"ids", ids}}.dump(), status);
+    if (status != 200) throw std::runtime_error(reply.value("error", "HTTP " + std::to_string(status)));
+    return reply.value("recalled", size_t{0});
+}
+
+void DaemonClient::clear_memory() {
+    long status = 0;
+    json reply = call("POST", "/v1/sessions/" + session + "/clear", "{}", status);
+    if (status != 200) throw std::runtime_error(reply.value("error", "HTTP " + std::to_string(status)));
+}
+
+std::string DaemonClient::export_memory() {
+    long status = 0;
+    json reply = call("POST", "/v1/sessions/" + session + "/export", "{}", status);
+    if (status != 200) throw std::runtime_error(reply.value("error", "HTTP " + std::to_string(status)));
+    return reply.value("memory_file", "");
+}
+
+std::string DaemonClient::stats() {
+    long status = 0;
+    json reply = call("GET", "/v1/stats", "", status);
+    if (status != 200) throw std::runtime_error(reply.value("error", "HTTP " + std::to_string(status)));
+    std::ostringstream out;
+    out << "daemon: " << reply.value("sessions_loaded", 0) << " sessions loaded ("
+        << reply.value("session_bytes", size_t{0}) / 1048576.0 << " of "
+        << reply.value("session_budget_bytes", size_t{0}) / 1048576.0 << " MB), "
+        << reply.value("session_unloads", 0) << " unloaded, " << reply.value("requests", 0) << " requests, "
+        << reply.value("workers", 0) << " workers\n"
+        << reply.value("summary", "");
+    return out.str();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <string>
+#include <vector>
+
+#include "metrics.hpp"
+#include "session_server.hpp"
+
+// Blocking client for one session of a memoraxx daemon, used by the REPL in
+// thin client mode (--connect). The keep-alive connection is reused across
+// calls. Failures are thrown as std::runtime_error.
+class DaemonClient {
+public:
+    DaemonClient(const std::string& endpoint, std::string session);
+    ~DaemonClient();
+    DaemonClient(const DaemonClient&) = delete;
+    DaemonClient& operator=(const DaemonClient&) = delete;
+
+    // Send a prompt to the session; fills `stats` with the daemon's stats of
+    // the turn. Returns the response, or the error message as completion() does.
+    // A cancelled `control` token abandons the call and cancels the turn on
+    // the daemon; its timeout is passed on to the daemon.
+    std::string completion(const std::string& prompt, bool use_cache, CompletionStats& stats,
+                           const RequestControl& control = {});
+
+    // Ranked turns from the session's archive, as LlamaStack::search_archive()
+    std::vector<ArchiveHit> search_archive(const std::string& query, size_t k);
+
+    // Returns how many turns were brought back, as LlamaStack::recall_archived()
+    size_t recall_archived(const std::vector<uint32_t>& ids);
+
+    void clear_memory();
+
+    // Returns the path the daemon exported the session's memory to
+    std::string export_memory();
+
+    // Daemon counters and metrics summary, formatted for the `stats` command
+    std::string stats();
+
+private:
+    // Send a request; returns the parsed JSON body of any HTTP status
+    nlohmann::json call(const char* method, const std::string& path, const std::string& body, long& status,
+                        const CancelToken* cancel = nullptr);
+
+    std::string base; // "http://host:port" or "http://localhost" for a Unix socket
+    std::string unix_path;
+    std::string session;
+    CURL* curl;
+};
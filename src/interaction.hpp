@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Structure to hold prompt-response pairs
+struct Interaction {
+    std::string prompt;
+    std::string response;
+    int token_count;
+};
+
+// Rolling summary of the turns evicted from memory
+struct MemorySummary {
+    std::string text;
+    int token_count = 0;
+    size_t turns = 0; // Evicted turns it covers
+    long long source_tokens = 0; // Tokens those turns took in full
+};
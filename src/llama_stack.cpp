@@ -0,0 +1,1352 @@
+#include "llama_stack.hpp"
+
+#include <curl/curl.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "multi_client.hpp"
+#include "response_decoder.hpp"
+#include "stream_decoder.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Callback function to collect cURL response
+size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
+    size_t total_size = size * nmemb;
+    userp->append(static_cast<char*>(contents), total_size);
+    return total_size;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int64_t unix_time() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Limit a transfer to the time left until `deadline`, replacing the pool's
+// defaults. Rounded up, so cURL never gives up before the deadline; cURL
+// reads 0 as no limit.
+void set_timeouts(CURL* handle, std::chrono::steady_clock::time_point deadline, size_t connect_ms) {
+    long total_ms = 0;
+    if (deadline != std::chrono::steady_clock::time_point::max()) {
+        const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        total_ms = std::max<long>(1, static_cast<long>(left.count()));
+    }
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, total_ms);
+    const long connect = static_cast<long>(connect_ms);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS, total_ms > 0 && connect > 0 ? std::min(connect, total_ms) : connect);
+}
+
+// cURL times transfers on its own clock, which can run out a little before ours
+const std::chrono::milliseconds DEADLINE_SLACK(10);
+
+// Sleep until `until`; false if `cancel` fired first
+bool sleep_until(std::chrono::steady_clock::time_point until, const CancelToken* cancel) {
+    if (cancel) return cancel->sleep_until(until);
+    std::this_thread::sleep_until(until);
+    return true;
+}
+
+// curl_multi handle that detaches its remaining transfers on destruction
+class MultiHandle {
+public:
+    MultiHandle() : multi(curl_multi_init()) {
+        if (!multi) {
+            throw std::runtime_error("Failed to initialize cURL multi handle");
+        }
+    }
+    ~MultiHandle() {
+        for (CURL* handle : added) curl_multi_remove_handle(multi, handle);
+        curl_multi_cleanup(multi);
+    }
+    MultiHandle(const MultiHandle&) = delete;
+    MultiHandle& operator=(const MultiHandle&) = delete;
+
+    CURLM* get() const { return multi; }
+    void add(CURL* handle) {
+        curl_multi_add_handle(multi, handle);
+        added.push_back(handle);
+    }
+    void remove(CURL* handle) {
+        curl_multi_remove_handle(multi, handle);
+        added.erase(std::find(added.begin(), added.end(), handle));
+    }
+
+private:
+    CURLM* multi;
+    std::vector<CURL*> added;
+};
+
+} // namespace
+
+std::chrono::milliseconds retry_backoff(int retry) {
+    thread_local std::mt19937 rng{std::random_device{}()};
+    const long base_ms = 1000L << std::min(retry, 10);
+    return std::chrono::milliseconds(base_ms / 2 + std::uniform_int_distribution<long>(0, base_ms / 2)(rng));
+}
+
+int count_tokens(const std::string& text) {
+    std::istringstream iss(text);
+    int word_count = std::distance(std::istream_iterator<std::string>{iss}, std::istream_iterator<std::string>{});
+    return static_cast<int>(word_count * 1.3);
+}
+
+LlamaStack::LlamaStack(const std::string& url,
+                       const std::string& model,
+                       size_t max_tokens,
+                       const std::string& mem_file,
+                       const LlamaOptions& options)
+    : base_url(url), model_name(model), memory(options.memory_compression), max_tokens(max_tokens), total_tokens(0),
+      memory_file(mem_file), options(options) {
+    if (options.warm_up) {
+        // First, so the model loads while memory is read
+        std::vector<std::string> urls;
+        if (options.backends) {
+            for (size_t i = 0; i < options.backends->size(); ++i) {
+                if (options.backends->serves(i, model_name)) urls.push_back(options.backends->url(i));
+            }
+        } else {
+            urls.push_back(base_url);
+        }
+        RequestBody body;
+        body.append("{\"model\":\"");
+        body.append_escaped(model_name);
+        body.append("\",\"prompt\":\"\"");
+        finish_payload(body);
+        warm_up.start(connections, std::move(urls), std::move(body),
+                      std::chrono::milliseconds(options.request_timeout_ms));
+    }
+    if (this->options.retrieval) {
+        open_retrieval();
+    }
+    if (options.summarize) {
+        // Taken from the history's share of the window, like pinned turns
+        summary_budget = std::min(options.summary_tokens > 0 ? options.summary_tokens : max_tokens / 8,
+                                  (max_tokens - retrieval_budget) / 2);
+    }
+    if (!options.tokenizer_file.empty()) {
+        tokenizer = shared_tokenizer(options.tokenizer_file);
+    }
+    if (!memory_file.empty()) {
+        journal = std::make_unique<MemoryJournal>(memory_file + ".journal");
+        load_memory();
+        if (retrieval) match_retrieval_ids();
+        if (this->options.archive) {
+            open_archive();
+        }
+    }
+    // Initialize tools
+    Tool run_cmd = {
+        "run_command",
+        "Run a shell command and return the output",
+        json{
+            {"type", "object"},
+            {"properties", {
+                {"command", json{{"type", "string"}, {"description", "The shell command to run"}}}
+            }},
+            {"required", json::array({"command"})}
+        }
+    };
+    tools.push_back(run_cmd);
+    tool_executor = std::make_unique<ToolExecutor>(this->options.tool_workers,
+                                                   std::chrono::milliseconds(this->options.tool_timeout_ms),
+                                                   this->options.tool_output_bytes);
+    tool_executor->add("run_command", [](const json& args, ToolExecutor::Clock::time_point deadline, size_t max_output,
+                                         const CancelToken* cancel) {
+        if (!args.contains("command") || !args["command"].is_string()) {
+            ToolResult missing;
+            missing.output = "Error: Missing command argument";
+            missing.failed = true;
+            return missing;
+        }
+        auto start = ToolExecutor::Clock::now();
+        ToolResult result = run_shell_command(args["command"].get<std::string>(), deadline, max_output, cancel);
+        result.output.insert(0, "Command output:\n");
+        if (result.truncated) {
+            result.output += "\n[output truncated: " + std::to_string(max_output) + " of " +
+                             std::to_string(result.bytes) + " bytes shown]";
+        }
+        if (result.timed_out) {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - start).count();
+            result.output += "\n[command timed out after " + std::to_string(ms) + " ms and was killed]";
+        }
+        if (result.cancelled) result.output += "\n[command cancelled and killed]";
+        return result;
+    });
+    if (this->options.response_cache) {
+        if (this->options.response_cache_file.empty() && !memory_file.empty()) {
+            this->options.response_cache_file = memory_file + ".cache";
+        }
+        cache = shared_response_cache(this->options.response_cache_file, this->options.response_cache_bytes);
+    }
+    render_preamble(); // The history was rendered as it was loaded
+    if (this->options.summarize) {
+        open_summarizer();
+    }
+    if (this->options.session_context) {
+        load_session();
+    }
+}
+
+LlamaStack::~LlamaStack() {
+    // Keep a summary that finished after the last turn
+    adopt_summary();
+    if (options.session_context) {
+        save_session();
+    }
+}
+
+void LlamaStack::clear_memory() {
+    memory.clear();
+    context.clear();
+    session_context.clear();
+    total_tokens = 0;
+    retrieval_ids.clear();
+    // The archive keeps the cleared turns; only those brought back are dropped
+    pinned.clear();
+    pinned_context.clear();
+    pinned_tokens = 0;
+    summary = MemorySummary{};
+    summary_context.clear();
+    if (summarizer) summarizer->reset();
+    if (retrieval) {
+        try {
+            retrieval->clear();
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to clear vector index: " << e.what() << std::endl;
+        }
+    }
+    if (journal) {
+        try {
+            journal->record_clear();
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to save memory: " << e.what() << std::endl;
+        }
+    }
+    std::cout << "Memory cleared.\n";
+}
+
+void LlamaStack::export_memory() {
+    if (memory_file.empty()) {
+        std::cout << "No memory file configured.\n";
+        return;
+    }
+    if (export_memory(memory_file)) {
+        std::cout << "Memory exported to " << memory_file << ".\n";
+    }
+}
+
+std::string LlamaStack::completion(const std::string& prompt,
+                               const std::function<void(const std::string&)>& on_token,
+                               bool use_cache, const RequestControl& control) {
+    if (prompt.empty()) {
+        return "Error: Empty prompt provided";
+    }
+
+    auto request_start = std::chrono::steady_clock::now();
+
+    try {
+        PendingTurn turn = prepare_turn(prompt, control);
+        turn.use_cache = use_cache;
+        std::string result;
+        std::vector<int> returned_context;
+        while (true) {
+            if (cached_response(turn, result, returned_context)) {
+                if (on_token) on_token(result);
+            } else {
+                result = request(turn, on_token, returned_context, request_start);
+                cache_response(turn, result, returned_context);
+            }
+            if (!continue_turn(turn, result)) break;
+            // Streamed text so far was a tool call; mark where the tools ran
+            if (on_token) on_token("\n[" + std::to_string(stats.tool_runs.size()) + " tool call(s) done]\n");
+        }
+
+        result = finish_turn(turn, std::move(result), std::move(returned_context));
+        record_phase(Phase::Total, elapsed_ms(request_start));
+        return result;
+    } catch (const json::exception& e) {
+        stats.failed = true;
+        record_phase(Phase::Total, elapsed_ms(request_start));
+        return "JSON parse error: " + std::string(e.what());
+    } catch (const std::exception& e) {
+        stats.failed = true;
+        record_phase(Phase::Total, elapsed_ms(request_start));
+        return "Error: " + std::string(e.what());
+    }
+}
+
+struct LlamaStack::Attempt {
+    explicit Attempt(ConnectionPool::Lease lease) : lease(std::move(lease)) {}
+
+    size_t backend = BackendPool::NONE;
+    ConnectionPool::Lease lease;
+    StreamDecoder decoder;
+    RequestBody::Cursor request; // Read position in the turn's payload
+    std::string body; // Response body when not streaming
+    CURLcode result = CURLE_OK;
+    long http_code = 0;
+    bool finished = false;
+    bool stream = false;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point deadline; // Of the turn
+    // First byte of the response body. Stamped here: with the body uploaded
+    // through CURLOPT_READFUNCTION, CURLINFO_STARTTRANSFER_TIME marks the
+    // start of the upload instead
+    std::chrono::steady_clock::time_point first_byte;
+
+    // CURLOPT_WRITEFUNCTION: note the first byte, then decode or buffer
+    static size_t write(void* contents, size_t size, size_t nmemb, Attempt* attempt) {
+        if (attempt->first_byte == std::chrono::steady_clock::time_point{}) {
+            attempt->first_byte = std::chrono::steady_clock::now();
+        }
+        return attempt->stream ? StreamCallback(contents, size, nmemb, &attempt->decoder)
+                               : WriteCallback(contents, size, nmemb, &attempt->body);
+    }
+
+    // Start to first response byte, or -1 before one arrived
+    double first_byte_ms() const {
+        if (first_byte == std::chrono::steady_clock::time_point{}) return -1.0;
+        return std::chrono::duration<double, std::milli>(first_byte - started).count();
+    }
+
+    // Stopped by the turn's cancel token or deadline, which says nothing about the server
+    bool abandoned() const {
+        return result == CURLE_ABORTED_BY_CALLBACK ||
+               (result == CURLE_OPERATION_TIMEDOUT && std::chrono::steady_clock::now() + DEADLINE_SLACK >= deadline);
+    }
+    // Transport errors, 5xx and errors reported in the stream count against the server
+    bool server_failed() const { return result != CURLE_OK || http_code >= 500 || !decoder.error.empty(); }
+    bool succeeded() const { return finished && !server_failed() && http_code == 200; }
+};
+
+std::unique_ptr<LlamaStack::Attempt> LlamaStack::start_attempt(size_t backend, const PendingTurn& turn,
+                                                               const std::function<void(const std::string&)>& on_token) {
+    auto attempt = std::make_unique<Attempt>(connections.acquire());
+    attempt->backend = backend;
+    attempt->decoder.on_token = on_token;
+    attempt->decoder.keep_context = options.session_context;
+    attempt->started = std::chrono::steady_clock::now();
+    attempt->deadline = turn.deadline;
+    CURL* curl_handle = attempt->lease.get();
+    const std::string& url = backend == BackendPool::NONE ? base_url : options.backends->url(backend);
+    curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str());
+    turn.payload.attach(curl_handle, attempt->request);
+    set_timeouts(curl_handle, turn.deadline, options.connect_timeout_ms);
+    CancelToken::watch(curl_handle, turn.cancel);
+    attempt->stream = options.stream;
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, Attempt::write);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, attempt.get());
+    return attempt;
+}
+
+void LlamaStack::report(const Attempt& attempt) {
+    if (attempt.backend == BackendPool::NONE) return;
+    if (attempt.abandoned()) {
+        // Like a lost hedge race: the first byte, or the wait so far, is still a latency sample
+        const double first_byte_ms = attempt.first_byte_ms();
+        options.backends->finish(attempt.backend, BackendPool::Outcome::Cancelled,
+                                 first_byte_ms >= 0 ? first_byte_ms : elapsed_ms(attempt.started));
+        return;
+    }
+    if (attempt.server_failed()) {
+        options.backends->finish(attempt.backend, BackendPool::Outcome::Failure);
+        return;
+    }
+    options.backends->finish(attempt.backend, BackendPool::Outcome::Success,
+                             attempt.http_code == 200 ? attempt.first_byte_ms() : -1.0);
+}
+
+std::unique_ptr<LlamaStack::Attempt> LlamaStack::perform(const PendingTurn& turn,
+                                                         const std::function<void(const std::string&)>& on_token,
+                                                         size_t avoid) {
+    BackendPool* pool = options.backends.get();
+    size_t backend = BackendPool::NONE;
+    if (pool) {
+        backend = pool->acquire(model_name, avoid);
+        if (backend == BackendPool::NONE) {
+            throw std::runtime_error("No backend serves model " + model_name);
+        }
+    }
+    auto complete = [&](Attempt& attempt, CURLcode result) {
+        attempt.result = result;
+        attempt.finished = true;
+        curl_easy_getinfo(attempt.lease.get(), CURLINFO_RESPONSE_CODE, &attempt.http_code);
+        connections.record_transfer(attempt.lease.get());
+        report(attempt);
+    };
+
+    // Requests run on a private multi handle, whose loop wakes up often
+    // enough to notice a cancelled token. When hedged, a streamed request
+    // wins with its first token, since tokens shown cannot be taken back;
+    // otherwise the first successful response wins.
+    const std::chrono::milliseconds hedge_delay = pool ? pool->hedge_delay() : std::chrono::milliseconds(0);
+    std::unique_ptr<Attempt> attempts[2];
+    const size_t NO_WINNER = 2;
+    size_t winner = NO_WINNER;
+    auto forward = [&](size_t i) {
+        return [&, i](const std::string& token) {
+            if (winner == NO_WINNER) winner = i;
+            if (winner == i && on_token) on_token(token);
+        };
+    };
+    MultiHandle multi;
+    attempts[0] = start_attempt(backend, turn, forward(0));
+    multi.add(attempts[0]->lease.get());
+    const auto hedge_at = attempts[0]->started + hedge_delay;
+    bool hedge_tried = hedge_delay.count() == 0;
+    auto running = [&](size_t i) { return attempts[i] && !attempts[i]->finished; };
+
+    while (true) {
+        int still_running = 0;
+        curl_multi_perform(multi.get(), &still_running);
+        int queued = 0;
+        while (CURLMsg* message = curl_multi_info_read(multi.get(), &queued)) {
+            if (message->msg != CURLMSG_DONE) continue;
+            for (size_t i = 0; i < 2; ++i) {
+                if (!attempts[i] || attempts[i]->lease.get() != message->easy_handle) continue;
+                multi.remove(message->easy_handle);
+                complete(*attempts[i], message->data.result);
+                if (attempts[i]->succeeded() && winner == NO_WINNER) winner = i;
+            }
+        }
+
+        if (winner != NO_WINNER) {
+            const size_t loser = 1 - winner;
+            if (running(loser)) {
+                multi.remove(attempts[loser]->lease.get());
+                // Only the first request's wait says anything about its backend
+                pool->finish(attempts[loser]->backend, BackendPool::Outcome::Cancelled,
+                             loser == 0 ? elapsed_ms(attempts[loser]->started) : -1.0);
+                attempts[loser].reset();
+            }
+            if (attempts[winner]->finished) {
+                if (winner == 1) ++stats.hedge_wins;
+                attempts[winner]->decoder.on_token = on_token;
+                return std::move(attempts[winner]);
+            }
+        } else if (!running(0) && !running(1)) {
+            // Both failed, or the first failed before the hedge was sent
+            const size_t last = attempts[1] ? 1 : 0;
+            attempts[last]->decoder.on_token = on_token;
+            return std::move(attempts[last]);
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (!hedge_tried && winner == NO_WINNER && now >= hedge_at) {
+            hedge_tried = true;
+            const size_t second = pool->acquire(model_name, attempts[0]->backend);
+            if (second == attempts[0]->backend) {
+                pool->finish(second, BackendPool::Outcome::Cancelled); // No other backend to hedge on
+            } else {
+                attempts[1] = start_attempt(second, turn, forward(1));
+                multi.add(attempts[1]->lease.get());
+                ++stats.hedges;
+            }
+        }
+        long wait_ms = hedge_tried ? 1000
+                     : std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(hedge_at - now).count() + 1);
+        if (turn.cancel) wait_ms = std::min<long>(wait_ms, CancelToken::POLL_MS);
+        curl_multi_poll(multi.get(), nullptr, 0, static_cast<int>(wait_ms), nullptr);
+    }
+}
+
+void LlamaStack::check_deadline(const PendingTurn& turn) {
+    if (turn.cancel && turn.cancel->cancelled()) {
+        stats.cancelled = true;
+        throw std::runtime_error("Request cancelled");
+    }
+    if (std::chrono::steady_clock::now() + DEADLINE_SLACK >= turn.deadline) {
+        stats.timed_out = true;
+        const auto budget = std::chrono::duration_cast<std::chrono::milliseconds>(turn.deadline - turn.started);
+        throw std::runtime_error("Timed out after " + std::to_string(budget.count()) + " ms");
+    }
+}
+
+std::string LlamaStack::request(const PendingTurn& turn, const std::function<void(const std::string&)>& on_token,
+                                std::vector<int>& returned_context, std::chrono::steady_clock::time_point turn_start) {
+    BackendPool* pool = options.backends.get();
+
+    // Perform the request with retry
+    const int MAX_ATTEMPTS = 3;
+    std::unique_ptr<Attempt> attempt;
+    size_t avoid = BackendPool::NONE;
+    for (int n = 0;; ++n) {
+        check_deadline(turn);
+        attempt = perform(turn, on_token, avoid);
+        avoid = attempt->backend;
+        const StreamDecoder& decoder = attempt->decoder;
+        if (!decoder.error.empty()) {
+            throw std::runtime_error(decoder.error);
+        }
+        if (attempt->result == CURLE_OK && attempt->http_code == 200) {
+            break;
+        }
+        if (attempt->abandoned()) {
+            check_deadline(turn);
+        }
+
+        // Transport errors and 5xx are retried. Tokens already shown to the
+        // user cannot be taken back, so a stream that broke midway is not.
+        const std::string error = attempt->result != CURLE_OK
+            ? "cURL error: " + std::string(curl_easy_strerror(attempt->result))
+            : "HTTP error: " + std::to_string(attempt->http_code);
+        const bool retryable = (attempt->result != CURLE_OK || attempt->http_code >= 500) && !decoder.got_first_token;
+        if (!retryable || n + 1 == MAX_ATTEMPTS) {
+            throw std::runtime_error(error);
+        }
+        // A retry on another healthy backend goes out right away; the same
+        // server gets time to recover, if the deadline leaves any
+        if (!pool || pool->available(model_name, avoid) == 0) {
+            const auto resume = std::chrono::steady_clock::now() + retry_backoff(n);
+            if (resume >= turn.deadline) {
+                throw std::runtime_error(error + " (no time left to retry)");
+            }
+            if (!sleep_until(resume, turn.cancel)) {
+                check_deadline(turn);
+            }
+        }
+    }
+    if (pool) stats.backend = pool->url(attempt->backend);
+    CURL* curl_handle = attempt->lease.get();
+    StreamDecoder& decoder = attempt->decoder;
+
+    // Transport phases of the final attempt
+    curl_off_t pretransfer_us = 0, total_us = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_PRETRANSFER_TIME_T, &pretransfer_us);
+    curl_easy_getinfo(curl_handle, CURLINFO_TOTAL_TIME_T, &total_us);
+    const double connect_ms = pretransfer_us / 1000.0;
+    const double total_ms = total_us / 1000.0;
+    const double first_byte_ms = attempt->first_byte_ms() < 0 ? total_ms
+                               : std::clamp(attempt->first_byte_ms(), connect_ms, total_ms);
+    record_phase(Phase::Connect, connect_ms);
+    record_phase(Phase::FirstByte, first_byte_ms - connect_ms);
+    record_phase(Phase::Transfer, total_ms - first_byte_ms);
+
+    std::string result;
+    if (options.stream) {
+        ++stats.agent_steps;
+        decoder.finish();
+        if (!decoder.error.empty()) {
+            throw std::runtime_error(decoder.error);
+        }
+        if (!decoder.done && !decoder.got_first_token) {
+            throw std::runtime_error("No 'response' field in API output");
+        }
+        result = std::move(decoder.assembled);
+        returned_context = std::move(decoder.context);
+        // Counters add up over the steps of an agent turn
+        stats.eval_count += decoder.eval_count;
+        stats.prompt_eval_count += decoder.prompt_eval_count;
+        stats.server_total_ms += decoder.total_duration / 1e6;
+        stats.load_ms += decoder.load_duration / 1e6;
+        stats.prompt_eval_ms += decoder.prompt_eval_duration / 1e6;
+        stats.eval_ms += decoder.eval_duration / 1e6;
+        record_phase(Phase::Parse, decoder.parse_ms);
+        if (decoder.got_first_token) {
+            auto now = std::chrono::steady_clock::now();
+            if (stats.time_to_first_token == 0.0) {
+                stats.time_to_first_token = std::chrono::duration<double>(decoder.first_token_time - turn_start).count();
+            }
+            // Prefer the server's own generation timing; fall back to wall time after the first token
+            double gen_seconds = decoder.eval_duration > 0
+                ? decoder.eval_duration / 1e9
+                : std::chrono::duration<double>(now - decoder.first_token_time).count();
+            if (decoder.eval_count > 0 && gen_seconds > 0) {
+                stats.tokens_per_sec = decoder.eval_count / gen_seconds;
+            }
+        }
+    } else {
+        result = decode_response(attempt->body, returned_context);
+    }
+    return result;
+}
+
+PendingTurn LlamaStack::prepare_turn(const std::string& prompt, const RequestControl& control) {
+    adopt_summary();
+    stats = CompletionStats{};
+    stats.streamed = options.stream;
+    stats.prompt_tokens_reused = session_context.size();
+    if (summarizer) {
+        stats.summary_turns = summary.turns;
+        stats.summary_tokens = summary.token_count;
+        stats.summary_source_tokens = summary.source_tokens;
+    }
+    PendingTurn turn;
+    turn.prompt = prompt;
+    const auto timeout = control.timeout.count() > 0 ? control.timeout
+                                                     : std::chrono::milliseconds(options.request_timeout_ms);
+    turn.started = std::chrono::steady_clock::now();
+    if (timeout.count() > 0) turn.deadline = turn.started + timeout;
+    turn.cancel = control.cancel;
+
+    // Recall relevant older turns; a failed lookup only costs relevance
+    if (retrieval) {
+        auto retrieval_start = std::chrono::steady_clock::now();
+        try {
+            turn.prompt_embedding = embed(prompt, turn);
+            turn.recalled = recall(turn.prompt_embedding);
+        } catch (const std::exception& e) {
+            // A cancelled turn ends at its first request anyway
+            if (!turn.cancel || !turn.cancel->cancelled()) {
+                std::cerr << "Warning: Retrieval failed: " << e.what() << std::endl;
+            }
+        }
+        record_phase(Phase::Retrieval, elapsed_ms(retrieval_start));
+    }
+
+    auto serialize_start = std::chrono::steady_clock::now();
+    build_payload(turn.payload, prompt, turn.recalled);
+    record_phase(Phase::Serialize, elapsed_ms(serialize_start));
+    return turn;
+}
+
+std::string LlamaStack::decode_response(const std::string& body, std::vector<int>& returned_context) {
+    auto parse_start = std::chrono::steady_clock::now();
+    // Only session context mode needs the returned context
+    GenerateResponse response;
+    decode_generate_response(body.data(), body.data() + body.size(), response, options.session_context);
+    if (!response.has_response) {
+        throw std::runtime_error("No 'response' field in API output");
+    }
+    returned_context = std::move(response.context);
+    // Counters add up over the steps of an agent turn
+    ++stats.agent_steps;
+    stats.eval_count += response.eval_count;
+    stats.prompt_eval_count += response.prompt_eval_count;
+    if (response.eval_count > 0 && response.eval_duration > 0) {
+        stats.tokens_per_sec = response.eval_count / (response.eval_duration / 1e9);
+    }
+    stats.server_total_ms += response.total_duration / 1e6;
+    stats.load_ms += response.load_duration / 1e6;
+    stats.prompt_eval_ms += response.prompt_eval_duration / 1e6;
+    stats.eval_ms += response.eval_duration / 1e6;
+    record_phase(Phase::Parse, elapsed_ms(parse_start));
+    return std::move(response.response);
+}
+
+bool LlamaStack::cached_response(const PendingTurn& turn, std::string& result, std::vector<int>& returned_context) {
+    if (!cache || !turn.use_cache) return false;
+    ResponseCache::Entry entry;
+    if (!cache->get(ResponseCache::key(base_url, turn.payload), entry)) {
+        ++stats.cache_misses;
+        return false;
+    }
+    ++stats.cache_hits;
+    ++stats.agent_steps;
+    result = std::move(entry.response);
+    returned_context = std::move(entry.context);
+    return true;
+}
+
+void LlamaStack::cache_response(const PendingTurn& turn, const std::string& result, const std::vector<int>& returned_context) {
+    if (!cache || !turn.use_cache || result.empty()) return;
+    auto persist_start = std::chrono::steady_clock::now();
+    cache->put(ResponseCache::key(base_url, turn.payload), {result, returned_context});
+    record_phase(Phase::Persist, elapsed_ms(persist_start));
+}
+
+std::vector<ToolCall> LlamaStack::parse_tool_calls(const std::string& response) {
+    std::vector<ToolCall> calls;
+    // Cheap test first: most responses are prose, and a tool call is one
+    // JSON object, so only a response that starts with '{', ends with '}'
+    // and names a tool call is parsed
+    const size_t start = response.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos || response[start] != '{' || response[response.find_last_not_of(" \t\r\n")] != '}' ||
+        response.find("\"tool_call", start) == std::string::npos) {
+        return calls;
+    }
+    json parsed = json::parse(response, nullptr, false);
+    if (parsed.is_discarded() || !parsed.is_object()) return calls;
+    auto add = [&](const json& call) {
+        if (!call.is_object() || !call.contains("name") || !call["name"].is_string()) return;
+        calls.push_back({call["name"].get<std::string>(), call.value("arguments", json::object())});
+    };
+    if (parsed.contains("tool_call")) add(parsed["tool_call"]);
+    if (parsed.contains("tool_calls") && parsed["tool_calls"].is_array()) {
+        for (const auto& call : parsed["tool_calls"]) add(call);
+    }
+    return calls;
+}
+
+bool LlamaStack::continue_turn(PendingTurn& turn, std::string& result) {
+    ++turn.steps;
+    std::vector<ToolCall> calls = parse_tool_calls(result);
+    if (calls.empty()) return false;
+
+    // Tools share the turn's deadline and cancel token, so a cancelled or
+    // late turn does not wait out a slow command
+    check_deadline(turn);
+    auto tool_start = std::chrono::steady_clock::now();
+    std::vector<ToolResult> results = tool_executor->run_all(calls, turn.deadline, turn.cancel);
+    record_phase(Phase::Tool, elapsed_ms(tool_start));
+    check_deadline(turn);
+
+    std::string output;
+    for (const auto& run : results) {
+        // Names come from the model; only registered ones are kept as labels
+        stats.tool_runs.push_back({tool_executor->has(run.name) ? run.name : "unknown", run.ms, run.bytes,
+                                   run.timed_out, run.failed});
+        if (!output.empty()) output += "\n\n";
+        if (results.size() > 1) output += "[" + run.name + "]\n";
+        output += run.output;
+    }
+
+    if (turn.steps >= options.agent_max_steps) {
+        // Out of steps: the tool output is the answer, as with a single step
+        result = std::move(output);
+        stats.tool_called = true;
+        return false;
+    }
+
+    auto serialize_start = std::chrono::steady_clock::now();
+    turn.scratchpad += "Assistant: " + result + "\nTool results:\n" + output + "\n\n";
+    build_payload(turn.payload,
+                  turn.prompt + "\n\n" + turn.scratchpad +
+                      "Answer the request above using these tool results, or call another tool.",
+                  turn.recalled);
+    record_phase(Phase::Serialize, elapsed_ms(serialize_start));
+    return true;
+}
+
+std::string LlamaStack::finish_turn(const PendingTurn& turn, std::string result, std::vector<int> returned_context) {
+    const std::string& prompt = turn.prompt;
+
+    // Store interaction in memory
+    auto phase_start = std::chrono::steady_clock::now();
+    const Interaction interaction{prompt, result, interaction_tokens(prompt, result)};
+    memory.push_back(interaction);
+    total_tokens += interaction.token_count;
+    context.append(interaction);
+    record_phase(Phase::Context, elapsed_ms(phase_start));
+
+    phase_start = std::chrono::steady_clock::now();
+    persist_interaction(interaction);
+    if (retrieval) {
+        uint32_t id = RetrievalStore::NONE;
+        if (!turn.prompt_embedding.empty()) {
+            try {
+                const size_t before = retrieval->size();
+                retrieval->add(interaction, turn.prompt_embedding);
+                // A new embedding dimension discards the stored turns
+                if (retrieval->size() != before + 1) {
+                    std::fill(retrieval_ids.begin(), retrieval_ids.end(), RetrievalStore::NONE);
+                }
+                id = static_cast<uint32_t>(retrieval->size() - 1);
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to save memory: " << e.what() << std::endl;
+            }
+        }
+        retrieval_ids.push_back(id);
+    }
+    record_phase(Phase::Persist, elapsed_ms(phase_start));
+
+    phase_start = std::chrono::steady_clock::now();
+    const size_t evicted = trim_history();
+    record_phase(Phase::Context, elapsed_ms(phase_start));
+
+    phase_start = std::chrono::steady_clock::now();
+    persist_evictions(evicted);
+    record_phase(Phase::Persist, elapsed_ms(phase_start));
+
+    // The returned context encodes exactly what the model saw and said.
+    // It no longer matches `memory` once tools ran or eviction dropped
+    // turns, so fall back to full-text replay.
+    if (options.session_context && stats.tool_runs.empty() && evicted == 0) {
+        session_context = std::move(returned_context);
+    } else {
+        session_context.clear();
+    }
+
+    return result;
+}
+
+size_t LlamaStack::memory_bytes() const {
+    size_t bytes = context.preamble().size() + context.history().size() + session_context.size() * sizeof(int) +
+                   pinned_context.size() + summary.text.size() + summary_context.size() + memory.bytes();
+    for (const auto& hit : pinned) {
+        bytes += sizeof(ArchiveHit) + hit.interaction.prompt.size() + hit.interaction.response.size();
+    }
+    return bytes;
+}
+
+std::string LlamaStack::memory_report() const {
+    const TurnStoreUsage usage = memory.usage();
+    const auto mb = [](size_t bytes) { return bytes / 1048576.0; };
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << usage.turns << " turns, " << total_tokens << "/" << history_budget()
+        << " tokens, " << mb(memory.bytes() + context.history().size()) << " MB";
+    if (options.max_memory_bytes > 0) out << "/" << mb(options.max_memory_bytes) << " MB";
+    out << " (stored " << mb(memory.bytes()) << " MB for " << mb(usage.text_bytes) << " MB of text, rendered "
+        << mb(context.history().size()) << " MB)";
+    if (usage.compressed_turns > 0) out << ", " << usage.compressed_turns << " compressed";
+    if (usage.shared_turns > 0) {
+        out << ", " << usage.shared_turns << " turns share " << usage.shared_responses << " responses";
+    }
+    return out.str();
+}
+
+size_t LlamaStack::trim_history() {
+    size_t evicted = 0;
+    while ((total_tokens > history_budget() || over_memory_budget()) && !memory.empty()) {
+        total_tokens -= memory.token_count(0);
+        if (summarizer) summarizer->add(memory.front());
+        memory.pop_front();
+        if (retrieval) retrieval_ids.pop_front();
+        context.evict_front();
+        ++evicted;
+    }
+    return evicted;
+}
+
+void LlamaStack::open_summarizer() {
+    auto generate = [this](const std::string& prompt, const CancelToken& cancel) {
+        return generate_summary(prompt, cancel);
+    };
+    auto count = [tokenizer = tokenizer](const std::string& text) {
+        return tokenizer ? static_cast<int>(tokenizer->count(text)) : count_tokens(text);
+    };
+    // A batch of evicted turns plus the summary fit the model's window
+    summarizer = std::make_unique<MemorySummarizer>(generate, count, summary_budget,
+                                                    std::max<size_t>(max_tokens - summary_budget * 2, 1));
+    summarizer->reset(summary);
+    render_summary();
+}
+
+void LlamaStack::adopt_summary() {
+    if (!summarizer || !summarizer->take(summary)) return;
+    render_summary();
+    // The server's context holds the old summary
+    session_context.clear();
+    if (journal) {
+        try {
+            journal->record_summary(summary);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to save memory: " << e.what() << std::endl;
+        }
+    }
+}
+
+void LlamaStack::render_summary() {
+    summary_context.clear();
+    if (summary.text.empty()) return;
+    ContextRenderer::append_escaped(summary_context, "Summary of the earlier conversation:\n" + summary.text + "\n\n");
+}
+
+std::string LlamaStack::generate_summary(const std::string& prompt, const CancelToken& cancel) {
+    const std::string& model = options.summary_model.empty() ? model_name : options.summary_model;
+    RequestBody body;
+    body.append("{\"model\":\"");
+    body.append_escaped(model);
+    body.append("\",\"prompt\":\"");
+    body.append_escaped(prompt);
+    body.append("\",\"stream\":false");
+    if (!options.keep_alive.empty()) {
+        body.append(",\"keep_alive\":\"");
+        body.append_escaped(options.keep_alive);
+        body.append("\"");
+    }
+    body.append("}");
+
+    size_t backend = BackendPool::NONE;
+    std::string url = base_url;
+    if (options.backends) {
+        backend = options.backends->acquire(model);
+        if (backend == BackendPool::NONE) throw std::runtime_error("no backend serves model " + model);
+        url = options.backends->url(backend);
+    }
+    MultiClient client(connections, 1, &cancel);
+    MultiClient::Response response;
+    client.post(url, std::move(body), [&response](MultiClient::Response& done) { response = std::move(done); },
+                std::chrono::milliseconds(0), std::chrono::milliseconds(options.request_timeout_ms));
+    client.run();
+    if (backend != BackendPool::NONE) {
+        // No latency: a whole summary per first byte would skew the hedge delay
+        if (response.result == CURLE_ABORTED_BY_CALLBACK) {
+            options.backends->finish(backend, BackendPool::Outcome::Cancelled);
+        } else if (response.result != CURLE_OK || response.http_code != 200) {
+            options.backends->finish(backend, BackendPool::Outcome::Failure);
+        } else {
+            options.backends->finish(backend, BackendPool::Outcome::Success);
+        }
+    }
+    if (response.result != CURLE_OK) {
+        throw std::runtime_error("cURL error: " + std::string(curl_easy_strerror(response.result)));
+    }
+    GenerateResponse decoded;
+    decode_generate_response(response.body.data(), response.body.data() + response.body.size(), decoded, false);
+    if (!decoded.error.empty()) throw std::runtime_error(decoded.error);
+    if (response.http_code != 200) throw std::runtime_error("HTTP " + std::to_string(response.http_code));
+    return decoded.response;
+}
+
+std::vector<ArchiveHit> LlamaStack::search_archive(const std::string& query, size_t k) const {
+    if (!archive) return {};
+    return archive->search(query, k);
+}
+
+size_t LlamaStack::recall_archived(const std::vector<uint32_t>& ids) {
+    if (!archive) return 0;
+    const size_t budget = (max_tokens - retrieval_budget) / 2;
+    size_t added = 0;
+    for (uint32_t id : ids) {
+        ArchiveHit hit = archive->read(id);
+        const size_t tokens = static_cast<size_t>(std::max(hit.interaction.token_count, 0));
+        const bool present = std::any_of(pinned.begin(), pinned.end(), [&](const ArchiveHit& p) { return p.id == id; });
+        if (present || tokens > budget) continue;
+        pinned.push_back(std::move(hit));
+        pinned_tokens += tokens;
+        while (pinned_tokens > budget) {
+            pinned_tokens -= pinned.front().interaction.token_count;
+            pinned.pop_front();
+        }
+        ++added;
+    }
+    if (added == 0) return 0;
+
+    pinned_context.clear();
+    for (const auto& hit : pinned) {
+        ContextRenderer::render_interaction(pinned_context, hit.interaction);
+    }
+    persist_evictions(trim_history());
+    // The server's context holds the turns without them
+    session_context.clear();
+    return added;
+}
+
+int LlamaStack::interaction_tokens(const std::string& prompt, const std::string& response) const {
+    if (tokenizer) {
+        return static_cast<int>(tokenizer->count(prompt) + tokenizer->count(response));
+    }
+    return count_tokens(prompt + " " + response);
+}
+
+std::shared_ptr<const BpeTokenizer> LlamaStack::shared_tokenizer(const std::string& path) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<const BpeTokenizer>> loaded;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = loaded.find(path);
+    if (it != loaded.end()) return it->second;
+    std::shared_ptr<const BpeTokenizer> tokenizer;
+    try {
+        tokenizer = BpeTokenizer::load(path);
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: Failed to load tokenizer: " << e.what() << ". Estimating token counts." << std::endl;
+    }
+    loaded.emplace(path, tokenizer); // Failures too, so they are reported once
+    return tokenizer;
+}
+
+std::shared_ptr<ResponseCache> LlamaStack::shared_response_cache(const std::string& path, size_t max_bytes) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<ResponseCache>> opened;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = opened.find(path);
+    if (it != opened.end()) return it->second;
+    auto cache = std::make_shared<ResponseCache>(path, max_bytes);
+    try {
+        cache->open();
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: Failed to open response cache: " << e.what() << ". Caching in memory only." << std::endl;
+    }
+    opened.emplace(path, cache);
+    return cache;
+}
+
+void LlamaStack::render_preamble() {
+    json tools_json = json::array();
+    for (const auto& tool : tools) {
+        tools_json.push_back({
+            {"name", tool.name},
+            {"description", tool.description},
+            {"parameters", tool.parameters}
+        });
+    }
+    std::string preamble = "You have access to the following tools:\n" + tools_json.dump(2) + "\n\nTo use a tool, respond with a JSON object like: {\"tool_call\": {\"name\": \"tool_name\", \"arguments\": {...}}}\n"
+                           "To run several tools at once, respond with {\"tool_calls\": [{\"name\": ..., \"arguments\": {...}}, ...]}\n\n";
+    preamble += "You are a highly knowledgeable and friendly AI assistant. Use tools when appropriate.\n\n"
+                "Use the following conversation history for context:\n\n";
+    context.set_preamble(preamble);
+}
+
+void LlamaStack::build_payload(RequestBody& payload, const std::string& current_prompt, std::string_view recalled) {
+    payload.clear();
+    payload.append("{\"model\":\"");
+    payload.append_escaped(model_name);
+    payload.append("\",\"prompt\":\"");
+    if (!session_context.empty()) {
+        payload.append(ContextRenderer::render_prompt(current_prompt));
+        payload.append("\",\"context\":[");
+        char digits[16];
+        for (size_t i = 0; i < session_context.size(); ++i) {
+            if (i > 0) payload.append(",");
+            auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), session_context[i]);
+            payload.append(std::string_view(digits, end - digits));
+        }
+        payload.append("]");
+        finish_payload(payload);
+        return;
+    }
+
+    // Rendered context is borrowed in place; recalled turns are copied,
+    // since they belong to a PendingTurn that may move
+    payload.borrow(context.preamble());
+    payload.borrow(summary_context);
+    payload.borrow(pinned_context);
+    payload.append(recalled);
+    payload.borrow(context.history());
+    payload.append(ContextRenderer::render_prompt(current_prompt));
+    payload.append("\"");
+    finish_payload(payload);
+}
+
+void LlamaStack::finish_payload(RequestBody& payload) const {
+    payload.append(options.stream ? ",\"stream\":true" : ",\"stream\":false");
+    if (!options.keep_alive.empty()) {
+        payload.append(",\"keep_alive\":\"");
+        payload.append_escaped(options.keep_alive);
+        payload.append("\"");
+    }
+    payload.append("}");
+}
+
+LlamaStack::WarmUp::~WarmUp() {
+    cancel.cancel();
+    if (thread.joinable()) thread.join();
+}
+
+void LlamaStack::WarmUp::start(ConnectionPool& pool, std::vector<std::string> urls, RequestBody body,
+                               std::chrono::milliseconds timeout) {
+    thread = std::thread([this, &pool, urls = std::move(urls), body = std::move(body), timeout] {
+        MultiClient client(pool, urls.size(), &cancel);
+        for (const auto& url : urls) {
+            client.post(url, body, [&url](MultiClient::Response& response) {
+                if (response.result == CURLE_ABORTED_BY_CALLBACK) return;
+                if (response.result != CURLE_OK) {
+                    std::cerr << "Warning: Failed to load the model on " << url << ": "
+                              << curl_easy_strerror(response.result) << std::endl;
+                } else if (response.http_code != 200) {
+                    const json reply = json::parse(response.body, nullptr, false);
+                    std::cerr << "Warning: Failed to load the model on " << url << ": HTTP " << response.http_code;
+                    if (reply.is_object() && reply.contains("error") && reply["error"].is_string()) {
+                        std::cerr << " " << reply["error"].get<std::string>();
+                    }
+                    std::cerr << std::endl;
+                }
+            }, std::chrono::milliseconds(0), timeout);
+        }
+        client.run();
+    });
+}
+
+void LlamaStack::open_retrieval() {
+    const std::string generate_path = "/api/generate";
+    if (options.embedding_url.empty() && base_url.size() >= generate_path.size() &&
+        base_url.compare(base_url.size() - generate_path.size(), generate_path.size(), generate_path) == 0) {
+        options.embedding_url = base_url.substr(0, base_url.size() - generate_path.size()) + "/api/embeddings";
+    }
+    if (memory_file.empty() || options.embedding_url.empty()) {
+        std::cerr << "Warning: Retrieval needs memory_file and embedding_url. Retrieval disabled." << std::endl;
+        return;
+    }
+    try {
+        retrieval = std::make_unique<RetrievalStore>(memory_file);
+        retrieval->open();
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: Failed to open vector index: " << e.what() << ". Retrieval disabled." << std::endl;
+        retrieval.reset();
+        return;
+    }
+    retrieval_budget = std::min(options.retrieval_tokens > 0 ? options.retrieval_tokens : max_tokens / 4, max_tokens);
+    // Recalled turns change between requests, so a KV context never matches
+    options.session_context = false;
+}
+
+void LlamaStack::match_retrieval_ids() {
+    // Stored turns are in memory order; a turn that was never stored
+    // matches none of them and is skipped
+    retrieval_ids.assign(memory.size(), RetrievalStore::NONE);
+    size_t next = retrieval->size();
+    std::string scratch;
+    try {
+        for (size_t i = memory.size(); i-- > 0 && next > 0;) {
+            const auto [prompt, response] = memory.view(i, scratch);
+            const Interaction stored = retrieval->read(static_cast<uint32_t>(next - 1));
+            if (stored.prompt == prompt && stored.response == response) {
+                retrieval_ids[i] = static_cast<uint32_t>(--next);
+            }
+        }
+    } catch (const std::exception& e) {
+        // Unmatched turns only widen what a search may return
+        std::cerr << "Warning: Failed to read vector index: " << e.what() << std::endl;
+    }
+}
+
+std::vector<float> LlamaStack::embed(const std::string& text, const PendingTurn& turn) {
+    ConnectionPool::Lease lease = connections.acquire();
+    CURL* curl_handle = lease.get();
+    std::string payload = json{{"model", options.embedding_model}, {"prompt", text}}.dump();
+    std::string response_buffer;
+    curl_easy_setopt(curl_handle, CURLOPT_URL, options.embedding_url.c_str());
+    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, payload.c_str());
+    set_timeouts(curl_handle, turn.deadline, options.connect_timeout_ms);
+    CancelToken::watch(curl_handle, turn.cancel);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &response_buffer);
+    CURLcode res = curl_easy_perform(curl_handle);
+    connections.record_transfer(curl_handle);
+    if (res != CURLE_OK) {
+        throw std::runtime_error("cURL error: " + std::string(curl_easy_strerror(res)));
+    }
+    long http_code = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &http_code);
+    if (http_code != 200) {
+        throw std::runtime_error("HTTP error: " + std::to_string(http_code));
+    }
+    json response_json = json::parse(response_buffer);
+    if (response_json.contains("embedding")) {
+        return response_json["embedding"].get<std::vector<float>>();
+    }
+    if (response_json.contains("embeddings") && !response_json["embeddings"].empty()) {
+        return response_json["embeddings"][0].get<std::vector<float>>(); // /api/embed
+    }
+    throw std::runtime_error("No 'embedding' field in API output");
+}
+
+std::string LlamaStack::recall(const std::vector<float>& query) {
+    // Turns from the oldest one still in the window on are already in context
+    size_t limit = retrieval->size();
+    for (uint32_t id : retrieval_ids) {
+        if (id != RetrievalStore::NONE) {
+            limit = id;
+            break;
+        }
+    }
+    auto hits = retrieval->search(query, options.retrieval_top_k, limit);
+    std::vector<std::pair<uint32_t, Interaction>> picked;
+    size_t used = 0;
+    for (const auto& hit : hits) {
+        Interaction interaction = retrieval->read(hit.second);
+        if (used + interaction.token_count > retrieval_budget) continue;
+        used += interaction.token_count;
+        picked.emplace_back(hit.second, std::move(interaction));
+    }
+    std::sort(picked.begin(), picked.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    std::string recalled;
+    for (const auto& [id, interaction] : picked) {
+        ContextRenderer::render_interaction(recalled, interaction);
+    }
+    stats.retrieved_turns = picked.size();
+    return recalled;
+}
+
+bool LlamaStack::export_memory(const std::string& path) {
+    try {
+        json memory_json = json::array();
+        if (summary.turns > 0) {
+            memory_json.push_back({
+                {"summary", summary.text},
+                {"token_count", summary.token_count},
+                {"turns", summary.turns},
+                {"source_tokens", summary.source_tokens}
+            });
+        }
+        memory.for_each([&](std::string_view prompt, std::string_view response, int token_count) {
+            memory_json.push_back({
+                {"prompt", prompt},
+                {"response", response},
+                {"token_count", token_count}
+            });
+        });
+        std::ofstream ofs(path);
+        if (!ofs.is_open()) {
+            throw std::runtime_error("cannot open " + path);
+        }
+        ofs << memory_json.dump(2);
+        ofs.close();
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to export memory: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+void LlamaStack::open_archive() {
+    try {
+        archive = std::make_unique<TurnArchive>(memory_file + ".archive");
+        archive->open();
+        // Turns stored before the archive existed start it off
+        if (archive->size() == 0) {
+            for (size_t i = 0; i < memory.size(); ++i) {
+                archive->append(memory.at(i), unix_time());
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: Failed to open archive: " << e.what() << ". Archive disabled." << std::endl;
+        archive.reset();
+    }
+}
+
+std::vector<Interaction> LlamaStack::memory_snapshot() const {
+    std::vector<Interaction> snapshot;
+    snapshot.reserve(memory.size());
+    memory.for_each([&](std::string_view prompt, std::string_view response, int token_count) {
+        snapshot.push_back({std::string(prompt), std::string(response), token_count});
+    });
+    return snapshot;
+}
+
+void LlamaStack::persist_interaction(const Interaction& interaction) {
+    try {
+        if (journal) journal->append(interaction);
+        if (archive) archive->append(interaction, unix_time());
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to save memory: " << e.what() << std::endl;
+    }
+}
+
+void LlamaStack::persist_evictions(size_t evicted) {
+    if (!journal) return;
+    try {
+        for (size_t i = 0; i < evicted; ++i) {
+            journal->record_eviction();
+        }
+        if (journal->should_compact()) {
+            journal->compact_async(memory_snapshot(), summary);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to save memory: " << e.what() << std::endl;
+    }
+}
+
+uint64_t LlamaStack::memory_fingerprint(const TurnStore& memory) {
+    uint64_t hash = 1469598103934665603ULL; // FNV-1a
+    if (memory.empty()) return hash;
+    std::string scratch;
+    const auto [prompt, response] = memory.view(memory.size() - 1, scratch);
+    for (std::string_view text : {prompt, response}) {
+        for (unsigned char c : text) {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+void LlamaStack::load_session() {
+    if (memory_file.empty() || memory.empty()) return;
+    try {
+        std::ifstream ifs(session_file());
+        if (!ifs.is_open()) return;
+        json session;
+        ifs >> session;
+        if (session.value("model", "") != model_name ||
+            session.value("turns", size_t{0}) != memory.size() ||
+            session.value("fingerprint", uint64_t{0}) != memory_fingerprint(memory)) {
+            return;
+        }
+        session_context = session["context"].get<std::vector<int>>();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to load session context: " << e.what() << std::endl;
+    }
+}
+
+void LlamaStack::save_session() {
+    if (memory_file.empty()) return;
+    try {
+        if (session_context.empty()) {
+            std::remove(session_file().c_str());
+            return;
+        }
+        json session = {
+            {"model", model_name},
+            {"turns", memory.size()},
+            {"fingerprint", memory_fingerprint(memory)},
+            {"context", session_context}
+        };
+        std::ofstream ofs(session_file());
+        ofs << session.dump();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to save session context: " << e.what() << std::endl;
+    }
+}
+
+void LlamaStack::load_memory() {
+    if (!journal) return;
+    try {
+        std::deque<Interaction> replayed;
+        if (!journal->replay(replayed, &summary)) {
+            import_memory_file();
+            journal->compact(memory_snapshot(), summary);
+            return;
+        }
+        if (restore_history(replayed) > 0) {
+            journal->compact(memory_snapshot(), summary);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to load memory: " << e.what() << std::endl;
+    }
+}
+
+void LlamaStack::import_memory_file() {
+    std::ifstream ifs(memory_file);
+    if (!ifs.is_open()) return;
+    json memory_json;
+    ifs >> memory_json;
+    ifs.close();
+    std::deque<Interaction> imported;
+    for (const auto& item : memory_json) {
+        if (item.contains("summary")) {
+            summary = {item["summary"].get<std::string>(), item.value("token_count", 0), item.value("turns", size_t{0}),
+                       item.value("source_tokens", 0LL)};
+        } else if (item.contains("prompt") && item.contains("response")) {
+            // Store prompt and response to avoid repeated JSON lookups
+            const auto prompt = item["prompt"].get<std::string>();
+            const auto response = item["response"].get<std::string>();
+            int tokens = item.contains("token_count") ? item["token_count"].get<int>() : interaction_tokens(prompt, response);
+            imported.push_back({prompt, response, tokens});
+        }
+    }
+    restore_history(imported);
+}
+
+size_t LlamaStack::restore_history(const std::deque<Interaction>& turns) {
+    // The newest turns that fit the token budget, oldest first
+    size_t first = turns.size();
+    size_t tokens = 0;
+    while (first > 0 && tokens + turns[first - 1].token_count <= history_budget()) {
+        tokens += turns[--first].token_count;
+    }
+    memory.clear();
+    context.clear();
+    total_tokens = 0;
+    for (size_t i = first; i < turns.size(); ++i) {
+        memory.push_back(turns[i]);
+        context.append(turns[i]);
+        total_tokens += turns[i].token_count;
+    }
+    // The byte budget counts stored and rendered bytes, known only once
+    // the turns are in; evict as trim_history() would, without summarizing
+    while (over_memory_budget() && !memory.empty()) {
+        total_tokens -= memory.token_count(0);
+        memory.pop_front();
+        context.evict_front();
+        ++first;
+    }
+    return first;
+}
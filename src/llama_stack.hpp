@@ -0,0 +1,378 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "backend_pool.hpp"
+#include "cancel_token.hpp"
+#include "connection_pool.hpp"
+#include "context_renderer.hpp"
+#include "interaction.hpp"
+#include "memory_journal.hpp"
+#include "memory_summarizer.hpp"
+#include "metrics.hpp"
+#include "request_body.hpp"
+#include "response_cache.hpp"
+#include "retrieval_store.hpp"
+#include "tokenizer.hpp"
+#include "tool_executor.hpp"
+#include "turn_archive.hpp"
+#include "turn_store.hpp"
+
+// Optional LlamaStack features, set from config.json
+struct LlamaOptions {
+    bool stream = true; // Request NDJSON streaming from the server
+    bool session_context = false; // Reuse the server's KV `context` between turns
+    std::string tokenizer_file; // tokenizer.json or tiktoken file matching the model
+    bool retrieval = false; // Recall relevant older turns from a vector index
+    std::string embedding_model = "nomic-embed-text";
+    std::string embedding_url; // Defaults to base_url's /api/embeddings
+    size_t retrieval_top_k = 4; // Older turns recalled per prompt
+    size_t retrieval_tokens = 0; // Budget for recalled turns; 0 = max_tokens / 4
+    size_t agent_max_steps = 1; // Model requests per turn; tool results are fed back until the last
+    size_t tool_timeout_ms = 30000; // Deadline of each tool call; 0 = only the turn's deadline
+    size_t tool_output_bytes = 64 * 1024; // Output kept per tool call
+    size_t tool_workers = 4; // Tool calls run in parallel
+    bool response_cache = false; // Answer repeated requests from a local cache
+    size_t response_cache_bytes = 64 << 20; // Budget of cached responses in memory
+    std::string response_cache_file; // Defaults to `<memory_file>.cache`; memory only without either
+    std::shared_ptr<BackendPool> backends; // Routes requests over several servers; null sends them to base_url
+    size_t request_timeout_ms = 120000; // Deadline of each completion, retries included; 0 = none
+    size_t connect_timeout_ms = 5000; // Most time spent connecting to a server
+    bool archive = true; // Keep every turn in `<memory_file>.archive` for search_archive()
+    bool warm_up = false; // Have the server load the model in the background from construction on
+    std::string keep_alive; // How long the server keeps the model loaded, e.g. "30m"; empty = its default
+    bool summarize = false; // Fold evicted turns into a rolling summary ahead of the history
+    size_t summary_tokens = 0; // Budget of the summary; 0 = max_tokens / 8
+    std::string summary_model; // Model that writes the summary; empty = the chat model
+    size_t max_memory_bytes = 64 << 20; // Budget of stored and rendered turns, next to max_tokens; 0 = none
+    bool memory_compression = false; // Keep stored turns zstd-compressed, when built with zstd
+};
+
+// Deadline and cancellation of one completion
+struct RequestControl {
+    std::chrono::milliseconds timeout{0}; // Overrides request_timeout_ms when nonzero
+    const CancelToken* cancel = nullptr; // Aborts the completion once cancelled; must outlive it
+};
+
+// Request for one turn, built by LlamaStack::prepare_turn()
+struct PendingTurn {
+    std::string prompt;
+    RequestBody payload; // Request body for base_url; borrows the stack's rendered context until finish_turn()
+    std::vector<float> prompt_embedding; // Retrieval key, when retrieval is on
+    std::string recalled; // Rendered older turns, when retrieval is on
+    std::string scratchpad; // Tool calls and results of earlier agent steps
+    size_t steps = 0; // Model responses received so far
+    bool use_cache = true; // Clear to bypass the response cache for this turn
+    std::chrono::steady_clock::time_point started; // When the deadline was set
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    const CancelToken* cancel = nullptr;
+};
+
+// Structure for tools
+struct Tool {
+    std::string name;
+    std::string description;
+    nlohmann::json parameters;
+};
+
+// Wait before retry `retry` (0 for the first) of a failed request: a
+// random time between half and all of 1, 2, 4... seconds, so clients that
+// failed together do not retry in lockstep
+std::chrono::milliseconds retry_backoff(int retry);
+
+// Fallback token counter (word-based approximation).
+// Estimates tokens as word count * 1.3 to account for subword tokenization.
+// This is still a rough estimate and may not accurately reflect the tokenizer used by the LLM.
+// This discrepancy could lead to either under-utilizing the context window or, more critically,
+// exceeding the model's maximum token limit, which might cause API requests to fail.
+// Configure `tokenizer_file` to count with the model's BPE vocabulary instead.
+int count_tokens(const std::string& text);
+
+// Conversation client for Ollama's /api/generate: keeps the token-bounded
+// memory, renders it into each request, runs tool calls and persists turns.
+class LlamaStack {
+public:
+    LlamaStack(const std::string& url = "http://localhost:11434/api/generate",
+               const std::string& model = "llama3.2",
+               size_t max_tokens = 4096,
+               const std::string& mem_file = "",
+               const LlamaOptions& options = {});
+    ~LlamaStack();
+    LlamaStack(const LlamaStack&) = delete;
+    LlamaStack& operator=(const LlamaStack&) = delete;
+
+    // Clear memory
+    void clear_memory();
+
+    // Write memory to memory_file as a JSON array
+    void export_memory();
+
+    // Generate endpoint that prepared turns are posted to
+    const std::string& url() const { return base_url; }
+
+    // Stats of the most recent completion
+    const CompletionStats& last_stats() const { return stats; }
+
+    // Add time measured by the caller to a phase of the current turn, for
+    // callers that run the HTTP request themselves
+    void record_phase(Phase phase, double ms) { stats.phase_ms[static_cast<size_t>(phase)] += ms; }
+
+    // Approximate heap held by the conversation: stored turns, the rendered
+    // context and the session context
+    size_t memory_bytes() const;
+
+    // Human-readable breakdown of the memory held by the recent turns
+    std::string memory_report() const;
+
+    // Connection reuse counters of the keep-alive pool
+    const ConnectionPool& connection_pool() const { return connections; }
+
+    // Send a prompt to the model. In streaming mode, `on_token` is invoked for
+    // each response fragment as it arrives; a cached response arrives as one
+    // fragment. `use_cache` false always asks the model. Once `control`'s
+    // deadline passes or its token is cancelled, the request in flight is
+    // aborted within milliseconds and an error is returned; the memory is
+    // left as it was.
+    std::string completion(const std::string& prompt,
+                           const std::function<void(const std::string&)>& on_token = nullptr,
+                           bool use_cache = true, const RequestControl& control = {});
+
+    // Reset the stats, recall relevant older turns and build the request
+    // body for `prompt`, starting the turn's deadline
+    PendingTurn prepare_turn(const std::string& prompt, const RequestControl& control = {});
+
+    // Parse a non-streamed response body; returns the response text
+    std::string decode_response(const std::string& body, std::vector<int>& returned_context);
+
+    // Look up the response to `turn.payload` in the response cache
+    bool cached_response(const PendingTurn& turn, std::string& result, std::vector<int>& returned_context);
+
+    // Remember the response to `turn.payload` for later identical requests
+    void cache_response(const PendingTurn& turn, const std::string& result, const std::vector<int>& returned_context);
+
+    // The response cache, or null when disabled
+    const ResponseCache* response_cache() const { return cache.get(); }
+
+    // The `k` archived turns most relevant to the words of `query`, best
+    // first; empty without an archive
+    std::vector<ArchiveHit> search_archive(const std::string& query, size_t k = 10) const;
+
+    // Bring archived turns back into the context of the following prompts,
+    // ahead of the recent history, until clear_memory(). They get at most
+    // half of the history budget, with older recalled turns giving way to
+    // newer ones, and the oldest recent turns are evicted to make room.
+    // Returns how many were added. Throws std::out_of_range for an unknown id.
+    size_t recall_archived(const std::vector<uint32_t>& ids);
+
+    // The archive, or null when disabled
+    const TurnArchive* turn_archive() const { return archive.get(); }
+
+    // Run the tool calls requested in `result`, in parallel. Returns true
+    // with `turn.payload` set to the follow-up request that feeds the tool
+    // output back to the model; returns false when `result` is the final
+    // response. At the last agent step the tool output becomes `result`.
+    bool continue_turn(PendingTurn& turn, std::string& result);
+
+    // Store the turn in memory; returns the final response
+    std::string finish_turn(const PendingTurn& turn, std::string result, std::vector<int> returned_context);
+
+private:
+    // Token count of one interaction. Computed once and cached in the
+    // Interaction, so stored turns are never re-tokenized.
+    int interaction_tokens(const std::string& prompt, const std::string& response) const;
+
+    // Tokenizers are immutable once loaded, so every stack configured with
+    // the same file (e.g. one per batch conversation or daemon session)
+    // shares one instance. Safe to call from several threads.
+    static std::shared_ptr<const BpeTokenizer> shared_tokenizer(const std::string& path);
+
+    // Stacks configured with the same cache file share one cache, so batch
+    // conversations see each other's responses. Safe to call from several threads.
+    static std::shared_ptr<ResponseCache> shared_response_cache(const std::string& path, size_t max_bytes);
+
+    // Render the tool schemas and system prompt that precede the history
+    void render_preamble();
+
+    // Build the request body around the incrementally rendered context.
+    // Only the current prompt is escaped here; preamble and history are
+    // already stored in escaped form.
+    //
+    // With a valid session context, the server already holds the history in
+    // its KV cache, so only the new turn is sent along with `context`.
+    // The summary of evicted turns, turns brought back from the archive,
+    // then turns recalled by retrieval go between the preamble and the
+    // history.
+    void build_payload(RequestBody& payload, const std::string& current_prompt, std::string_view recalled = {});
+
+    // Set up retrieval mode; it needs a memory_file and an embeddings endpoint
+    void open_retrieval();
+
+    // Find the store ids of the turns loaded into `memory` by matching them
+    // against the newest stored turns
+    void match_retrieval_ids();
+
+    // Embedding of `text` from the backend's embeddings endpoint, within the
+    // deadline of `turn`
+    std::vector<float> embed(const std::string& text, const PendingTurn& turn);
+
+    // Render the stored turns most relevant to `query` that are no longer in
+    // the recent window, packed by relevance into the retrieval budget and
+    // kept in chronological order
+    std::string recall(const std::vector<float>& query);
+
+    // Open the archive next to memory_file, seeding a new one with `memory`
+    void open_archive();
+
+    // Export memory as a JSON array
+    bool export_memory(const std::string& path);
+
+    // Snapshot of memory for journal compaction
+    std::vector<Interaction> memory_snapshot() const;
+
+    // Journal a newly stored interaction
+    void persist_interaction(const Interaction& interaction);
+
+    // Close a request body after its prompt or context: stream mode, keep_alive
+    void finish_payload(RequestBody& payload) const;
+
+    // Model load requested from every server the stack sends to. Stopped
+    // on destruction, also when the constructor throws.
+    class WarmUp {
+    public:
+        WarmUp() = default;
+        ~WarmUp();
+        WarmUp(const WarmUp&) = delete;
+        WarmUp& operator=(const WarmUp&) = delete;
+
+        // POST `body` to each of `urls` at once from a background thread,
+        // over connections of `pool` that stay open for the first turn
+        void start(ConnectionPool& pool, std::vector<std::string> urls, RequestBody body,
+                   std::chrono::milliseconds timeout);
+
+    private:
+        CancelToken cancel;
+        std::thread thread;
+    };
+
+    // Evict the oldest turns until the rest fit the history budget and
+    // max_memory_bytes, handing them to the summarizer; returns how many
+    size_t trim_history();
+
+    // Start the background summarizer from the loaded summary
+    void open_summarizer();
+
+    // Put a summary finished by the summarizer into the context and the journal
+    void adopt_summary();
+
+    // Render `summary` into `summary_context`
+    void render_summary();
+
+    // Non-streamed generate request for the summarizer; runs on its thread
+    std::string generate_summary(const std::string& prompt, const CancelToken& cancel);
+
+    // Journal FIFO evictions and compact the journal once it is mostly dead records
+    void persist_evictions(size_t evicted);
+
+    // Session context file stored alongside memory_file
+    std::string session_file() const { return memory_file + ".session"; }
+
+    // Fingerprint of the newest interaction, to tie a saved context to `memory`
+    static uint64_t memory_fingerprint(const TurnStore& memory);
+
+    // Restore the server context saved by the previous run, if it still
+    // matches the configured model and the loaded memory
+    void load_session();
+
+    void save_session();
+
+    // One HTTP request to one server
+    struct Attempt;
+
+    // Start an attempt on `backend`, or on base_url for BackendPool::NONE,
+    // limited to the time left of `turn`
+    std::unique_ptr<Attempt> start_attempt(size_t backend, const PendingTurn& turn,
+                                           const std::function<void(const std::string&)>& on_token);
+
+    // Send the turn's payload once, to the backend picked by the pool while
+    // avoiding `avoid`. With hedging on, a request still without a first
+    // byte after the hedge delay is duplicated on another backend; the
+    // first to answer wins and the other is cancelled. Returns the attempt
+    // that answered, or the last one that failed.
+    std::unique_ptr<Attempt> perform(const PendingTurn& turn,
+                                     const std::function<void(const std::string&)>& on_token, size_t avoid);
+
+    // Tell the pool how an attempt ended
+    void report(const Attempt& attempt);
+
+    // Send the turn's payload with retries and decode the response text.
+    // Retries back off with jitter and only while the deadline allows.
+    std::string request(const PendingTurn& turn, const std::function<void(const std::string&)>& on_token,
+                        std::vector<int>& returned_context, std::chrono::steady_clock::time_point turn_start);
+
+    // Throw if the turn was cancelled or its deadline has passed
+    void check_deadline(const PendingTurn& turn);
+
+    // Tool calls in a response: {"tool_call": {...}} or {"tool_calls": [...]}
+    static std::vector<ToolCall> parse_tool_calls(const std::string& response);
+
+    // Tokens available to the recent window
+    size_t history_budget() const { return max_tokens - retrieval_budget - pinned_tokens - summary_budget; }
+
+    // Whether the stored and rendered turns exceed max_memory_bytes
+    bool over_memory_budget() const {
+        return options.max_memory_bytes > 0 && memory.bytes() + context.history().size() > options.max_memory_bytes;
+    }
+
+    // Load memory by replaying the journal, importing a JSON memory file on first use
+    void load_memory();
+
+    // Import a JSON array written by export_memory() or older versions
+    void import_memory_file();
+
+    // Replace memory and its rendering with the newest of `turns` that fit
+    // max_tokens and max_memory_bytes, as trim_history() would leave them;
+    // returns how many older turns were left out
+    size_t restore_history(const std::deque<Interaction>& turns);
+
+    std::string base_url;
+    std::string model_name;
+    ConnectionPool connections; // Keep-alive handles reused across turns and retries
+    WarmUp warm_up; // Uses `connections`, so it is declared after them
+    TurnStore memory; // Memory to store recent interactions
+    size_t max_tokens; // Maximum tokens to store
+    size_t total_tokens; // Current total tokens
+    std::string memory_file; // File for persistent memory (optional)
+    std::unique_ptr<MemoryJournal> journal; // Append-only log next to memory_file
+    ContextRenderer context; // Rendered prompt kept in step with `memory`
+    std::vector<Tool> tools; // Available tools for agent
+    std::unique_ptr<ToolExecutor> tool_executor; // Runs `tools`
+    LlamaOptions options;
+    CompletionStats stats; // Stats of the last completion
+    std::vector<int> session_context; // Server KV context covering all of `memory`
+    std::shared_ptr<const BpeTokenizer> tokenizer; // Exact token counts when configured
+    std::unique_ptr<RetrievalStore> retrieval; // Every turn with its embedding, when enabled
+    // Store id of each turn in `memory`, or RetrievalStore::NONE for turns
+    // that were not stored (a failed embedding); kept when retrieval is on
+    std::deque<uint32_t> retrieval_ids;
+    size_t retrieval_budget = 0; // Tokens reserved for recalled turns
+    std::shared_ptr<ResponseCache> cache; // Responses by request, when enabled
+    std::unique_ptr<TurnArchive> archive; // Every turn ever stored, when enabled
+    std::deque<ArchiveHit> pinned; // Archived turns brought back by recall_archived()
+    std::string pinned_context; // `pinned`, rendered
+    size_t pinned_tokens = 0;
+    MemorySummary summary; // Evicted turns, summarized; what the prompt carries
+    std::string summary_context; // `summary`, rendered
+    size_t summary_budget = 0; // Tokens reserved for the summary
+    // Declared last, so its thread stops before the members it uses go
+    std::unique_ptr<MemorySummarizer> summarizer;
+};
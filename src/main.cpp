@@ -2,22 +2,34 @@
 #include <string>
 #include <chrono>
 #include <ctime>
+#include <iomanip>
+#include <sstream>
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
 #include <thread>
+#include <future>
 #include <atomic>
 #include <csignal>
 #include <stdexcept>
 #include <deque>
 #include <fstream>
 #include <algorithm> // For std::min, std::transform
-#include <regex> // For std::regex, std::sregex_iterator
 #ifndef _WIN32
 #include <sys/resource.h> // For CPU usage
 #endif
 #include <functional> // For std::function
 #include <vector> // For std::vector
 #include <climits> // For INT_MAX
+#include <memory> // For std::unique_ptr
+#include <map> // For std::map
+#include <cstdlib> // For std::getenv
+
+#include "connection_pool.hpp"
+#include "daemon_client.hpp"
+#include "llama_stack.hpp"
+#include "metrics.hpp"
+#include "multi_client.hpp"
+#include "session_server.hpp"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -48,46 +60,25 @@ double get_cpu_time() {
 // Global flag for graceful shutdown
 std::atomic<bool> g_shutdown{false};
 
-// Signal handler for Ctrl+C
+// Aborts requests in flight: the REPL's current turn, or a batch run after
+// a second signal
+CancelToken g_interrupt;
+
+// The REPL is waiting for a response, so Ctrl+C cancels the turn only
+std::atomic<bool> g_in_turn{false};
+
+// Signal handler for Ctrl+C, and for SIGTERM stopping a daemon
 void signal_handler(int signal) {
-    if (signal == SIGINT) {
+    if (signal == SIGINT && g_in_turn) {
+        g_interrupt.cancel();
+        return;
+    }
+    if (signal == SIGINT || signal == SIGTERM) {
+        if (g_shutdown) g_interrupt.cancel(); // Second signal: stop waiting for requests in flight
         g_shutdown = true;
     }
 }
 
-// Callback function to collect cURL response
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
-    size_t total_size = size * nmemb;
-    userp->append(static_cast<char*>(contents), total_size);
-    return total_size;
-}
-
-// Structure to hold prompt-response pairs
-struct Interaction {
-    std::string prompt;
-    std::string response;
-    int token_count;
-};
-
-// Structure for tools
-struct Tool {
-    std::string name;
-    std::string description;
-    json parameters;
-};
-
-// Improved token counter (word-based approximation).
-// Estimates tokens as word count * 1.3 to account for subword tokenization.
-// This is still a rough estimate and may not accurately reflect the tokenizer used by the LLM.
-// This discrepancy could lead to either under-utilizing the context window or, more critically,
-// exceeding the model's maximum token limit, which might cause API requests to fail.
-// For production use, consider integrating a proper tokenizer library.
-int count_tokens(const std::string& text) {
-    std::istringstream iss(text);
-    int word_count = std::distance(std::istream_iterator<std::string>{iss}, std::istream_iterator<std::string>{});
-    return static_cast<int>(word_count * 1.3);
-}
-
 // Compute Levenshtein distance for fuzzy matching (space-optimized)
 int levenshtein_distance(const std::string& s1, const std::string& s2) {
     size_t len1 = s1.size(), len2 = s2.size();
@@ -117,269 +108,440 @@ int levenshtein_distance(const std::string& s1, const std::string& s2) {
     return prev_row[len1];
 }
 
-class LlamaStack {
-private:
-    std::string base_url;
-    std::string model_name;
-    CURL* curl;
-    std::deque<Interaction> memory; // Memory to store recent interactions
-    size_t max_tokens; // Maximum tokens to store
-    size_t total_tokens; // Current total tokens
-    std::string memory_file; // File for persistent memory (optional)
-    std::vector<Tool> tools; // Available tools for agent
-
-    // Initialize a new CURL handle for thread safety
-    CURL* init_curl() {
-        CURL* handle = curl_easy_init();
-        if (!handle) {
-            throw std::runtime_error("Failed to initialize cURL");
-        }
-        curl_easy_setopt(handle, CURLOPT_TIMEOUT, 30L); // 30 seconds max for entire request
-        curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 5L); // 5 seconds max to connect
-        return handle;
+// One line of at most `max_bytes` from `text`, for search results
+std::string snippet(const std::string& text, size_t max_bytes) {
+    std::string line;
+    for (char c : text) {
+        if (c == '\n' || c == '\r' || c == '\t') c = ' ';
+        if (c == ' ' && (line.empty() || line.back() == ' ')) continue;
+        line += c;
     }
+    if (line.size() <= max_bytes) return line;
+    size_t cut = max_bytes;
+    while (cut > 0 && (static_cast<unsigned char>(line[cut]) & 0xC0) == 0x80) --cut; // Keep UTF-8 sequences whole
+    return line.substr(0, cut) + "...";
+}
 
-    // Build context from memory
-    std::string build_context(const std::string& current_prompt) {
-        // Build tools JSON
-        json tools_json = json::array();
-        for (const auto& tool : tools) {
-            tools_json.push_back({
-                {"name", tool.name},
-                {"description", tool.description},
-                {"parameters", tool.parameters}
-            });
-        }
-        std::string tools_str = "You have access to the following tools:\n" + tools_json.dump(2) + "\n\nTo use a tool, respond with a JSON object like: {\"tool_call\": {\"name\": \"tool_name\", \"arguments\": {...}}}\n\n";
+const size_t SEARCH_RESULTS = 8; // Turns listed by the search command
 
-        std::string context = tools_str + "You are a highly knowledgeable and friendly AI assistant. Use tools when appropriate.\n\n"
-                              "Use the following conversation history for context:\n\n";
-        for (const auto& interaction : memory) {
-            context += "User: " + interaction.prompt + "\nAssistant: " + interaction.response + "\n\n";
-        }
-        context += "User: " + current_prompt + "\nAssistant:";
-        return context;
+// Print archive search results numbered from 1
+void print_hits(const std::vector<ArchiveHit>& hits) {
+    for (size_t i = 0; i < hits.size(); ++i) {
+        const std::time_t time = static_cast<std::time_t>(hits[i].time);
+        char when[32];
+        std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M", std::localtime(&time));
+        std::cout << "[" << i + 1 << "] " << when << "  score " << std::fixed << std::setprecision(2)
+                  << hits[i].score << "\n    You: " << snippet(hits[i].interaction.prompt, 100)
+                  << "\n    AI:  " << snippet(hits[i].interaction.response, 160) << "\n";
     }
+}
 
-    // Save memory to file
-    void save_memory() {
-        if (memory_file.empty()) return;
-        try {
-            json memory_json = json::array();
-            for (const auto& interaction : memory) {
-                memory_json.push_back({
-                    {"prompt", interaction.prompt},
-                    {"response", interaction.response},
-                    {"token_count", interaction.token_count}
-                });
-            }
-            std::ofstream ofs(memory_file);
-            ofs << memory_json.dump(2);
-            ofs.close();
-        } catch (const std::exception& e) {
-            std::cerr << "Failed to save memory: " << e.what() << std::endl;
-        }
+// Settings for non-interactive batch mode (--batch)
+struct BatchOptions {
+    std::string input = "-"; // JSONL prompts; "-" reads stdin
+    std::string output = "-"; // JSONL results; "-" writes stdout
+    size_t concurrency = 4; // Requests in flight at once
+    bool shared_memory = false; // One memory for all prompts, persisted to memory_file
+};
+
+// Runs a JSONL prompt set through a MultiClient. Prompts that share a
+// memory form a conversation and run in order on their own LlamaStack;
+// separate conversations run concurrently, up to `concurrency` at a time.
+// Results are written as JSONL in completion order. Each turn is recorded
+// in `metrics` when one is given.
+class BatchRunner {
+public:
+    BatchRunner(const BatchOptions& batch, const std::string& base_url, const std::string& model,
+                size_t max_tokens, const std::string& memory_file, const LlamaOptions& options, std::ostream& out,
+                Metrics* metrics = nullptr)
+        : batch(batch), base_url(base_url), model(model), max_tokens(max_tokens), memory_file(memory_file),
+          options(options), out(out), metrics(metrics), client(connections, batch.concurrency, &g_interrupt) {
+        // Each request is a single JSON body, so batch mode never streams
+        this->options.stream = false;
     }
 
-    // Execute a tool
-    std::string execute_tool(const std::string& name, const json& args) {
-        if (name == "run_command") {
-            if (!args.contains("command")) return "Error: Missing command argument";
-            std::string cmd = args["command"].get<std::string>();
-            FILE* pipe = popen(cmd.c_str(), "r");
-            if (!pipe) return "Error: Failed to run command";
-            char buffer[128];
-            std::string result;
-            while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-                result += buffer;
-            }
-            pclose(pipe);
-            return "Command output:\n" + result;
+    // Returns the number of prompts that failed
+    size_t run(std::istream& in) {
+        auto start = std::chrono::steady_clock::now();
+        read_prompts(in);
+        start_conversations();
+        client.run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cerr << "[memoraxx batch: " << completed << " prompts, " << failed << " failed, " << seconds << "s, "
+                  << (seconds > 0 ? completed / seconds : 0.0) << " prompts/s, peak in flight: " << client.peak_in_flight()
+                  << ", connections: " << connections.new_connections() << " new/" << connections.reused_connections() << " reused]\n";
+        if (g_interrupt.cancelled()) {
+            std::cerr << "Interrupted; requests in flight were cancelled and remaining prompts were not sent.\n";
+        } else if (g_shutdown && next_conversation < order.size()) {
+            std::cerr << "Interrupted; remaining prompts were not sent. Interrupt again to cancel requests in flight.\n";
         }
-        return "Unknown tool: " + name;
+        return failed;
     }
 
-    // Load memory from file
-    void load_memory() {
-        if (memory_file.empty()) return;
-        try {
-            std::ifstream ifs(memory_file);
-            if (!ifs.is_open()) return;
-            json memory_json;
-            ifs >> memory_json;
-            ifs.close();
-            memory.clear();
-            total_tokens = 0;
-            for (const auto& item : memory_json) {
-                if (item.contains("prompt") && item.contains("response")) {
-                    // Store prompt and response to avoid repeated JSON lookups
-                    const auto prompt = item["prompt"].get<std::string>();
-                    const auto response = item["response"].get<std::string>();
-                    int tokens = item.contains("token_count") ? item["token_count"].get<int>() : count_tokens(prompt + " " + response);
-                    if (total_tokens + tokens <= max_tokens) {
-                        memory.push_back({prompt, response, tokens});
-                        total_tokens += tokens;
-                    } else {
-                        break; // Stop loading if would exceed
-                    }
+private:
+    struct Item {
+        json id; // Echoed back; defaults to the input line number
+        std::string conversation;
+        std::string prompt;
+        bool use_cache = true; // "cache": false skips the response cache
+        std::chrono::milliseconds timeout{0}; // "timeout_ms"; 0 uses request_timeout_ms
+    };
+
+    struct Conversation {
+        std::deque<Item> items; // Waiting prompts, in input order
+        std::unique_ptr<LlamaStack> stack;
+        PendingTurn pending; // Turn of items.front() while in flight
+        int attempts = 0;
+        std::chrono::steady_clock::time_point posted; // First attempt of the pending turn
+        MultiClient::Response transfer; // Timings of the turn's latest request
+        size_t backend = BackendPool::NONE; // Server of the latest request, when routing
+        bool cancelled = false; // The pending turn was cancelled
+        bool timed_out = false; // The pending turn ran out of time
+    };
+
+    static const int MAX_ATTEMPTS = 3;
+
+    void read_prompts(std::istream& in) {
+        std::string line;
+        size_t line_number = 0;
+        while (std::getline(in, line)) {
+            ++line_number;
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            Item item;
+            item.id = line_number;
+            try {
+                json entry = json::parse(line);
+                if (entry.is_string()) {
+                    item.prompt = entry.get<std::string>();
+                } else {
+                    item.prompt = entry.at("prompt").get<std::string>();
+                    if (entry.contains("id")) item.id = entry["id"];
+                    if (entry.contains("conversation")) item.conversation = entry["conversation"].get<std::string>();
+                    if (entry.contains("cache")) item.use_cache = entry["cache"].get<bool>();
+                    if (entry.contains("timeout_ms")) item.timeout = std::chrono::milliseconds(entry["timeout_ms"].get<size_t>());
                 }
+                if (item.prompt.empty()) throw std::runtime_error("empty prompt");
+            } catch (const std::exception& e) {
+                // Reported right away so every input line gets a result line
+                write_result(json{{"id", item.id}, {"error", std::string("Invalid input: ") + e.what()}}, true);
+                continue;
             }
-        } catch (const std::exception& e) {
-            std::cerr << "Failed to load memory: " << e.what() << std::endl;
+
+            // Without an explicit conversation every prompt stands alone
+            std::string key = batch.shared_memory ? std::string()
+                            : item.conversation.empty() ? "#" + std::to_string(line_number)
+                            : "=" + item.conversation;
+            auto [it, inserted] = conversations.try_emplace(key);
+            if (inserted) order.push_back(&it->second);
+            it->second.items.push_back(std::move(item));
         }
     }
 
-public:
-    LlamaStack(const std::string& url = "http://localhost:11434/api/generate",
-                const std::string& model = "llama3.2",
-                size_t max_tokens = 4096,
-                const std::string& mem_file = "")
-        : base_url(url), model_name(model), max_tokens(max_tokens), total_tokens(0), memory_file(mem_file) {
-        curl = init_curl();
-        if (!memory_file.empty()) {
-            load_memory();
-        }
-        // Initialize tools
-        Tool run_cmd = {
-            "run_command",
-            "Run a shell command and return the output",
-            json{
-                {"type", "object"},
-                {"properties", {
-                    {"command", json{{"type", "string"}, {"description", "The shell command to run"}}}
-                }},
-                {"required", json::array({"command"})}
+    void start_conversations() {
+        while (!g_shutdown && active < batch.concurrency && next_conversation < order.size()) {
+            Conversation& conversation = *order[next_conversation++];
+            if (batch.shared_memory) {
+                conversation.stack = std::make_unique<LlamaStack>(base_url, model, max_tokens, memory_file, options);
+            } else {
+                // Independent memories live only for the run
+                LlamaOptions independent = options;
+                independent.retrieval = false;
+                // but still share the persistent response cache
+                if (independent.response_cache_file.empty() && !memory_file.empty()) {
+                    independent.response_cache_file = memory_file + ".cache";
+                }
+                conversation.stack = std::make_unique<LlamaStack>(base_url, model, max_tokens, "", independent);
             }
-        };
-        tools.push_back(run_cmd);
+            ++active;
+            send_next(conversation);
+        }
     }
 
-    ~LlamaStack() {
-        save_memory();
-        if (curl) {
-            curl_easy_cleanup(curl);
+    // Start the conversation's next prompt. Cache hits finish without a
+    // request, so conversations are advanced from a queue rather than by
+    // recursion, which long runs of hits would otherwise deepen.
+    void send_next(Conversation& conversation) {
+        advancing.push_back(&conversation);
+        if (draining) return;
+        draining = true;
+        while (!advancing.empty()) {
+            Conversation& next = *advancing.front();
+            advancing.pop_front();
+            advance(next);
         }
+        draining = false;
     }
 
-    // Clear memory
-    void clear_memory() {
-        memory.clear();
-        save_memory();
-        std::cout << "Memory cleared.\n";
+    void advance(Conversation& conversation) {
+        if (g_shutdown || conversation.items.empty()) {
+            conversation.stack.reset();
+            --active;
+            start_conversations();
+            return;
+        }
+        const Item& item = conversation.items.front();
+        conversation.posted = std::chrono::steady_clock::now();
+        conversation.pending = conversation.stack->prepare_turn(item.prompt, {item.timeout, &g_interrupt});
+        conversation.pending.use_cache = item.use_cache;
+        conversation.transfer = {};
+        conversation.cancelled = false;
+        conversation.timed_out = false;
+        request(conversation);
     }
 
-    std::string completion(const std::string& prompt) {
-        if (prompt.empty()) {
-            return "Error: Empty prompt provided";
+    // Post the pending request, unless the response cache answers it
+    void request(Conversation& conversation) {
+        conversation.attempts = 0;
+        conversation.backend = BackendPool::NONE;
+        std::string text;
+        std::vector<int> returned_context;
+        if (conversation.stack->cached_response(conversation.pending, text, returned_context)) {
+            on_model_response(conversation, std::move(text), std::move(returned_context));
+            return;
         }
+        post(conversation, std::chrono::milliseconds(0));
+    }
 
-        CURL* curl_handle = init_curl();
-        std::string response_buffer;
-        struct curl_slist* headers = nullptr;
+    void post(Conversation& conversation, std::chrono::milliseconds delay) {
+        // Each attempt gets what is left of the turn's deadline
+        std::chrono::milliseconds timeout(0);
+        const auto deadline = conversation.pending.deadline;
+        if (deadline != std::chrono::steady_clock::time_point::max()) {
+            const auto start = std::chrono::steady_clock::now() + delay;
+            if (start >= deadline) {
+                time_out(conversation);
+                return;
+            }
+            timeout = std::chrono::ceil<std::chrono::milliseconds>(deadline - start);
+        }
+        ++conversation.attempts;
+        std::string url = conversation.stack->url();
+        if (options.backends) {
+            // A retry avoids the backend that just failed
+            conversation.backend = options.backends->acquire(model, conversation.backend);
+            if (conversation.backend == BackendPool::NONE) {
+                finish(conversation, "Error: No backend serves model " + model);
+                return;
+            }
+            url = options.backends->url(conversation.backend);
+        }
+        client.post(url, conversation.pending.payload,
+                    [this, &conversation](MultiClient::Response& response) { on_response(conversation, response); },
+                    delay, timeout);
+    }
 
-        try {
-            // Build prompt with context
-            std::string full_prompt = build_context(prompt);
-
-            // Construct JSON payload
-            json json_payload = {
-                {"model", model_name},
-                {"prompt", full_prompt},
-                {"stream", false}
-            };
-            std::string payload = json_payload.dump();
-
-            // Set cURL options
-            headers = curl_slist_append(headers, "Content-Type: application/json");
-            curl_easy_setopt(curl_handle, CURLOPT_URL, base_url.c_str());
-            curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, payload.c_str());
-            curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
-            curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteCallback);
-            curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &response_buffer);
-
-            // Perform the request with retry
-            const int MAX_RETRIES = 3;
-            int retries = MAX_RETRIES;
-            bool success = false;
-            for (int attempt = 0; attempt < retries; ++attempt) {
-                if (attempt > 0) {
-                    int delay = 1 << (attempt - 1); // 1, 2, 4 seconds
-                    std::this_thread::sleep_for(std::chrono::seconds(delay));
-                }
+    void time_out(Conversation& conversation) {
+        conversation.timed_out = true;
+        const auto budget = std::chrono::duration_cast<std::chrono::milliseconds>(conversation.pending.deadline -
+                                                                                   conversation.posted);
+        finish(conversation, "Error: Timed out after " + std::to_string(budget.count()) + " ms");
+    }
 
-                CURLcode res = curl_easy_perform(curl_handle);
-                if (res != CURLE_OK) {
-                    if (attempt == retries - 1) {
-                        throw std::runtime_error("cURL error: " + std::string(curl_easy_strerror(res)));
-                    }
-                    continue;
-                }
+    void on_response(Conversation& conversation, MultiClient::Response& response) {
+        const bool cancelled = response.result == CURLE_ABORTED_BY_CALLBACK;
+        // cURL's clock may run out a few milliseconds before ours
+        const bool out_of_time = response.result == CURLE_OPERATION_TIMEDOUT &&
+                                 std::chrono::steady_clock::now() + std::chrono::milliseconds(10) >=
+                                     conversation.pending.deadline;
+        // Same retry policy as the REPL: transport errors and 5xx, with jittered backoff
+        bool retryable = response.result != CURLE_OK || response.http_code >= 500;
+        BackendPool* pool = options.backends.get();
+        if (pool && conversation.backend != BackendPool::NONE) {
+            // Cancelled or out of time says nothing about the backend
+            const auto outcome = cancelled || out_of_time ? BackendPool::Outcome::Cancelled
+                               : retryable ? BackendPool::Outcome::Failure : BackendPool::Outcome::Success;
+            pool->finish(conversation.backend, outcome, response.http_code == 200 ? response.first_byte_ms : -1.0);
+        }
+        if (cancelled || out_of_time) {
+            conversation.transfer = std::move(response);
+            if (out_of_time) {
+                time_out(conversation);
+                return;
+            }
+            conversation.cancelled = true;
+            finish(conversation, "Error: Request cancelled");
+            return;
+        }
+        if (retryable && conversation.attempts < MAX_ATTEMPTS && !g_shutdown) {
+            // Another healthy backend is tried right away
+            const bool elsewhere = pool && pool->available(model, conversation.backend) > 0;
+            const auto delay = elsewhere ? std::chrono::milliseconds(0) : retry_backoff(conversation.attempts - 1);
+            if (std::chrono::steady_clock::now() + delay < conversation.pending.deadline) {
+                post(conversation, delay);
+                return;
+            }
+        }
 
-                // Check HTTP status code
-                long http_code = 0;
-                curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &http_code);
-                if (http_code == 200) {
-                    success = true;
-                    break;
-                } else if (http_code >= 500 && attempt < retries - 1) {
-                    continue;
-                } else {
-                    throw std::runtime_error("HTTP error: " + std::to_string(http_code));
-                }
+        LlamaStack& stack = *conversation.stack;
+        stack.record_phase(Phase::Connect, response.connect_ms);
+        stack.record_phase(Phase::FirstByte, response.first_byte_ms - response.connect_ms);
+        stack.record_phase(Phase::Transfer, response.transfer_ms - response.first_byte_ms);
+        conversation.transfer = std::move(response);
+        const MultiClient::Response& transfer = conversation.transfer;
+        std::string text;
+        std::vector<int> returned_context;
+        try {
+            if (transfer.result != CURLE_OK) {
+                throw std::runtime_error("cURL error: " + std::string(curl_easy_strerror(transfer.result)));
+            }
+            if (transfer.http_code != 200) {
+                throw std::runtime_error("HTTP error: " + std::to_string(transfer.http_code));
             }
+            text = stack.decode_response(transfer.body, returned_context);
+            stack.cache_response(conversation.pending, text, returned_context);
+        } catch (const json::exception& e) {
+            finish(conversation, "JSON parse error: " + std::string(e.what()));
+            return;
+        } catch (const std::exception& e) {
+            finish(conversation, "Error: " + std::string(e.what()));
+            return;
+        }
+        conversation.transfer.body.clear();
+        on_model_response(conversation, std::move(text), std::move(returned_context));
+    }
 
-            // Parse JSON response
-            json response_json = json::parse(response_buffer);
-            if (!response_json.contains("response")) {
-                throw std::runtime_error("No 'response' field in API output");
+    // A response to the pending request, from the server or the cache
+    void on_model_response(Conversation& conversation, std::string text, std::vector<int> returned_context) {
+        LlamaStack& stack = *conversation.stack;
+        try {
+            if (stack.continue_turn(conversation.pending, text)) {
+                // Tools ran; send their output back to the model as the next step
+                request(conversation);
+                return;
             }
+            text = stack.finish_turn(conversation.pending, std::move(text), std::move(returned_context));
+        } catch (const std::exception& e) {
+            finish(conversation, "Error: " + std::string(e.what()));
+            return;
+        }
+        finish(conversation, "", &text);
+    }
 
-            std::string result = response_json["response"].get<std::string>();
+    // Write the result of the turn and move on to the conversation's next prompt
+    void finish(Conversation& conversation, const std::string& error, const std::string* response = nullptr) {
+        LlamaStack& stack = *conversation.stack;
+        const Item& item = conversation.items.front();
+        const MultiClient::Response& transfer = conversation.transfer;
+        const bool ok = response != nullptr;
+        json result = {{"id", item.id}};
+        if (!item.conversation.empty()) result["conversation"] = item.conversation;
+        if (ok) {
+            result["response"] = *response;
+        } else {
+            result["error"] = error;
+        }
 
-            // Check for tool call
-            try {
-                json response_parsed = json::parse(result);
-                if (response_parsed.contains("tool_call")) {
-                    std::string tool_name = response_parsed["tool_call"]["name"];
-                    json tool_args = response_parsed["tool_call"]["arguments"];
-                    std::string tool_output = execute_tool(tool_name, tool_args);
-                    result = tool_output;
+        stack.record_phase(Phase::Total, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - conversation.posted).count());
+        const CompletionStats& stats = stack.last_stats();
+        if (metrics) {
+            CompletionStats recorded = stats;
+            recorded.failed = !ok;
+            recorded.cancelled = conversation.cancelled;
+            recorded.timed_out = conversation.timed_out;
+            metrics->record(recorded);
+        }
+        if (conversation.cancelled) result["cancelled"] = true;
+        if (conversation.timed_out) result["timed_out"] = true;
+        result["attempts"] = conversation.attempts;
+        if (conversation.backend != BackendPool::NONE) result["backend"] = options.backends->url(conversation.backend);
+        result["latency_ms"] = stats.phase(Phase::Total);
+        result["queue_ms"] = transfer.queue_ms;
+        result["connect_ms"] = transfer.connect_ms;
+        result["first_byte_ms"] = transfer.first_byte_ms;
+        result["transfer_ms"] = transfer.transfer_ms;
+        if (ok) {
+            result["eval_count"] = stats.eval_count;
+            result["prompt_eval_count"] = stats.prompt_eval_count;
+            result["tokens_per_sec"] = stats.tokens_per_sec;
+            result["tool_called"] = stats.tool_called;
+            result["agent_steps"] = stats.agent_steps;
+            result["cache_hits"] = stats.cache_hits;
+            if (!stats.tool_runs.empty()) {
+                json& tools = result["tools"] = json::array();
+                for (const auto& run : stats.tool_runs) {
+                    tools.push_back({{"name", run.name}, {"ms", run.ms}, {"bytes", run.bytes}, {"timed_out", run.timed_out}});
                 }
-            } catch (const json::exception&) {
-                // Not a tool call, use as is
             }
+        }
+        write_result(result, !ok);
 
-            // Store interaction in memory
-            int tokens = count_tokens(prompt + " " + result);
-            memory.push_back({prompt, result, tokens});
-            total_tokens += tokens;
-            while (total_tokens > max_tokens && !memory.empty()) {
-                total_tokens -= memory.front().token_count;
-                memory.pop_front();
-            }
-            save_memory();
+        conversation.items.pop_front();
+        send_next(conversation);
+    }
 
-            curl_slist_free_all(headers);
-            curl_easy_cleanup(curl_handle);
-            return result;
-        } catch (const json::exception& e) {
-            curl_slist_free_all(headers);
-            curl_easy_cleanup(curl_handle);
-            return "JSON parse error: " + std::string(e.what());
-        } catch (const std::exception& e) {
-            curl_slist_free_all(headers);
-            curl_easy_cleanup(curl_handle);
-            return "Error: " + std::string(e.what());
-        }
+    void write_result(const json& result, bool is_failure) {
+        out << result.dump() << '\n' << std::flush;
+        ++completed;
+        if (is_failure) ++failed;
     }
+
+    BatchOptions batch;
+    std::string base_url;
+    std::string model;
+    size_t max_tokens;
+    std::string memory_file;
+    LlamaOptions options;
+    std::ostream& out;
+    Metrics* metrics;
+    ConnectionPool connections;
+    MultiClient client;
+    std::map<std::string, Conversation> conversations;
+    std::vector<Conversation*> order; // Conversations by first appearance
+    size_t next_conversation = 0;
+    std::deque<Conversation*> advancing; // Conversations waiting for send_next() to start their next prompt
+    bool draining = false; // send_next() is working through `advancing`
+    size_t active = 0; // Conversations with a LlamaStack
+    size_t completed = 0;
+    size_t failed = 0;
 };
 
-int main() {
+// Print command-line usage
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [--batch FILE] [--output FILE] [--jobs N] [--memory independent|shared]\n"
+              << "       [--metrics-file FILE] [--daemon] [--listen ENDPOINT] [--allow-remote]\n"
+              << "       [--connect ENDPOINT] [--session ID]\n"
+              << "\n"
+              << "Without options, starts the interactive prompt.\n"
+              << "  --batch FILE   Run JSONL prompts from FILE ('-' for stdin) and exit\n"
+              << "  --output FILE  Write JSONL results to FILE instead of stdout\n"
+              << "  --jobs N       Requests in flight at once (default: 4)\n"
+              << "  --memory MODE  'independent' (default): each prompt, or each \"conversation\",\n"
+              << "                 has its own memory; 'shared': all prompts run in order on\n"
+              << "                 the memory in memory_file\n"
+              << "  --metrics-file FILE\n"
+              << "                 Write per-turn metrics to FILE: Prometheus text format\n"
+              << "                 if it ends in .prom, otherwise one JSON line per turn\n"
+              << "  --daemon       Serve sessions to many clients until interrupted\n"
+              << "  --listen ENDPOINT\n"
+              << "                 Where the daemon listens: unix:PATH or HOST:PORT\n"
+              << "                 (default: unix:memoraxx.sock); TCP hosts must be loopback\n"
+              << "  --allow-remote Let the daemon listen on other TCP addresses. Anyone who\n"
+              << "                 can connect can then run shell commands through tools\n"
+              << "  --connect ENDPOINT\n"
+              << "                 Run the interactive prompt against a daemon\n"
+              << "  --session ID   Daemon session to use with --connect (default: $USER)\n";
+}
+
+int main(int argc, char** argv) {
     // Load config or use defaults
     std::string base_url = "http://localhost:11434/api/generate";
     std::string model = "llama3.2";
     size_t max_tokens = 4096;
     std::string memory_file = "memory.json";
+    LlamaOptions options;
+    BatchOptions batch;
+    bool batch_mode = false;
+    DaemonOptions daemon;
+    bool daemon_mode = false;
+    std::string connect; // Daemon endpoint in thin client mode
+    const char* user = std::getenv("USER");
+    std::string session_id = user && *user ? user : "default";
+    bool metrics_enabled = true;
+    std::string metrics_file;
+    bool warm_up = true; // Load the model on the server while the REPL starts
+    std::vector<BackendConfig> backends; // Routed over instead of base_url when set
+    RoutingOptions routing;
 
     try {
         std::ifstream ifs("config.json");
@@ -390,6 +552,59 @@ int main() {
             if (config.contains("model")) model = config["model"].get<std::string>();
             if (config.contains("max_tokens")) max_tokens = config["max_tokens"].get<size_t>();
             if (config.contains("memory_file")) memory_file = config["memory_file"].get<std::string>();
+            if (config.contains("stream")) options.stream = config["stream"].get<bool>();
+            if (config.contains("session_context")) options.session_context = config["session_context"].get<bool>();
+            if (config.contains("tokenizer_file")) options.tokenizer_file = config["tokenizer_file"].get<std::string>();
+            if (config.contains("retrieval")) options.retrieval = config["retrieval"].get<bool>();
+            if (config.contains("embedding_model")) options.embedding_model = config["embedding_model"].get<std::string>();
+            if (config.contains("embedding_url")) options.embedding_url = config["embedding_url"].get<std::string>();
+            if (config.contains("retrieval_top_k")) options.retrieval_top_k = config["retrieval_top_k"].get<size_t>();
+            if (config.contains("retrieval_tokens")) options.retrieval_tokens = config["retrieval_tokens"].get<size_t>();
+            if (config.contains("batch_concurrency")) batch.concurrency = config["batch_concurrency"].get<size_t>();
+            if (config.contains("batch_memory")) batch.shared_memory = config["batch_memory"].get<std::string>() == "shared";
+            if (config.contains("agent_max_steps")) options.agent_max_steps = std::max<size_t>(1, config["agent_max_steps"].get<size_t>());
+            if (config.contains("tool_timeout_ms")) options.tool_timeout_ms = config["tool_timeout_ms"].get<size_t>();
+            if (config.contains("tool_output_bytes")) options.tool_output_bytes = config["tool_output_bytes"].get<size_t>();
+            if (config.contains("tool_workers")) options.tool_workers = config["tool_workers"].get<size_t>();
+            if (config.contains("response_cache")) options.response_cache = config["response_cache"].get<bool>();
+            if (config.contains("response_cache_bytes")) options.response_cache_bytes = config["response_cache_bytes"].get<size_t>();
+            if (config.contains("response_cache_file")) options.response_cache_file = config["response_cache_file"].get<std::string>();
+            if (config.contains("daemon_listen")) daemon.listen = config["daemon_listen"].get<std::string>();
+            if (config.contains("daemon_workers")) daemon.workers = std::max<size_t>(1, config["daemon_workers"].get<size_t>());
+            if (config.contains("daemon_session_dir")) daemon.session_dir = config["daemon_session_dir"].get<std::string>();
+            if (config.contains("daemon_memory_bytes")) daemon.memory_bytes = config["daemon_memory_bytes"].get<size_t>();
+            if (config.contains("daemon_idle_seconds")) daemon.idle_seconds = config["daemon_idle_seconds"].get<size_t>();
+            if (config.contains("backends")) {
+                for (const auto& entry : config["backends"]) {
+                    BackendConfig backend;
+                    if (entry.is_string()) {
+                        backend.url = entry.get<std::string>();
+                    } else {
+                        backend.url = entry.at("url").get<std::string>();
+                        backend.weight = entry.value("weight", 1.0);
+                        backend.models = entry.value("models", std::vector<std::string>{});
+                    }
+                    backends.push_back(std::move(backend));
+                }
+            }
+            if (config.contains("backend_health_interval_ms")) routing.health_interval_ms = config["backend_health_interval_ms"].get<size_t>();
+            if (config.contains("backend_eject_failures")) routing.eject_failures = std::max<size_t>(1, config["backend_eject_failures"].get<size_t>());
+            if (config.contains("backend_eject_ms")) routing.eject_ms = config["backend_eject_ms"].get<size_t>();
+            if (config.contains("backend_slow_factor")) routing.slow_factor = config["backend_slow_factor"].get<double>();
+            if (config.contains("hedge")) routing.hedge = config["hedge"].get<bool>();
+            if (config.contains("hedge_min_ms")) routing.hedge_min_ms = config["hedge_min_ms"].get<size_t>();
+            if (config.contains("request_timeout_ms")) options.request_timeout_ms = config["request_timeout_ms"].get<size_t>();
+            if (config.contains("connect_timeout_ms")) options.connect_timeout_ms = config["connect_timeout_ms"].get<size_t>();
+            if (config.contains("archive")) options.archive = config["archive"].get<bool>();
+            if (config.contains("warm_up")) warm_up = config["warm_up"].get<bool>();
+            if (config.contains("keep_alive")) options.keep_alive = config["keep_alive"].get<std::string>();
+            if (config.contains("summarize")) options.summarize = config["summarize"].get<bool>();
+            if (config.contains("summary_tokens")) options.summary_tokens = config["summary_tokens"].get<size_t>();
+            if (config.contains("summary_model")) options.summary_model = config["summary_model"].get<std::string>();
+            if (config.contains("max_memory_bytes")) options.max_memory_bytes = config["max_memory_bytes"].get<size_t>();
+            if (config.contains("memory_compression")) options.memory_compression = config["memory_compression"].get<bool>();
+            if (config.contains("metrics")) metrics_enabled = config["metrics"].get<bool>();
+            if (config.contains("metrics_file")) metrics_file = config["metrics_file"].get<std::string>();
         }
     } catch (const nlohmann::json::exception& e) {
         std::cerr << "Warning: Failed to parse config.json: " << e.what() << ". Using default settings." << std::endl;
@@ -397,29 +612,150 @@ int main() {
         std::cerr << "Warning: Failed to load config.json: " << e.what() << ". Using default settings." << std::endl;
     }
 
+    // Command-line options override config.json
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--batch" && has_value) {
+            batch_mode = true;
+            batch.input = argv[++i];
+        } else if (arg == "--output" && has_value) {
+            batch.output = argv[++i];
+        } else if (arg == "--jobs" && has_value) {
+            batch.concurrency = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--memory" && has_value) {
+            std::string mode = argv[++i];
+            if (mode != "independent" && mode != "shared") {
+                std::cerr << "Unknown memory mode: " << mode << std::endl;
+                return 1;
+            }
+            batch.shared_memory = mode == "shared";
+        } else if (arg == "--metrics-file" && has_value) {
+            metrics_file = argv[++i];
+        } else if (arg == "--daemon") {
+            daemon_mode = true;
+        } else if (arg == "--listen" && has_value) {
+            daemon.listen = argv[++i];
+        } else if (arg == "--allow-remote") {
+            daemon.allow_remote = true;
+        } else if (arg == "--connect" && has_value) {
+            connect = argv[++i];
+        } else if (arg == "--session" && has_value) {
+            session_id = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    if (options.memory_compression && !TurnStore::compression_available()) {
+        std::cerr << "Warning: memory_compression needs a build with zstd. Storing turns uncompressed." << std::endl;
+    }
+
     std::signal(SIGINT, signal_handler);
+    std::signal(SIGTERM, signal_handler);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
 
-    try {
-        // Initialize with memory file for persistence
-        LlamaStack llama(base_url, model, max_tokens, memory_file);
-
-        // Startup animation
-        std::cout << "Waking up";
-        for (int i = 0; i < 4 && !g_shutdown; ++i) {
-            std::cout << "." << std::flush;
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    // Turn stats are aggregated only when enabled; a metrics file implies it
+    Metrics metrics;
+    metrics_enabled = metrics_enabled || !metrics_file.empty();
+    if (!metrics_file.empty()) metrics.open_sink(metrics_file);
+
+    // One pool for every stack, so load and health are tracked process-wide
+    if (!backends.empty() && connect.empty()) {
+        try {
+            options.backends = std::make_shared<BackendPool>(backends, routing);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: Invalid backends: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (batch_mode) {
+        try {
+            std::ifstream input_file;
+            if (batch.input != "-") {
+                input_file.open(batch.input);
+                if (!input_file.is_open()) throw std::runtime_error("cannot open " + batch.input);
+            }
+            std::ofstream output_file;
+            if (batch.output != "-") {
+                output_file.open(batch.output);
+                if (!output_file.is_open()) throw std::runtime_error("cannot open " + batch.output);
+            }
+            BatchRunner runner(batch, base_url, model, max_tokens, memory_file, options,
+                               batch.output == "-" ? std::cout : output_file, metrics_enabled ? &metrics : nullptr);
+            size_t failed = runner.run(batch.input == "-" ? std::cin : input_file);
+            return failed == 0 ? 0 : 2;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
         }
-        if (g_shutdown) {
-            std::cout << "\nShutdown requested. Exiting.\n";
+    }
+
+    if (daemon_mode) {
+        try {
+            // One response cache for all sessions
+            LlamaOptions session_options = options;
+            if (session_options.response_cache_file.empty()) {
+                session_options.response_cache_file = daemon.session_dir + "/responses.cache";
+            }
+            SessionServer server(daemon, [&](const std::string& session_file) {
+                return std::make_unique<LlamaStack>(base_url, model, max_tokens, session_file, session_options);
+            }, metrics_enabled ? &metrics : nullptr);
+            server.start();
+            std::cout << "memoraxx daemon listening on " << daemon.listen;
+            if (server.port() != 0) std::cout << " (port " << server.port() << ")";
+            std::cout << ", " << daemon.workers << " workers, sessions in " << daemon.session_dir << "\n" << std::flush;
+            while (!g_shutdown) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            }
+            std::cout << "Shutting down daemon.\n";
+            server.stop();
             return 0;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        // Initialize with memory file for persistence. In thin client mode
+        // the daemon holds the memory instead. The stack is built in the
+        // background, with the model loading on the server meanwhile, so the
+        // prompt accepts input at once; the first command or prompt that
+        // needs the stack waits for whatever is left.
+        std::unique_ptr<LlamaStack> llama;
+        std::future<std::unique_ptr<LlamaStack>> loading;
+        std::unique_ptr<DaemonClient> remote;
+        if (connect.empty()) {
+            LlamaOptions repl_options = options;
+            repl_options.warm_up = warm_up;
+            loading = std::async(std::launch::async, [&, repl_options] {
+                return std::make_unique<LlamaStack>(base_url, model, max_tokens, memory_file, repl_options);
+            });
+        } else {
+            remote = std::make_unique<DaemonClient>(connect, session_id);
+            remote->stats(); // Fail now if the daemon is not there
+        }
+        auto stack = [&]() -> LlamaStack& {
+            if (!llama) llama = loading.get();
+            return *llama;
+        };
+
+        std::cout << "\033[1;32mWelcome to memoraxx!\033[0m\n";
+        std::cout << "Ask anything. Type 'exit', 'quit', 'clear' or 'export' to manage memory, 'search' to find past turns, "
+                     "'stats' for metrics.\n";
+        if (options.response_cache) {
+            std::cout << "Repeated prompts are answered from the response cache; start a prompt with '!' to skip it.\n";
         }
-        std::cout << "\n\033[1;32mWelcome to memoraxx!\033[0m\n";
-        std::cout << "Ask anything. Type 'exit', 'quit', or 'clear' to manage memory.\n";
 
         std::string user_message;
         while (!g_shutdown) {
             std::cout << "\n> ";
-            std::getline(std::cin, user_message);
+            if (!std::getline(std::cin, user_message)) {
+                break; // End of input
+            }
             if (user_message.empty()) {
                 std::cout << "Please enter a non-empty prompt.\n";
                 continue;
@@ -455,7 +791,89 @@ int main() {
                     g_shutdown = true;
                 }},
                 {"clear", [&]() {
-                    llama.clear_memory();
+                    if (!remote) {
+                        stack().clear_memory();
+                        return;
+                    }
+                    try {
+                        remote->clear_memory();
+                        std::cout << "Memory cleared.\n";
+                    } catch (const std::exception& e) {
+                        std::cerr << "Error: " << e.what() << std::endl;
+                    }
+                }},
+                {"export", [&]() {
+                    if (!remote) {
+                        stack().export_memory();
+                        return;
+                    }
+                    try {
+                        std::cout << "Memory exported to " << remote->export_memory() << " on the daemon.\n";
+                    } catch (const std::exception& e) {
+                        std::cerr << "Error: " << e.what() << std::endl;
+                    }
+                }},
+                {"search", [&]() {
+                    if (!remote && !stack().turn_archive()) {
+                        std::cout << "The archive is disabled; it needs a memory_file and \"archive\": true.\n";
+                        return;
+                    }
+                    std::cout << "Search past turns for: " << std::flush;
+                    std::string query;
+                    if (!std::getline(std::cin, query) || query.empty()) return;
+                    std::vector<ArchiveHit> hits;
+                    const auto search_start = std::chrono::steady_clock::now();
+                    try {
+                        hits = remote ? remote->search_archive(query, SEARCH_RESULTS)
+                                      : stack().search_archive(query, SEARCH_RESULTS);
+                    } catch (const std::exception& e) {
+                        std::cerr << "Error: " << e.what() << std::endl;
+                        return;
+                    }
+                    const double search_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - search_start).count();
+                    if (hits.empty()) {
+                        std::cout << "No matching turns.\n";
+                        return;
+                    }
+                    print_hits(hits);
+                    std::cout << hits.size() << (hits.size() == 1 ? " turn" : " turns") << " in " << std::fixed
+                              << std::setprecision(2) << search_ms
+                              << " ms. Numbers to bring back into context (Enter to skip): " << std::flush;
+                    std::string picks;
+                    if (!std::getline(std::cin, picks)) return;
+                    std::istringstream numbers(picks);
+                    std::vector<uint32_t> ids;
+                    for (size_t n; numbers >> n;) {
+                        if (n >= 1 && n <= hits.size()) ids.push_back(hits[n - 1].id);
+                    }
+                    if (ids.empty()) return;
+                    try {
+                        const size_t recalled = remote ? remote->recall_archived(ids) : stack().recall_archived(ids);
+                        if (recalled == 0) {
+                            std::cout << "Already in context, or too long for it.\n";
+                        } else {
+                            std::cout << recalled << (recalled == 1 ? " turn" : " turns")
+                                      << " brought back into context until 'clear'.\n";
+                        }
+                    } catch (const std::exception& e) {
+                        std::cerr << "Error: " << e.what() << std::endl;
+                    }
+                }},
+                {"stats", [&]() {
+                    if (remote) {
+                        try {
+                            std::cout << remote->stats();
+                        } catch (const std::exception& e) {
+                            std::cerr << "Error: " << e.what() << std::endl;
+                        }
+                    } else if (metrics_enabled) {
+                        std::cout << metrics.summary();
+                    } else {
+                        std::cout << "Metrics are disabled; set \"metrics\": true in config.json.\n";
+                    }
+                    if (!remote) std::cout << "Memory: " << stack().memory_report() << "\n";
+                    if (options.backends) std::cout << options.backends->summary();
                 }}
             };
 
@@ -488,6 +906,7 @@ int main() {
 
             // Get CPU usage before operation
             double cpu_before = get_cpu_time();
+            if (!remote) stack(); // Memory still loading on the first turn
 
             std::cout << "\rmemoraxx is thinking" << std::flush;
             std::atomic<bool> done{false};
@@ -495,15 +914,53 @@ int main() {
                 int count = 0;
                 while (!done) {
                     std::cout << "\rmemoraxx is thinking" << std::string(count % 4, '.') << std::flush;
-                    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+                    // Short naps, so the first streamed token is not held up by the join
+                    for (int nap = 0; nap < 8 && !done; ++nap) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    }
                     count++;
                 }
             });
 
-            std::string response = llama.completion(user_message);
-            done = true;
-            loader.join();
-            std::cout << "\r" << std::string(20, ' ') << "\r"; // Clear line
+            // In streaming mode the spinner is replaced by the response as soon as
+            // the first token arrives.
+            bool streaming_started = false;
+            auto print_token = [&](const std::string& token) {
+                if (!streaming_started) {
+                    done = true;
+                    loader.join();
+                    std::cout << "\r" << std::string(24, ' ') << "\r"; // Clear line
+                    std::cout << "\n--- AI Response ---\n";
+                    streaming_started = true;
+                }
+                std::cout << token << std::flush;
+            };
+
+            // A leading '!' asks the model even when the response is cached
+            bool use_cache = user_message[0] != '!';
+            if (!use_cache) user_message.erase(0, 1);
+            std::string response;
+            CompletionStats remote_stats;
+            // Ctrl+C from here on cancels this turn rather than the session
+            const RequestControl control{std::chrono::milliseconds(0), &g_interrupt};
+            g_interrupt.reset();
+            g_in_turn = true;
+            if (remote) {
+                try {
+                    response = remote->completion(user_message, use_cache, remote_stats, control);
+                } catch (const std::exception& e) {
+                    response = "Error: " + std::string(e.what());
+                    remote_stats.failed = true;
+                }
+            } else {
+                response = stack().completion(user_message, print_token, use_cache, control);
+            }
+            g_in_turn = false;
+            if (!streaming_started) {
+                done = true;
+                loader.join();
+                std::cout << "\r" << std::string(24, ' ') << "\r"; // Clear line
+            }
 
             // Get CPU usage after operation
             double cpu_after = get_cpu_time();
@@ -518,13 +975,63 @@ int main() {
             // Calculate CPU usage difference for this operation
             double cpu_usage = (cpu_after - cpu_before) * 1000.0;
 
-            std::cout << "\n--- AI Response ---\n" << response << "\n-------------------\n";
+            const CompletionStats& stats = remote ? remote_stats : llama->last_stats();
+            if (metrics_enabled && !remote) metrics.record(stats);
+            if (!streaming_started) {
+                std::cout << "\n--- AI Response ---\n" << response << "\n-------------------\n";
+            } else {
+                // A streamed tool call is replaced by the tool's output
+                if (stats.tool_called || stats.failed) {
+                    std::cout << "\n" << response;
+                }
+                std::cout << "\n-------------------\n";
+            }
             std::cout << "[memoraxx: brain active";
             for (int i = 0; i < 3; ++i) {
                 std::cout << "." << std::flush;
                 std::this_thread::sleep_for(std::chrono::milliseconds(300));
             }
-            std::cout << "]\n[" << current_time << ", took " << duration.count() << "s, CPU usage: " << cpu_usage << " ms]\n";
+            std::cout << "]\n[" << current_time << ", took " << duration.count() << "s, CPU usage: " << cpu_usage << " ms";
+            if (stats.streamed && stats.time_to_first_token > 0) {
+                std::cout << ", TTFT: " << stats.time_to_first_token << "s";
+            }
+            if (stats.tokens_per_sec > 0) {
+                std::cout << ", " << stats.tokens_per_sec << " tokens/s";
+            }
+            if (stats.prompt_tokens_reused > 0) {
+                std::cout << ", prompt eval: " << stats.prompt_eval_count << " tokens (" << stats.prompt_tokens_reused << " saved)";
+            }
+            if (stats.agent_steps > 1) {
+                std::cout << ", agent steps: " << stats.agent_steps;
+            }
+            if (stats.cache_hits > 0) {
+                std::cout << ", cached: " << stats.cache_hits << " of " << stats.agent_steps << " responses";
+            }
+            if (!stats.backend.empty()) {
+                std::cout << ", backend: " << stats.backend;
+                if (stats.hedges > 0) std::cout << " (" << stats.hedge_wins << " of " << stats.hedges << " hedges won)";
+            }
+            for (const auto& run : stats.tool_runs) {
+                std::cout << ", " << run.name << ": " << run.ms << " ms/" << run.bytes << " bytes"
+                          << (run.timed_out ? " (timed out)" : "");
+            }
+            if (stats.summary_turns > 0) {
+                std::cout << ", summary: " << stats.summary_turns << " turns in " << stats.summary_tokens << " tokens ("
+                          << stats.summary_source_tokens - stats.summary_tokens << " saved)";
+            }
+            if (stats.retrieved_turns > 0) {
+                std::cout << ", recalled: " << stats.retrieved_turns << " turns in " << stats.phase(Phase::Retrieval) << " ms";
+            }
+            if (llama) {
+                const ConnectionPool& pool = llama->connection_pool();
+                std::cout << ", connections: " << pool.new_connections() << " new/" << pool.reused_connections() << " reused";
+            } else {
+                std::cout << ", session: " << session_id;
+            }
+            if (size_t rss = process_rss_bytes()) {
+                std::cout << ", RSS: " << rss / 1048576.0 << " MB";
+            }
+            std::cout << "]\n";
         }
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
@@ -0,0 +1,225 @@
+#include "memory_journal.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <nlohmann/json.hpp>
+#ifndef _WIN32
+#include <unistd.h> // For fsync
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+const size_t MIN_COMPACTION_GARBAGE = 64;
+
+std::string add_record(const Interaction& interaction) {
+    return json{
+        {"op", "add"},
+        {"prompt", interaction.prompt},
+        {"response", interaction.response},
+        {"token_count", interaction.token_count}
+    }.dump() + "\n";
+}
+
+std::string summary_record(const MemorySummary& summary) {
+    return json{
+        {"op", "summary"},
+        {"text", summary.text},
+        {"token_count", summary.token_count},
+        {"turns", summary.turns},
+        {"source_tokens", summary.source_tokens}
+    }.dump() + "\n";
+}
+
+// Flush stdio buffers and ask the OS to persist the file
+void sync_file(std::FILE* file) {
+    std::fflush(file);
+#ifndef _WIN32
+    fsync(fileno(file));
+#endif
+}
+
+} // namespace
+
+MemoryJournal::MemoryJournal(std::string journal_path) : path(std::move(journal_path)) {
+    // A leftover snapshot means a compaction was interrupted; the journal itself is intact
+    std::error_code ec;
+    std::filesystem::remove(path + ".tmp", ec);
+}
+
+MemoryJournal::~MemoryJournal() {
+    join_compaction();
+    if (out) std::fclose(out);
+}
+
+void MemoryJournal::open_for_append() {
+    out = std::fopen(path.c_str(), "ab");
+    if (!out) {
+        throw std::runtime_error("Failed to open memory journal " + path);
+    }
+}
+
+bool MemoryJournal::replay(std::deque<Interaction>& memory, MemorySummary* summary) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.is_open()) return false;
+    std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ifs.close();
+
+    memory.clear();
+    if (summary) *summary = MemorySummary{};
+    records = 0;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        size_t end = data.find('\n', offset);
+        bool valid = end != std::string::npos;
+        if (valid) {
+            try {
+                json record = json::parse(data.begin() + offset, data.begin() + end);
+                const std::string op = record.at("op").get<std::string>();
+                if (op == "add") {
+                    memory.push_back({record.at("prompt").get<std::string>(),
+                                      record.at("response").get<std::string>(),
+                                      record.at("token_count").get<int>()});
+                } else if (op == "evict") {
+                    if (!memory.empty()) memory.pop_front();
+                } else if (op == "summary") {
+                    MemorySummary restored{record.at("text").get<std::string>(), record.at("token_count").get<int>(),
+                                           record.at("turns").get<size_t>(),
+                                           record.at("source_tokens").get<long long>()};
+                    if (summary) *summary = std::move(restored);
+                } else if (op == "clear") {
+                    memory.clear();
+                    if (summary) *summary = MemorySummary{};
+                } else {
+                    valid = false;
+                }
+            } catch (const json::exception&) {
+                valid = false;
+            }
+        }
+        if (!valid) {
+            // Everything from the first bad record on was never fully written
+            std::cerr << "Warning: Truncating corrupt memory journal tail at byte " << offset << std::endl;
+            std::filesystem::resize_file(path, offset);
+            break;
+        }
+        ++records;
+        offset = end + 1;
+    }
+    live = memory.size();
+    return true;
+}
+
+void MemoryJournal::write_record(const std::string& line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!out) open_for_append();
+    if (std::fwrite(line.data(), 1, line.size(), out) != line.size() || std::fflush(out) != 0) {
+        throw std::runtime_error("Failed to append to memory journal " + path);
+    }
+    ++records;
+    if (compacting) tail.push_back(line);
+}
+
+void MemoryJournal::append(const Interaction& interaction) {
+    write_record(add_record(interaction));
+    ++live;
+}
+
+void MemoryJournal::record_eviction() {
+    write_record("{\"op\":\"evict\"}\n");
+    if (live > 0) --live;
+}
+
+void MemoryJournal::record_summary(const MemorySummary& summary) {
+    write_record(summary_record(summary));
+}
+
+void MemoryJournal::record_clear() {
+    write_record("{\"op\":\"clear\"}\n");
+    live = 0;
+}
+
+bool MemoryJournal::should_compact() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t garbage = records - std::min(records, live);
+    return !compacting && garbage >= std::max(MIN_COMPACTION_GARBAGE, live);
+}
+
+void MemoryJournal::compact_async(std::vector<Interaction> snapshot, MemorySummary summary) {
+    join_compaction();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        compacting = true;
+        tail.clear();
+    }
+    compactor = std::thread([this, snapshot = std::move(snapshot), summary = std::move(summary)]() {
+        run_compaction(snapshot, summary);
+    });
+}
+
+void MemoryJournal::compact(const std::vector<Interaction>& snapshot, const MemorySummary& summary) {
+    join_compaction();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        compacting = true;
+        tail.clear();
+    }
+    run_compaction(snapshot, summary);
+}
+
+void MemoryJournal::run_compaction(const std::vector<Interaction>& snapshot, const MemorySummary& summary) {
+    const std::string tmp_path = path + ".tmp";
+    try {
+        std::FILE* tmp = std::fopen(tmp_path.c_str(), "wb");
+        if (!tmp) {
+            throw std::runtime_error("cannot create " + tmp_path);
+        }
+        const bool has_summary = summary.turns > 0;
+        if (has_summary) {
+            const std::string line = summary_record(summary);
+            std::fwrite(line.data(), 1, line.size(), tmp);
+        }
+        for (const auto& interaction : snapshot) {
+            const std::string line = add_record(interaction);
+            std::fwrite(line.data(), 1, line.size(), tmp);
+        }
+
+        // Records appended meanwhile go after the snapshot, then the
+        // snapshot atomically replaces the journal.
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& line : tail) {
+            std::fwrite(line.data(), 1, line.size(), tmp);
+        }
+        sync_file(tmp);
+        bool write_failed = std::ferror(tmp) != 0;
+        std::fclose(tmp);
+        if (write_failed) {
+            throw std::runtime_error("write to " + tmp_path + " failed");
+        }
+        if (out) {
+            std::fclose(out);
+            out = nullptr;
+        }
+        std::filesystem::rename(tmp_path, path);
+        records = snapshot.size() + tail.size() + (has_summary ? 1 : 0);
+        tail.clear();
+        compacting = false;
+        open_for_append();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to compact memory journal: " << e.what() << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(tmp_path, ec);
+        std::lock_guard<std::mutex> lock(mutex);
+        tail.clear();
+        compacting = false;
+    }
+}
+
+void MemoryJournal::join_compaction() {
+    if (compactor.joinable()) compactor.join();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "interaction.hpp"
+
+// Append-only on-disk log of conversation memory.
+// Each new interaction, eviction, summary update and clear is written as one JSON line, so a
+// turn costs O(new turn) disk I/O instead of rewriting the whole history.
+// Dead records are dropped by a background compaction that writes a fresh
+// snapshot and atomically renames it over the journal.
+class MemoryJournal {
+public:
+    explicit MemoryJournal(std::string path);
+    ~MemoryJournal();
+    MemoryJournal(const MemoryJournal&) = delete;
+    MemoryJournal& operator=(const MemoryJournal&) = delete;
+
+    const std::string& file_path() const { return path; }
+
+    // Rebuild memory, and the summary of evicted turns if `summary` is
+    // given, from the journal. A torn or corrupt tail left by a crash is
+    // truncated away. Returns false if there is no journal yet.
+    bool replay(std::deque<Interaction>& out, MemorySummary* summary = nullptr);
+
+    void append(const Interaction& interaction);
+    void record_eviction();
+    // Replace the summary of evicted turns
+    void record_summary(const MemorySummary& summary);
+    void record_clear();
+
+    // True when dead records outweigh live ones and no compaction is running
+    bool should_compact() const;
+
+    // Rewrite the journal from `snapshot` and `summary` on a background thread
+    void compact_async(std::vector<Interaction> snapshot, MemorySummary summary = {});
+
+    // Rewrite the journal from `snapshot` and `summary` before returning
+    void compact(const std::vector<Interaction>& snapshot, const MemorySummary& summary = {});
+
+private:
+    void write_record(const std::string& line);
+    void open_for_append();
+    void run_compaction(const std::vector<Interaction>& snapshot, const MemorySummary& summary);
+    void join_compaction();
+
+    std::string path;
+    std::FILE* out = nullptr;
+    mutable std::mutex mutex; // Guards `out`, the counters and `tail`
+    size_t records = 0; // Records currently in the journal file
+    size_t live = 0; // Interactions the journal currently describes
+    bool compacting = false;
+    std::vector<std::string> tail; // Records appended while compacting
+    std::thread compactor;
+};
@@ -0,0 +1,153 @@
+#include "memory_summarizer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+const size_t MAX_BACKOFF_SHIFT = 5; // Retries wait at most 32 s
+
+std::string trim(const std::string& text) {
+    const size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return {};
+    const size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+} // namespace
+
+MemorySummarizer::MemorySummarizer(Generate generate, CountTokens count_tokens, size_t max_tokens,
+                                   size_t batch_tokens)
+    : generate(std::move(generate)), count_tokens(std::move(count_tokens)), max_tokens(max_tokens),
+      batch_tokens(batch_tokens) {
+    worker = std::thread([this] { run(); });
+}
+
+MemorySummarizer::~MemorySummarizer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cancel.cancel();
+    wake.notify_all();
+    worker.join();
+}
+
+void MemorySummarizer::reset(MemorySummary restored) {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.clear();
+    summary = std::move(restored);
+    changed = false;
+    ++generation;
+    wake.notify_all();
+}
+
+void MemorySummarizer::add(Interaction interaction) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(interaction));
+    }
+    wake.notify_all();
+}
+
+bool MemorySummarizer::take(MemorySummary& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!changed) return false;
+    out = summary;
+    changed = false;
+    return true;
+}
+
+size_t MemorySummarizer::pending() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size() + in_flight;
+}
+
+std::string MemorySummarizer::prompt(const MemorySummary& summary, const std::deque<Interaction>& turns,
+                                     size_t max_tokens) {
+    // Words run about 1.3 tokens each
+    const size_t max_words = std::max<size_t>(max_tokens * 10 / 13, 1);
+    std::string text =
+        "You keep a running summary of a conversation between a user and an AI assistant. "
+        "Update the summary with the new turns below. Keep every fact, name, number, preference, "
+        "decision and open question a later answer may need, and drop small talk. Write plain prose "
+        "of at most " + std::to_string(max_words) + " words and reply with the updated summary only.\n\n"
+        "Current summary:\n";
+    text += summary.text.empty() ? "(none)" : summary.text;
+    text += "\n\nNew turns:\n";
+    for (const auto& turn : turns) {
+        text += "User: ";
+        text += turn.prompt;
+        text += "\nAssistant: ";
+        text += turn.response;
+        text += "\n\n";
+    }
+    return text;
+}
+
+void MemorySummarizer::run() {
+    size_t failures = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || !queue.empty(); });
+        if (stopping) return;
+
+        // The oldest turns within the batch bound, at least one
+        std::deque<Interaction> batch;
+        long long tokens = 0;
+        while (!queue.empty() &&
+               (batch.empty() || tokens + std::max(queue.front().token_count, 0) <= static_cast<long long>(batch_tokens))) {
+            tokens += std::max(queue.front().token_count, 0);
+            batch.push_back(std::move(queue.front()));
+            queue.pop_front();
+        }
+        in_flight = batch.size();
+        const MemorySummary base = summary;
+        const size_t started = generation;
+        lock.unlock();
+
+        std::string text;
+        std::string error;
+        int text_tokens = 0;
+        try {
+            text = trim(generate(prompt(base, batch, max_tokens), cancel));
+            if (text.empty()) throw std::runtime_error("empty summary");
+            // Cut an overlong summary at a word boundary until it fits
+            text_tokens = count_tokens(text);
+            while (text_tokens > static_cast<int>(max_tokens)) {
+                const size_t keep = text.size() * max_tokens / static_cast<size_t>(text_tokens);
+                const size_t space = keep > 0 ? text.find_last_of(" \n", keep) : std::string::npos;
+                text.resize(space != std::string::npos && space > 0 ? space : keep);
+                text_tokens = count_tokens(text);
+            }
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+
+        lock.lock();
+        in_flight = 0;
+        if (stopping) return;
+        if (started != generation) continue; // Reset meanwhile; the batch is gone
+
+        if (!error.empty()) {
+            for (auto it = batch.rbegin(); it != batch.rend(); ++it) {
+                queue.push_front(std::move(*it));
+            }
+            if (failures++ == 0) {
+                std::cerr << "Warning: Failed to summarize evicted turns: " << error << ". Retrying in the background."
+                          << std::endl;
+            }
+            const auto backoff = std::chrono::seconds(1LL << std::min(failures - 1, MAX_BACKOFF_SHIFT));
+            wake.wait_for(lock, backoff, [&] { return stopping || started != generation; });
+            continue;
+        }
+        failures = 0;
+        summary.text = std::move(text);
+        summary.token_count = text_tokens;
+        summary.turns = base.turns + batch.size();
+        summary.source_tokens = base.source_tokens + tokens;
+        changed = true;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "cancel_token.hpp"
+#include "interaction.hpp"
+
+// Folds turns evicted from the recent window into a rolling summary, on a
+// background thread. Evicted turns queue up; the worker sends the current
+// summary and a batch of them to the model and asks for an updated summary
+// of at most `max_tokens`. The foreground never waits for it: take()
+// returns a finished summary, if any, between turns. Failed requests are
+// retried with backoff and the batch stays queued. Turns still queued on
+// destruction are not summarized.
+class MemorySummarizer {
+public:
+    // Run one non-streamed generate request for `prompt` and return the
+    // response text; throws on failure. Called on the worker thread, and
+    // must give up once `cancel` fires.
+    using Generate = std::function<std::string(const std::string& prompt, const CancelToken& cancel)>;
+    using CountTokens = std::function<int(const std::string& text)>;
+
+    // `batch_tokens` bounds the turns sent with one request
+    MemorySummarizer(Generate generate, CountTokens count_tokens, size_t max_tokens, size_t batch_tokens);
+    ~MemorySummarizer();
+    MemorySummarizer(const MemorySummarizer&) = delete;
+    MemorySummarizer& operator=(const MemorySummarizer&) = delete;
+
+    // Start over from `summary`, dropping queued turns and discarding the
+    // result of a request in flight
+    void reset(MemorySummary summary = {});
+
+    // Queue an evicted turn, oldest first
+    void add(Interaction interaction);
+
+    // Copy the summary into `out` if it changed since the last call
+    bool take(MemorySummary& out);
+
+    // Turns queued or being summarized
+    size_t pending() const;
+
+    // The request sent to fold `turns` into `summary`
+    static std::string prompt(const MemorySummary& summary, const std::deque<Interaction>& turns, size_t max_tokens);
+
+private:
+    void run();
+
+    Generate generate;
+    CountTokens count_tokens;
+    size_t max_tokens;
+    size_t batch_tokens;
+
+    mutable std::mutex mutex; // Guards everything below but `cancel`
+    std::condition_variable wake;
+    std::deque<Interaction> queue;
+    size_t in_flight = 0; // Turns of the request in flight
+    MemorySummary summary;
+    bool changed = false; // `summary` not yet taken
+    size_t generation = 0; // Bumped by reset(), so stale results are dropped
+    bool stopping = false;
+    CancelToken cancel; // Aborts the request in flight on destruction
+    std::thread worker; // Last, so it starts after the members it uses
+};
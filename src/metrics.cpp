@@ -0,0 +1,341 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <nlohmann/json.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+const char* SERVER_STAGE_NAMES[] = {"total", "load", "prompt_eval", "eval"};
+
+void write_histogram(std::ostream& out, const char* metric, const char* label, const char* value, const Histogram& h) {
+    size_t cumulative = 0;
+    for (size_t i = 0; i < Histogram::BOUNDS_MS.size(); ++i) {
+        cumulative += h.buckets()[i];
+        out << metric << "_bucket{" << label << "=\"" << value << "\",le=\"" << Histogram::BOUNDS_MS[i] / 1000.0
+            << "\"} " << cumulative << "\n";
+    }
+    out << metric << "_bucket{" << label << "=\"" << value << "\",le=\"+Inf\"} " << h.count() << "\n"
+        << metric << "_sum{" << label << "=\"" << value << "\"} " << h.sum() / 1000.0 << "\n"
+        << metric << "_count{" << label << "=\"" << value << "\"} " << h.count() << "\n";
+}
+
+} // namespace
+
+const char* phase_name(Phase phase) {
+    static const char* NAMES[] = {"retrieval", "context", "serialize", "connect", "first_byte",
+                                  "transfer", "parse", "tool", "persist", "total"};
+    return NAMES[static_cast<size_t>(phase)];
+}
+
+void to_json(json& out, const CompletionStats& stats) {
+    out = {
+        {"failed", stats.failed},
+        {"cancelled", stats.cancelled},
+        {"timed_out", stats.timed_out},
+        {"streamed", stats.streamed},
+        {"tool_called", stats.tool_called},
+        {"agent_steps", stats.agent_steps},
+        {"cache_hits", stats.cache_hits},
+        {"cache_misses", stats.cache_misses},
+        {"hedges", stats.hedges},
+        {"hedge_wins", stats.hedge_wins},
+        {"retrieved_turns", stats.retrieved_turns},
+        {"summary_turns", stats.summary_turns},
+        {"summary_tokens", stats.summary_tokens},
+        {"summary_source_tokens", stats.summary_source_tokens},
+        {"prompt_tokens_reused", stats.prompt_tokens_reused},
+        {"prompt_eval_count", stats.prompt_eval_count},
+        {"eval_count", stats.eval_count},
+        {"time_to_first_token", stats.time_to_first_token},
+        {"tokens_per_sec", stats.tokens_per_sec},
+        {"server_ms", {{"total", stats.server_total_ms}, {"load", stats.load_ms},
+                       {"prompt_eval", stats.prompt_eval_ms}, {"eval", stats.eval_ms}}}
+    };
+    json& phase_ms = out["phase_ms"];
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        phase_ms[phase_name(static_cast<Phase>(i))] = stats.phase_ms[i];
+    }
+    if (!stats.backend.empty()) out["backend"] = stats.backend;
+    json& tool_runs = out["tools"] = json::array();
+    for (const auto& run : stats.tool_runs) {
+        tool_runs.push_back({{"name", run.name}, {"ms", run.ms}, {"bytes", run.bytes},
+                             {"timed_out", run.timed_out}, {"failed", run.failed}});
+    }
+}
+
+void from_json(const json& in, CompletionStats& stats) {
+    stats = CompletionStats{};
+    stats.failed = in.value("failed", false);
+    stats.cancelled = in.value("cancelled", false);
+    stats.timed_out = in.value("timed_out", false);
+    stats.streamed = in.value("streamed", false);
+    stats.tool_called = in.value("tool_called", false);
+    stats.agent_steps = in.value("agent_steps", size_t{0});
+    stats.cache_hits = in.value("cache_hits", size_t{0});
+    stats.cache_misses = in.value("cache_misses", size_t{0});
+    stats.hedges = in.value("hedges", size_t{0});
+    stats.hedge_wins = in.value("hedge_wins", size_t{0});
+    stats.backend = in.value("backend", std::string());
+    stats.retrieved_turns = in.value("retrieved_turns", size_t{0});
+    stats.summary_turns = in.value("summary_turns", size_t{0});
+    stats.summary_tokens = in.value("summary_tokens", 0);
+    stats.summary_source_tokens = in.value("summary_source_tokens", 0LL);
+    stats.prompt_tokens_reused = in.value("prompt_tokens_reused", size_t{0});
+    stats.prompt_eval_count = in.value("prompt_eval_count", 0LL);
+    stats.eval_count = in.value("eval_count", 0LL);
+    stats.time_to_first_token = in.value("time_to_first_token", 0.0);
+    stats.tokens_per_sec = in.value("tokens_per_sec", 0.0);
+    if (in.contains("server_ms")) {
+        const json& server = in["server_ms"];
+        stats.server_total_ms = server.value("total", 0.0);
+        stats.load_ms = server.value("load", 0.0);
+        stats.prompt_eval_ms = server.value("prompt_eval", 0.0);
+        stats.eval_ms = server.value("eval", 0.0);
+    }
+    if (in.contains("phase_ms")) {
+        for (size_t i = 0; i < PHASE_COUNT; ++i) {
+            stats.phase_ms[i] = in["phase_ms"].value(phase_name(static_cast<Phase>(i)), 0.0);
+        }
+    }
+    if (in.contains("tools")) {
+        for (const auto& run : in["tools"]) {
+            stats.tool_runs.push_back({run.value("name", ""), run.value("ms", 0.0), run.value("bytes", size_t{0}),
+                                       run.value("timed_out", false), run.value("failed", false)});
+        }
+    }
+}
+
+size_t process_rss_bytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS) {
+        return info.resident_size;
+    }
+    return 0;
+#else
+    // Second field of statm: resident pages
+    std::FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (!statm) return 0;
+    unsigned long size = 0, resident = 0;
+    int fields = std::fscanf(statm, "%lu %lu", &size, &resident);
+    std::fclose(statm);
+    return fields == 2 ? resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+#endif
+}
+
+size_t peak_rss_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss); // Bytes on macOS
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // Kilobytes on Linux
+#endif
+#endif
+}
+
+const std::array<double, 18> Histogram::BOUNDS_MS = {0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100,
+                                                     250, 500, 1000, 2500, 5000, 10000, 30000, 60000};
+
+void Histogram::record(double ms) {
+    size_t bucket = std::lower_bound(BOUNDS_MS.begin(), BOUNDS_MS.end(), ms) - BOUNDS_MS.begin();
+    ++bucket_counts[bucket];
+    ++total_count;
+    total_sum += ms;
+    if (window.size() < WINDOW) {
+        window.push_back(static_cast<float>(ms));
+    } else {
+        window[next] = static_cast<float>(ms);
+        next = (next + 1) % WINDOW;
+    }
+}
+
+double Histogram::percentile(double p) const {
+    if (window.empty()) return 0.0;
+    std::vector<float> sorted = window;
+    size_t index = std::min(static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5), sorted.size() - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+void Metrics::open_sink(const std::string& path) {
+    sink_path = path;
+    sink_prometheus = path.size() >= 5 && path.compare(path.size() - 5, 5, ".prom") == 0;
+    if (!sink_prometheus) {
+        sink_jsonl.open(path, std::ios::app);
+        if (!sink_jsonl.is_open()) {
+            std::cerr << "Warning: Cannot open metrics file " << path << ". Metrics file disabled." << std::endl;
+            sink_path.clear();
+        }
+    }
+}
+
+void Metrics::record(const CompletionStats& stats) {
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        if (stats.phase_ms[i] > 0) phases[i].record(stats.phase_ms[i]);
+    }
+    const double server_ms[] = {stats.server_total_ms, stats.load_ms, stats.prompt_eval_ms, stats.eval_ms};
+    for (size_t i = 0; i < SERVER_STAGES; ++i) {
+        if (server_ms[i] > 0) server[i].record(server_ms[i]);
+    }
+    for (const auto& run : stats.tool_runs) {
+        ToolTotals& totals = tools[run.name];
+        totals.latency.record(run.ms);
+        totals.bytes += run.bytes;
+        totals.timeouts += run.timed_out;
+        totals.failures += run.failed;
+    }
+    ++turns;
+    failed_turns += stats.failed;
+    cancelled_turns += stats.cancelled;
+    timed_out_turns += stats.timed_out;
+    tool_calls += stats.tool_runs.size();
+    cache_hits += stats.cache_hits;
+    cache_misses += stats.cache_misses;
+    hedges += stats.hedges;
+    hedge_wins += stats.hedge_wins;
+    prompt_tokens += stats.prompt_eval_count;
+    generated_tokens += stats.eval_count;
+    if (!sink_path.empty()) write_sink(stats);
+}
+
+void Metrics::write_sink(const CompletionStats& stats) {
+    try {
+        if (!sink_prometheus) {
+            json line = stats;
+            line["time"] = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+            line["rss_bytes"] = process_rss_bytes();
+            sink_jsonl << line.dump() << '\n' << std::flush;
+            if (!sink_jsonl) throw std::runtime_error("write failed");
+            return;
+        }
+        // Write-then-rename so a scraper never reads a half-written file
+        const std::string temp = sink_path + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::trunc);
+            if (!out.is_open()) throw std::runtime_error("cannot open " + temp);
+            out << prometheus();
+            if (!out) throw std::runtime_error("write failed");
+        }
+        if (std::rename(temp.c_str(), sink_path.c_str()) != 0) {
+            std::remove(sink_path.c_str()); // Windows does not replace on rename
+            if (std::rename(temp.c_str(), sink_path.c_str()) != 0) throw std::runtime_error("cannot replace " + sink_path);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to write metrics: " << e.what() << ". Metrics file disabled." << std::endl;
+        sink_path.clear();
+    }
+}
+
+std::string Metrics::summary() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << "turns: " << turns << " (" << failed_turns << " failed";
+    if (cancelled_turns > 0) out << ", " << cancelled_turns << " cancelled";
+    if (timed_out_turns > 0) out << ", " << timed_out_turns << " timed out";
+    out << ", " << tool_calls << " tool calls), prompt tokens: " << prompt_tokens << ", generated tokens: " << generated_tokens << "\n";
+    if (cache_hits + cache_misses > 0) {
+        out << "response cache: " << cache_hits << " hits, " << cache_misses << " misses ("
+            << 100.0 * cache_hits / (cache_hits + cache_misses) << "% hit rate)\n";
+    }
+    if (hedges > 0) {
+        out << "hedged requests: " << hedges << ", answered first by the hedge: " << hedge_wins << "\n";
+    }
+    if (turns > 0) {
+        out << std::left << std::setw(20) << "phase" << std::right << std::setw(8) << "count" << std::setw(12)
+            << "p50 ms" << std::setw(12) << "p99 ms" << std::setw(12) << "mean ms" << "\n";
+        auto row = [&](const std::string& name, const Histogram& h) {
+            if (h.count() == 0) return;
+            out << std::left << std::setw(20) << name << std::right << std::setw(8) << h.count() << std::setw(12)
+                << h.percentile(50) << std::setw(12) << h.percentile(99) << std::setw(12) << h.mean() << "\n";
+        };
+        for (size_t i = 0; i < PHASE_COUNT; ++i) row(phase_name(static_cast<Phase>(i)), phases[i]);
+        for (size_t i = 0; i < SERVER_STAGES; ++i) row(std::string("server ") + SERVER_STAGE_NAMES[i], server[i]);
+        for (const auto& [name, totals] : tools) row("tool " + name, totals.latency);
+        for (const auto& [name, totals] : tools) {
+            out << "tool " << name << ": " << totals.bytes << " bytes of output, " << totals.timeouts
+                << " timed out, " << totals.failures << " failed\n";
+        }
+    }
+    const size_t rss = process_rss_bytes();
+    out << std::setprecision(1) << "RSS: " << rss / 1048576.0 << " MB (peak "
+        << std::max(rss, peak_rss_bytes()) / 1048576.0 << " MB)\n";
+    return out.str();
+}
+
+std::string Metrics::prometheus() const {
+    std::ostringstream out;
+    out << "# HELP memoraxx_phase_seconds Client-side time per turn phase.\n"
+        << "# TYPE memoraxx_phase_seconds histogram\n";
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        write_histogram(out, "memoraxx_phase_seconds", "phase", phase_name(static_cast<Phase>(i)), phases[i]);
+    }
+    out << "# HELP memoraxx_server_seconds Server-side time per turn reported by Ollama.\n"
+        << "# TYPE memoraxx_server_seconds histogram\n";
+    for (size_t i = 0; i < SERVER_STAGES; ++i) {
+        write_histogram(out, "memoraxx_server_seconds", "stage", SERVER_STAGE_NAMES[i], server[i]);
+    }
+    if (!tools.empty()) {
+        out << "# HELP memoraxx_tool_seconds Run time per tool call.\n"
+            << "# TYPE memoraxx_tool_seconds histogram\n";
+        for (const auto& [name, totals] : tools) {
+            write_histogram(out, "memoraxx_tool_seconds", "tool", name.c_str(), totals.latency);
+        }
+        out << "# TYPE memoraxx_tool_output_bytes_total counter\n";
+        for (const auto& [name, totals] : tools) {
+            out << "memoraxx_tool_output_bytes_total{tool=\"" << name << "\"} " << totals.bytes << "\n";
+        }
+        out << "# TYPE memoraxx_tool_timeouts_total counter\n";
+        for (const auto& [name, totals] : tools) {
+            out << "memoraxx_tool_timeouts_total{tool=\"" << name << "\"} " << totals.timeouts << "\n";
+        }
+    }
+    out << "# TYPE memoraxx_turns_total counter\nmemoraxx_turns_total " << turns << "\n"
+        << "# TYPE memoraxx_failed_turns_total counter\nmemoraxx_failed_turns_total " << failed_turns << "\n"
+        << "# TYPE memoraxx_cancelled_turns_total counter\nmemoraxx_cancelled_turns_total " << cancelled_turns << "\n"
+        << "# TYPE memoraxx_timed_out_turns_total counter\nmemoraxx_timed_out_turns_total " << timed_out_turns << "\n"
+        << "# TYPE memoraxx_tool_calls_total counter\nmemoraxx_tool_calls_total " << tool_calls << "\n"
+        << "# TYPE memoraxx_response_cache_hits_total counter\nmemoraxx_response_cache_hits_total " << cache_hits << "\n"
+        << "# TYPE memoraxx_response_cache_misses_total counter\nmemoraxx_response_cache_misses_total " << cache_misses << "\n"
+        << "# TYPE memoraxx_hedged_requests_total counter\nmemoraxx_hedged_requests_total " << hedges << "\n"
+        << "# TYPE memoraxx_hedge_wins_total counter\nmemoraxx_hedge_wins_total " << hedge_wins << "\n"
+        << "# TYPE memoraxx_prompt_tokens_total counter\nmemoraxx_prompt_tokens_total " << prompt_tokens << "\n"
+        << "# TYPE memoraxx_generated_tokens_total counter\nmemoraxx_generated_tokens_total " << generated_tokens << "\n"
+        << "# TYPE memoraxx_resident_memory_bytes gauge\nmemoraxx_resident_memory_bytes " << process_rss_bytes() << "\n"
+        << "# TYPE memoraxx_peak_resident_memory_bytes gauge\nmemoraxx_peak_resident_memory_bytes " << peak_rss_bytes() << "\n";
+    return out.str();
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <fstream>
+#include <map>
+#include <nlohmann/json_fwd.hpp>
+#include <string>
+#include <vector>
+
+// Client-side phases of one turn, in request order
+enum class Phase : size_t {
+    Retrieval, // Prompt embedding plus index search
+    Context, // Rendering the prompt and updating the rendered history
+    Serialize, // Assembling the request body
+    Connect, // DNS, TCP and TLS, or picking up a kept-alive connection
+    FirstByte, // Request sent until the first response byte (model load and prompt eval)
+    Transfer, // First byte until the response is complete (generation when streaming)
+    Parse, // Decoding the response JSON
+    Tool, // Running a requested tool
+    Persist, // Journal, vector index and eviction records
+    Total, // Whole turn, including retries
+    Count
+};
+
+constexpr size_t PHASE_COUNT = static_cast<size_t>(Phase::Count);
+
+const char* phase_name(Phase phase);
+
+// One tool run of a turn
+struct ToolRun {
+    std::string name;
+    double ms = 0.0;
+    size_t bytes = 0; // Output produced, including any past the cap
+    bool timed_out = false;
+    bool failed = false;
+};
+
+// Timing details of the most recent completion
+struct CompletionStats {
+    bool streamed = false;
+    double time_to_first_token = 0.0; // Seconds, streaming only
+    double tokens_per_sec = 0.0;
+    long long eval_count = 0;
+    long long prompt_eval_count = 0; // Prompt tokens the server evaluated
+    size_t prompt_tokens_reused = 0; // Prompt tokens covered by the reused `context`
+    size_t retrieved_turns = 0; // Older turns recalled into the prompt
+    size_t summary_turns = 0; // Evicted turns covered by the summary in the prompt
+    int summary_tokens = 0; // Tokens of that summary
+    long long summary_source_tokens = 0; // Tokens those turns would take in full
+    bool tool_called = false; // Result is tool output, not the streamed text
+    size_t agent_steps = 0; // Model responses of the turn, cached or not
+    size_t cache_hits = 0; // Responses answered by the response cache
+    size_t cache_misses = 0; // Cache lookups that went to the model
+    size_t hedges = 0; // Requests duplicated on a second backend
+    size_t hedge_wins = 0; // Hedged requests answered first by the duplicate
+    std::string backend; // Server that answered the last request, when routing over several
+    std::vector<ToolRun> tool_runs; // Every tool run of the turn, across steps
+    bool failed = false; // Result is an error message
+    bool cancelled = false; // Failed because its cancel token fired
+    bool timed_out = false; // Failed because its deadline passed
+    std::array<double, PHASE_COUNT> phase_ms{}; // Client time per phase; 0 if skipped
+
+    // Server-side timings reported by Ollama, in milliseconds
+    double server_total_ms = 0.0;
+    double load_ms = 0.0; // Loading the model
+    double prompt_eval_ms = 0.0;
+    double eval_ms = 0.0; // Generation
+
+    double phase(Phase p) const { return phase_ms[static_cast<size_t>(p)]; }
+};
+
+// JSON form of the stats, as written to the metrics file and returned by
+// the daemon; from_json() reads it back
+void to_json(nlohmann::json& out, const CompletionStats& stats);
+void from_json(const nlohmann::json& in, CompletionStats& stats);
+
+// Resident set size of this process in bytes, or 0 where unsupported
+size_t process_rss_bytes();
+
+// Highest resident set size of this process so far, or 0 where unsupported
+size_t peak_rss_bytes();
+
+// Latency distribution in milliseconds. Cumulative bucket counts back the
+// Prometheus export; percentiles come from a window of the latest samples,
+// so they follow the current behaviour rather than the whole session.
+class Histogram {
+public:
+    static const std::array<double, 18> BOUNDS_MS; // Bucket upper bounds
+
+    void record(double ms);
+
+    size_t count() const { return total_count; }
+    double sum() const { return total_sum; }
+    double mean() const { return total_count ? total_sum / total_count : 0.0; }
+    const std::array<size_t, 19>& buckets() const { return bucket_counts; } // Last bucket is +Inf
+
+    // The `p`th percentile (0-100) of the recent window
+    double percentile(double p) const;
+
+private:
+    static constexpr size_t WINDOW = 1024;
+
+    std::array<size_t, 19> bucket_counts{};
+    size_t total_count = 0;
+    double total_sum = 0.0;
+    std::vector<float> window; // Ring buffer of the latest samples
+    size_t next = 0;
+};
+
+// Aggregates the stats of every turn. Callers record each turn's stats
+// after it finishes; nothing is collected unless a Metrics is in use.
+// Not thread-safe.
+class Metrics {
+public:
+    // Also write every turn to `path`: Prometheus text format, rewritten
+    // atomically, when it ends in ".prom", otherwise one JSON line per turn
+    void open_sink(const std::string& path);
+
+    void record(const CompletionStats& stats);
+
+    // Table of percentiles, counters and memory use for the `stats` command
+    std::string summary() const;
+
+    // Prometheus text exposition of all histograms and counters
+    std::string prometheus() const;
+
+private:
+    enum ServerStage { ServerTotal, ServerLoad, ServerPromptEval, ServerEval, SERVER_STAGES };
+
+    struct ToolTotals {
+        Histogram latency;
+        size_t bytes = 0;
+        size_t timeouts = 0;
+        size_t failures = 0;
+    };
+
+    void write_sink(const CompletionStats& stats);
+
+    std::array<Histogram, PHASE_COUNT> phases;
+    std::array<Histogram, SERVER_STAGES> server;
+    std::map<std::string, ToolTotals> tools; // By tool name
+    size_t turns = 0;
+    size_t failed_turns = 0;
+    size_t cancelled_turns = 0;
+    size_t timed_out_turns = 0;
+    size_t tool_calls = 0;
+    size_t cache_hits = 0;
+    size_t cache_misses = 0;
+    size_t hedges = 0;
+    size_t hedge_wins = 0;
+    long long prompt_tokens = 0;
+    long long generated_tokens = 0;
+    std::string sink_path;
+    bool sink_prometheus = false;
+    std::ofstream sink_jsonl;
+};
@@ -0,0 +1,141 @@
+#include "multi_client.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+MultiClient::MultiClient(ConnectionPool& pool, size_t max_in_flight, const CancelToken* cancel)
+    : pool(pool), max_in_flight(std::max<size_t>(max_in_flight, 1)), cancel(cancel) {
+    multi = curl_multi_init();
+    if (!multi) {
+        throw std::runtime_error("Failed to initialize cURL multi handle");
+    }
+}
+
+MultiClient::~MultiClient() {
+    // Detach before the leases hand the easy handles back to the pool
+    for (auto& transfer : active) {
+        curl_multi_remove_handle(multi, transfer.lease->get());
+    }
+    active.clear();
+    curl_multi_cleanup(multi);
+}
+
+void MultiClient::post(std::string url, RequestBody body, Callback done, std::chrono::milliseconds delay,
+                       std::chrono::milliseconds timeout) {
+    Transfer transfer;
+    transfer.url = std::move(url);
+    transfer.body = std::move(body);
+    transfer.done = std::move(done);
+    transfer.ready = Clock::now() + delay;
+    transfer.timeout = timeout;
+    queued.push_back(std::move(transfer));
+}
+
+size_t MultiClient::write_body(void* contents, size_t size, size_t nmemb, Transfer* transfer) {
+    if (transfer->first_byte == Clock::time_point{}) transfer->first_byte = Clock::now();
+    transfer->response.body.append(static_cast<char*>(contents), size * nmemb);
+    return size * nmemb;
+}
+
+void MultiClient::start_ready() {
+    const auto now = Clock::now();
+    for (auto it = queued.begin(); it != queued.end() && active.size() < max_in_flight;) {
+        if (it->ready > now) {
+            ++it; // Delayed retry; later requests may go first
+            continue;
+        }
+        active.splice(active.end(), queued, it++);
+
+        Transfer& transfer = active.back();
+        transfer.response.queue_ms = std::chrono::duration<double, std::milli>(now - transfer.ready).count();
+        transfer.started = now;
+        transfer.lease.emplace(pool.acquire());
+        CURL* handle = transfer.lease->get();
+        curl_easy_setopt(handle, CURLOPT_URL, transfer.url.c_str());
+        transfer.body.attach(handle, transfer.cursor);
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_body);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &transfer);
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, &transfer);
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, static_cast<long>(transfer.timeout.count()));
+        CancelToken::watch(handle, cancel);
+        CURLMcode code = curl_multi_add_handle(multi, handle);
+        if (code != CURLM_OK) {
+            active.pop_back();
+            throw std::runtime_error(std::string("cURL multi error: ") + curl_multi_strerror(code));
+        }
+    }
+    peak = std::max(peak, active.size());
+}
+
+void MultiClient::complete(CURLMsg* message) {
+    Transfer* transfer = nullptr;
+    curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, reinterpret_cast<char**>(&transfer));
+    Response& response = transfer->response;
+    response.result = message->data.result;
+    curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE, &response.http_code);
+    curl_off_t connect_us = 0, total_us = 0;
+    curl_easy_getinfo(message->easy_handle, CURLINFO_PRETRANSFER_TIME_T, &connect_us);
+    curl_easy_getinfo(message->easy_handle, CURLINFO_TOTAL_TIME_T, &total_us);
+    response.connect_ms = connect_us / 1000.0;
+    response.transfer_ms = total_us / 1000.0;
+    response.first_byte_ms = transfer->first_byte == Clock::time_point{}
+        ? response.transfer_ms
+        : std::min(std::chrono::duration<double, std::milli>(transfer->first_byte - transfer->started).count(),
+                   response.transfer_ms);
+
+    curl_multi_remove_handle(multi, message->easy_handle);
+    if (response.result == CURLE_OK) {
+        pool.record_transfer(message->easy_handle);
+    }
+
+    // Release the slot before the callback, which may post the next request
+    Response finished = std::move(response);
+    Callback done = std::move(transfer->done);
+    active.remove_if([transfer](const Transfer& t) { return &t == transfer; });
+    done(finished);
+}
+
+void MultiClient::abort_queued() {
+    // Callbacks may post again; those are aborted on the next pass
+    std::list<Transfer> aborted;
+    aborted.swap(queued);
+    for (auto& transfer : aborted) {
+        transfer.response.result = CURLE_ABORTED_BY_CALLBACK;
+        transfer.done(transfer.response);
+    }
+}
+
+int MultiClient::poll_timeout_ms() const {
+    // Wake up in time to notice a cancelled token
+    const int idle_ms = cancel ? CancelToken::POLL_MS : 1000;
+    if (queued.empty() || active.size() >= max_in_flight) return idle_ms;
+    auto earliest = std::min_element(queued.begin(), queued.end(), [](const Transfer& a, const Transfer& b) {
+        return a.ready < b.ready;
+    })->ready;
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(earliest - Clock::now()).count();
+    return static_cast<int>(std::clamp<long long>(wait, 0, idle_ms));
+}
+
+void MultiClient::run() {
+    while (!queued.empty() || !active.empty()) {
+        if (cancel && cancel->cancelled()) abort_queued();
+        start_ready();
+
+        int running = 0;
+        CURLMcode code = curl_multi_perform(multi, &running);
+        if (code != CURLM_OK) {
+            throw std::runtime_error(std::string("cURL multi error: ") + curl_multi_strerror(code));
+        }
+        int remaining = 0;
+        while (CURLMsg* message = curl_multi_info_read(multi, &remaining)) {
+            if (message->msg == CURLMSG_DONE) complete(message);
+        }
+
+        if (active.empty() && queued.empty()) break;
+        // Zero means a queued request can start right away
+        int timeout = poll_timeout_ms();
+        if (timeout > 0) {
+            curl_multi_poll(multi, nullptr, 0, timeout, nullptr);
+        }
+    }
+}
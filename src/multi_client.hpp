@@ -0,0 +1,89 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <optional>
+#include <string>
+
+#include "cancel_token.hpp"
+#include "connection_pool.hpp"
+#include "request_body.hpp"
+
+// Concurrent HTTP POSTs driven by one curl_multi handle on the calling
+// thread. Requests queue until one of `max_in_flight` slots is free; easy
+// handles are leased from a ConnectionPool, so finished connections are
+// kept alive for the next request. Once the optional cancel token fires,
+// transfers in flight are aborted and queued ones complete without being
+// sent, all with CURLE_ABORTED_BY_CALLBACK. Not thread-safe.
+class MultiClient {
+public:
+    struct Response {
+        CURLcode result = CURLE_OK;
+        long http_code = 0;
+        std::string body;
+        double queue_ms = 0.0; // Waiting for a free slot, after any delay
+        double connect_ms = 0.0; // Transfer start until the request could be sent
+        double first_byte_ms = 0.0; // Transfer start to first response byte; the whole transfer without a body
+        double transfer_ms = 0.0; // Transfer start to completion
+    };
+    using Callback = std::function<void(Response&)>;
+
+    MultiClient(ConnectionPool& pool, size_t max_in_flight, const CancelToken* cancel = nullptr);
+    ~MultiClient();
+    MultiClient(const MultiClient&) = delete;
+    MultiClient& operator=(const MultiClient&) = delete;
+
+    // Queue a JSON POST to `url`; borrowed parts of `body` must stay
+    // unchanged until `done` runs. It starts no earlier than `delay` from now
+    // and fails with CURLE_OPERATION_TIMEDOUT once it has run for `timeout`
+    // (0 = no limit); `done` runs on the thread calling run().
+    void post(std::string url, RequestBody body, Callback done,
+              std::chrono::milliseconds delay = std::chrono::milliseconds(0),
+              std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    // Drive transfers until nothing is queued or in flight. Callbacks may
+    // post further requests.
+    void run();
+
+    size_t peak_in_flight() const { return peak; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Transfer {
+        std::string url;
+        RequestBody body;
+        RequestBody::Cursor cursor;
+        Callback done;
+        Clock::time_point ready; // Earliest start
+        Clock::time_point started;
+        // First byte of the response body. Stamped here: with an upload,
+        // CURLINFO_STARTTRANSFER_TIME marks the start of the upload instead
+        Clock::time_point first_byte;
+        std::chrono::milliseconds timeout{0};
+        std::optional<ConnectionPool::Lease> lease;
+        Response response;
+    };
+
+    // CURLOPT_WRITEFUNCTION: append to the transfer's response body
+    static size_t write_body(void* contents, size_t size, size_t nmemb, Transfer* transfer);
+
+    void start_ready();
+    void complete(CURLMsg* message);
+    // Complete every queued transfer as aborted
+    void abort_queued();
+    int poll_timeout_ms() const;
+
+    ConnectionPool& pool;
+    CURLM* multi;
+    size_t max_in_flight;
+    const CancelToken* cancel;
+    size_t peak = 0;
+    // Lists, so a transfer is spliced from `queued` to `active` without moving
+    // and keeps a stable address for CURLOPT_PRIVATE
+    std::list<Transfer> queued; // Not yet started, in post order
+    std::list<Transfer> active;
+};
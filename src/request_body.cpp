@@ -0,0 +1,98 @@
+#include "request_body.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "context_renderer.hpp"
+
+RequestBody::RequestBody(std::string text) : scratch(std::move(text)) {
+    if (!scratch.empty()) pieces.push_back({nullptr, 0, scratch.size()});
+    total = scratch.size();
+}
+
+void RequestBody::clear() {
+    scratch.clear();
+    pieces.clear();
+    total = 0;
+}
+
+void RequestBody::add_owned(size_t offset) {
+    const size_t size = scratch.size() - offset;
+    if (size == 0) return;
+    total += size;
+    if (!pieces.empty() && !pieces.back().data && pieces.back().offset + pieces.back().size == offset) {
+        pieces.back().size += size;
+    } else {
+        pieces.push_back({nullptr, offset, size});
+    }
+}
+
+void RequestBody::append(std::string_view text) {
+    const size_t offset = scratch.size();
+    scratch.append(text);
+    add_owned(offset);
+}
+
+void RequestBody::append_escaped(std::string_view text) {
+    const size_t offset = scratch.size();
+    ContextRenderer::append_escaped(scratch, text);
+    add_owned(offset);
+}
+
+void RequestBody::borrow(std::string_view text) {
+    if (text.empty()) return;
+    pieces.push_back({text.data(), 0, text.size()});
+    total += text.size();
+}
+
+std::string RequestBody::str() const {
+    std::string out;
+    out.reserve(total);
+    for_each([&](std::string_view piece) { out.append(piece); });
+    return out;
+}
+
+void RequestBody::attach(CURL* handle, Cursor& cursor) const {
+    cursor = Cursor{this, 0, 0};
+    curl_easy_setopt(handle, CURLOPT_POST, 1L);
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(total));
+    curl_easy_setopt(handle, CURLOPT_READFUNCTION, read);
+    curl_easy_setopt(handle, CURLOPT_READDATA, &cursor);
+    curl_easy_setopt(handle, CURLOPT_SEEKFUNCTION, seek);
+    curl_easy_setopt(handle, CURLOPT_SEEKDATA, &cursor);
+}
+
+size_t RequestBody::read(char* buffer, size_t size, size_t count, void* cursor) {
+    auto& at = *static_cast<Cursor*>(cursor);
+    const auto& pieces = at.body->pieces;
+    const size_t capacity = size * count;
+    size_t written = 0;
+    while (written < capacity && at.piece < pieces.size()) {
+        const std::string_view piece = at.body->view(pieces[at.piece]);
+        const size_t take = std::min(piece.size() - at.offset, capacity - written);
+        std::memcpy(buffer + written, piece.data() + at.offset, take);
+        written += take;
+        at.offset += take;
+        if (at.offset == piece.size()) {
+            ++at.piece;
+            at.offset = 0;
+        }
+    }
+    return written;
+}
+
+int RequestBody::seek(void* cursor, curl_off_t offset, int origin) {
+    auto& at = *static_cast<Cursor*>(cursor);
+    if (origin != SEEK_SET || offset < 0 || static_cast<size_t>(offset) > at.body->total) {
+        return CURL_SEEKFUNC_CANTSEEK;
+    }
+    size_t left = static_cast<size_t>(offset);
+    at.piece = 0;
+    while (at.piece < at.body->pieces.size() && left >= at.body->pieces[at.piece].size) {
+        left -= at.body->pieces[at.piece].size;
+        ++at.piece;
+    }
+    at.offset = left;
+    return CURL_SEEKFUNC_OK;
+}
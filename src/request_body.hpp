@@ -0,0 +1,73 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Request body kept as a sequence of byte ranges and streamed to cURL in
+// order through CURLOPT_READFUNCTION, so the long, already escaped context
+// is never joined into one buffer. Small pieces (the JSON framing and the
+// new prompt) are copied into a scratch buffer that clear() keeps for the
+// next body; large ones are borrowed and must stay unchanged while the
+// body is in use. Copies and moves borrow the same ranges.
+class RequestBody {
+public:
+    RequestBody() = default;
+    // A body of one owned piece, e.g. a serialized JSON document
+    explicit RequestBody(std::string text);
+
+    // Drop every piece, keeping the scratch capacity
+    void clear();
+
+    void append(std::string_view text);
+    // Append `text` with JSON string escaping
+    void append_escaped(std::string_view text);
+    // Reference `text` in place; it must outlive the body's use
+    void borrow(std::string_view text);
+
+    size_t size() const { return total; }
+    bool empty() const { return total == 0; }
+
+    // The pieces joined, for callers that need one buffer
+    std::string str() const;
+
+    // Call `fn(std::string_view)` on each piece in order
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        for (const auto& piece : pieces) fn(view(piece));
+    }
+
+    // Read position of one transfer
+    struct Cursor {
+        const RequestBody* body = nullptr;
+        size_t piece = 0;
+        size_t offset = 0; // Within the piece
+    };
+
+    // Make `handle` POST this body, read through `cursor`, which must
+    // outlive the transfer. cURL can rewind it to resend the body on a
+    // stale keep-alive connection.
+    void attach(CURL* handle, Cursor& cursor) const;
+
+private:
+    struct Piece {
+        const char* data; // Borrowed bytes, or null for `scratch` bytes at `offset`
+        size_t offset;
+        size_t size;
+    };
+
+    std::string_view view(const Piece& piece) const {
+        return {piece.data ? piece.data : scratch.data() + piece.offset, piece.size};
+    }
+    // Extend the last piece if it ends the scratch, else start one
+    void add_owned(size_t offset);
+
+    static size_t read(char* buffer, size_t size, size_t count, void* cursor);
+    static int seek(void* cursor, curl_off_t offset, int origin);
+
+    std::string scratch;
+    std::vector<Piece> pieces;
+    size_t total = 0;
+};
@@ -0,0 +1,287 @@
+#include "response_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Fixed part of a segment record; response bytes and context tokens follow
+struct RecordHeader {
+    uint32_t payload_size; // Bytes after this field
+    uint32_t context_size;
+    uint64_t hash;
+    uint64_t body_size;
+    uint64_t response_size;
+};
+
+const size_t ENTRY_OVERHEAD = 96; // List node, index slot and allocations
+const uint64_t MIN_REWRITE_BYTES = 1 << 20;
+
+// xxHash64, which hashes 32 bytes per round; request bodies carry the whole
+// rendered history, so this is most of the lookup time
+const uint64_t P1 = 11400714785074694791ULL;
+const uint64_t P2 = 14029467366897019727ULL;
+const uint64_t P3 = 1609587929392839161ULL;
+const uint64_t P4 = 9650029242287828579ULL;
+const uint64_t P5 = 2870177450012600261ULL;
+
+uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+uint64_t read64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t read32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    return rotl(acc, 31) * P1;
+}
+
+uint64_t merge64(uint64_t acc, uint64_t v) {
+    acc ^= round64(0, v);
+    return acc * P1 + P4;
+}
+
+// Fed in pieces, so a request body is hashed without joining it; gives
+// the same hash as hashing the joined bytes at once
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed) : seed(seed), v1(seed + P1 + P2), v2(seed + P2), v3(seed), v4(seed - P1) {}
+
+    void update(std::string_view data) {
+        const char* p = data.data();
+        const char* end = p + data.size();
+        total += data.size();
+        if (buffered > 0) {
+            const size_t take = std::min<size_t>(32 - buffered, data.size());
+            std::memcpy(buffer + buffered, p, take);
+            buffered += take;
+            p += take;
+            if (buffered < 32) return;
+            consume(buffer);
+            buffered = 0;
+        }
+        for (; p + 32 <= end; p += 32) consume(p);
+        std::memcpy(buffer, p, end - p);
+        buffered = end - p;
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (total >= 32) {
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge64(merge64(merge64(merge64(h, v1), v2), v3), v4);
+        } else {
+            h = seed + P5;
+        }
+        h += total;
+        const char* p = buffer;
+        const char* end = buffer + buffered;
+        for (; p + 8 <= end; p += 8) h = rotl(h ^ round64(0, read64(p)), 27) * P1 + P4;
+        if (p + 4 <= end) {
+            h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+            p += 4;
+        }
+        for (; p < end; ++p) h = rotl(h ^ (static_cast<unsigned char>(*p) * P5), 11) * P1;
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        return h ^ (h >> 32);
+    }
+
+private:
+    void consume(const char* p) {
+        v1 = round64(v1, read64(p));
+        v2 = round64(v2, read64(p + 8));
+        v3 = round64(v3, read64(p + 16));
+        v4 = round64(v4, read64(p + 24));
+    }
+
+    uint64_t seed, v1, v2, v3, v4;
+    uint64_t total = 0;
+    char buffer[32];
+    size_t buffered = 0;
+};
+
+uint64_t xxh64(std::string_view data, uint64_t seed) {
+    Xxh64 hash(seed);
+    hash.update(data);
+    return hash.digest();
+}
+
+} // namespace
+
+ResponseCache::ResponseCache(std::string path, size_t max_bytes) : path(std::move(path)), max_bytes(max_bytes) {}
+
+ResponseCache::~ResponseCache() {
+    if (out) std::fclose(out);
+}
+
+ResponseCache::Key ResponseCache::key(std::string_view endpoint, std::string_view body) {
+    return {xxh64(body, xxh64(endpoint, 0)), body.size()};
+}
+
+ResponseCache::Key ResponseCache::key(std::string_view endpoint, const RequestBody& body) {
+    Xxh64 hash(xxh64(endpoint, 0));
+    body.for_each([&](std::string_view piece) { hash.update(piece); });
+    return {hash.digest(), body.size()};
+}
+
+size_t ResponseCache::cost(const Entry& entry) {
+    return entry.response.size() + entry.context.size() * sizeof(int) + ENTRY_OVERHEAD;
+}
+
+void ResponseCache::open() {
+    if (path.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ifstream in(path, std::ios::binary);
+    uint64_t offset = 0;
+    if (in.is_open()) {
+        in.seekg(0, std::ios::end);
+        const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+        in.seekg(0);
+
+        // Oldest first, so the newest records end up most recently used
+        RecordHeader header;
+        while (offset + sizeof(header) <= file_size) {
+            if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) break;
+            const uint64_t expected = sizeof(header) - sizeof(uint32_t) + header.response_size +
+                                      uint64_t(header.context_size) * sizeof(int);
+            if (header.payload_size != expected || offset + sizeof(uint32_t) + header.payload_size > file_size) break;
+            Entry entry;
+            entry.response.resize(header.response_size);
+            entry.context.resize(header.context_size);
+            if (!in.read(entry.response.data(), entry.response.size()) ||
+                !in.read(reinterpret_cast<char*>(entry.context.data()), entry.context.size() * sizeof(int))) {
+                break;
+            }
+            insert({header.hash, header.body_size}, std::move(entry));
+            offset += sizeof(uint32_t) + header.payload_size;
+        }
+        in.close();
+        if (offset < file_size) {
+            std::cerr << "Warning: Truncating corrupt response cache tail at byte " << offset << std::endl;
+            std::filesystem::resize_file(path, offset);
+        }
+    }
+    file_bytes = offset;
+    out = std::fopen(path.c_str(), "ab");
+    if (!out) {
+        throw std::runtime_error("cannot open response cache " + path);
+    }
+}
+
+bool ResponseCache::get(const Key& key, Entry& out_entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key.hash);
+    if (it == index.end() || it->second->key.size != key.size) {
+        ++miss_count;
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    out_entry = it->second->entry;
+    ++hit_count;
+    return true;
+}
+
+void ResponseCache::put(const Key& key, Entry entry) {
+    if (cost(entry) > max_bytes) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    insert(key, std::move(entry));
+    if (!out) return;
+    try {
+        append_record(lru.front());
+        if (file_bytes > std::max<uint64_t>(2 * uint64_t(max_bytes), MIN_REWRITE_BYTES)) rewrite();
+    } catch (const std::exception& e) {
+        // The entry still serves this run; only persistence is lost
+        std::cerr << "Failed to save response cache: " << e.what() << std::endl;
+        if (out) std::fclose(out);
+        out = nullptr;
+    }
+}
+
+void ResponseCache::insert(const Key& key, Entry entry) {
+    auto it = index.find(key.hash);
+    if (it != index.end()) {
+        used_bytes -= cost(it->second->entry);
+        lru.erase(it->second);
+        index.erase(it);
+    }
+    used_bytes += cost(entry);
+    lru.push_front({key, std::move(entry)});
+    index[key.hash] = lru.begin();
+    while (used_bytes > max_bytes && !lru.empty()) {
+        used_bytes -= cost(lru.back().entry);
+        index.erase(lru.back().key.hash);
+        lru.pop_back();
+    }
+}
+
+void ResponseCache::append_record(const Node& node) {
+    RecordHeader header;
+    header.context_size = static_cast<uint32_t>(node.entry.context.size());
+    header.hash = node.key.hash;
+    header.body_size = node.key.size;
+    header.response_size = node.entry.response.size();
+    header.payload_size = static_cast<uint32_t>(sizeof(header) - sizeof(uint32_t) + header.response_size +
+                                                node.entry.context.size() * sizeof(int));
+    std::fwrite(&header, sizeof(header), 1, out);
+    std::fwrite(node.entry.response.data(), 1, node.entry.response.size(), out);
+    std::fwrite(node.entry.context.data(), sizeof(int), node.entry.context.size(), out);
+    if (std::fflush(out) != 0 || std::ferror(out)) {
+        throw std::runtime_error("failed to append to " + path);
+    }
+    file_bytes += sizeof(uint32_t) + header.payload_size;
+}
+
+// Drop superseded and evicted records by writing the live entries, least
+// recently used first, to a new segment that replaces the old one
+void ResponseCache::rewrite() {
+    const std::string tmp_path = path + ".tmp";
+    std::fclose(out);
+    out = std::fopen(tmp_path.c_str(), "wb");
+    if (!out) {
+        throw std::runtime_error("cannot create " + tmp_path);
+    }
+    file_bytes = 0;
+    for (auto it = lru.rbegin(); it != lru.rend(); ++it) append_record(*it);
+    std::fclose(out);
+    out = nullptr;
+    std::filesystem::rename(tmp_path, path);
+    out = std::fopen(path.c_str(), "ab");
+    if (!out) {
+        throw std::runtime_error("cannot open response cache " + path);
+    }
+}
+
+size_t ResponseCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hit_count;
+}
+
+size_t ResponseCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return miss_count;
+}
+
+size_t ResponseCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lru.size();
+}
+
+size_t ResponseCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return used_bytes;
+}
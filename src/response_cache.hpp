@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "request_body.hpp"
+
+// Model responses keyed by a hash of the endpoint and the full request body,
+// which already holds the model, options and rendered prompt. Entries live in
+// an LRU bounded by `max_bytes`. With a path, every entry is also appended to
+// a segment file that is replayed on open, so repeated prompts still hit
+// after a restart; the file is rewritten from the live entries once it grows
+// past twice the budget. Thread-safe, so stacks can share one cache.
+class ResponseCache {
+public:
+    struct Key {
+        uint64_t hash = 0;
+        uint64_t size = 0; // Body length, checked on lookup against hash collisions
+    };
+
+    struct Entry {
+        std::string response;
+        std::vector<int> context; // Server KV context returned with the response
+    };
+
+    // `path` may be empty for a cache that lives only in memory
+    ResponseCache(std::string path, size_t max_bytes);
+    ~ResponseCache();
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    static Key key(std::string_view endpoint, std::string_view body);
+    // Same key as for the joined body
+    static Key key(std::string_view endpoint, const RequestBody& body);
+
+    // Load the segment file; a torn tail is truncated
+    void open();
+
+    // Copy the entry for `key` to `out` and mark it most recently used
+    bool get(const Key& key, Entry& out);
+
+    // Store `entry`, evicting least recently used entries to stay in budget
+    void put(const Key& key, Entry entry);
+
+    size_t hits() const;
+    size_t misses() const;
+    size_t size() const;
+    size_t bytes() const;
+
+private:
+    struct Node {
+        Key key;
+        Entry entry;
+    };
+    using Lru = std::list<Node>; // Most recently used first
+
+    static size_t cost(const Entry& entry);
+    void insert(const Key& key, Entry entry);
+    void append_record(const Node& node);
+    void rewrite();
+
+    std::string path;
+    size_t max_bytes;
+    mutable std::mutex mutex; // Guards everything below
+    Lru lru;
+    std::unordered_map<uint64_t, Lru::iterator> index; // By key hash
+    size_t used_bytes = 0;
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+    std::FILE* out = nullptr;
+    uint64_t file_bytes = 0; // Segment size, including superseded records
+};
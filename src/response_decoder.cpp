@@ -0,0 +1,309 @@
+#include "response_decoder.hpp"
+
+#include <charconv>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+void append_utf8(std::string& out, unsigned code_point) {
+    if (code_point < 0x80) {
+        out += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        out += static_cast<char>(0xC0 | (code_point >> 6));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        out += static_cast<char>(0xE0 | (code_point >> 12));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code_point >> 18));
+        out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+}
+
+// Cursor over one JSON text. Values the decoder does not keep are skipped
+// by structure only, without validating their contents.
+class Scanner {
+public:
+    Scanner(const char* begin, const char* end) : begin(begin), p(begin), end(end) {}
+
+    [[noreturn]] void fail(const char* what) const {
+        throw std::runtime_error("Invalid JSON at byte " + std::to_string(p - begin) + ": " + what);
+    }
+
+    void skip_space() {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+    }
+
+    // Next significant character, or '\0' at the end
+    char peek() {
+        skip_space();
+        return p < end ? *p : '\0';
+    }
+
+    bool consume(char c) {
+        if (peek() != c) return false;
+        ++p;
+        return true;
+    }
+
+    void expect(char c, const char* what) {
+        if (!consume(c)) fail(what);
+    }
+
+    bool at_end() {
+        skip_space();
+        return p == end;
+    }
+
+    const char* position() const { return p; }
+
+    // Unescape the string at the cursor into `out`
+    void string(std::string& out) {
+        out.clear();
+        ++p; // Opening quote
+        for (;;) {
+            const char* run = p;
+            while (p < end && *p != '"' && *p != '\\') ++p;
+            out.append(run, p);
+            if (p == end) fail("unterminated string");
+            if (*p++ == '"') return;
+            if (p == end) fail("unterminated string");
+            switch (*p++) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': append_utf8(out, code_point()); break;
+            default: fail("invalid escape");
+            }
+        }
+    }
+
+    // An object key; points into the input unless it has escapes
+    std::string_view key(std::string& scratch) {
+        const char* start = p + 1;
+        const char* q = start;
+        while (q < end && *q != '"' && *q != '\\') ++q;
+        if (q < end && *q == '"') {
+            p = q + 1;
+            return {start, static_cast<size_t>(q - start)};
+        }
+        string(scratch);
+        return scratch;
+    }
+
+    bool boolean() {
+        if (end - p >= 4 && std::string_view(p, 4) == "true") {
+            p += 4;
+            return true;
+        }
+        if (end - p >= 5 && std::string_view(p, 5) == "false") {
+            p += 5;
+            return false;
+        }
+        skip_value();
+        return false;
+    }
+
+    // Integer value; fractions are truncated, and non-numbers read as 0
+    long long integer() {
+        if (p == end || (*p != '-' && (*p < '0' || *p > '9'))) {
+            skip_value();
+            return 0;
+        }
+        long long value = 0;
+        auto [next, ec] = std::from_chars(p, end, value);
+        if (ec != std::errc()) fail("invalid number");
+        if (next < end && (*next == '.' || *next == 'e' || *next == 'E')) {
+            double real = 0.0;
+            auto [real_next, real_ec] = std::from_chars(p, end, real);
+            if (real_ec != std::errc()) fail("invalid number");
+            value = static_cast<long long>(real);
+            next = real_next;
+        }
+        p = next;
+        return value;
+    }
+
+    void int_array(std::vector<int>& out) {
+        out.clear();
+        ++p; // '['
+        if (consume(']')) return;
+        do {
+            skip_space();
+            int value = 0;
+            auto [next, ec] = std::from_chars(p, end, value);
+            if (ec != std::errc()) fail("expected an integer");
+            p = next;
+            out.push_back(value);
+        } while (consume(','));
+        expect(']', "expected ',' or ']'");
+    }
+
+    // Skip an array of numbers with a byte scan for its end; anything
+    // nested takes the general path
+    void skip_flat_array() {
+        for (const char* q = p + 1; q < end; ++q) {
+            if (*q == ']') {
+                p = q + 1;
+                return;
+            }
+            if (*q == '[' || *q == '{' || *q == '"') break;
+        }
+        skip_value();
+    }
+
+    void skip_value() {
+        switch (peek()) {
+        case '"':
+            skip_string();
+            return;
+        case '{':
+        case '[':
+            skip_nested();
+            return;
+        default: {
+            // Number or literal
+            const char* start = p;
+            while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\n' && *p != '\r' &&
+                   *p != '\t') {
+                ++p;
+            }
+            if (p == start) fail("expected a value");
+        }
+        }
+    }
+
+private:
+    void skip_string() {
+        for (++p; p < end; ++p) {
+            if (*p == '\\') {
+                if (++p == end) break;
+            } else if (*p == '"') {
+                ++p;
+                return;
+            }
+        }
+        fail("unterminated string");
+    }
+
+    void skip_nested() {
+        size_t depth = 0;
+        while (p < end) {
+            const char c = *p;
+            if (c == '"') {
+                skip_string();
+                continue;
+            }
+            ++p;
+            if (c == '{' || c == '[') {
+                ++depth;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                return;
+            }
+        }
+        fail("unterminated object or array");
+    }
+
+    unsigned hex4() {
+        if (end - p < 4) fail("truncated \\u escape");
+        unsigned value = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char c = *p++;
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else fail("invalid \\u escape");
+        }
+        return value;
+    }
+
+    // Code point of a \u escape, joining surrogate pairs; a lone
+    // surrogate becomes U+FFFD
+    unsigned code_point() {
+        const unsigned value = hex4();
+        if (value >= 0xDC00 && value < 0xE000) return 0xFFFD;
+        if (value < 0xD800 || value >= 0xDC00) return value;
+        if (end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+            const char* mark = p;
+            p += 2;
+            const unsigned low = hex4();
+            if (low >= 0xDC00 && low < 0xE000) return 0x10000 + ((value - 0xD800) << 10) + (low - 0xDC00);
+            p = mark;
+        }
+        return 0xFFFD;
+    }
+
+    const char* begin;
+    const char* p;
+    const char* end;
+};
+
+} // namespace
+
+void decode_generate_response(const char* begin, const char* end, GenerateResponse& out, bool keep_context) {
+    out.response.clear();
+    out.has_response = false;
+    out.error.clear();
+    out.done = false;
+    out.eval_count = out.eval_duration = out.prompt_eval_count = out.prompt_eval_duration = 0;
+    out.load_duration = out.total_duration = 0;
+    out.context.clear();
+
+    Scanner in(begin, end);
+    in.expect('{', "expected an object");
+    if (!in.consume('}')) {
+        std::string scratch;
+        do {
+            if (in.peek() != '"') in.fail("expected a key");
+            const std::string_view key = in.key(scratch);
+            in.expect(':', "expected ':'");
+            const char next = in.peek();
+            if (key == "response" && next == '"') {
+                in.string(out.response);
+                out.has_response = true;
+            } else if (key == "error") {
+                if (next == '"') {
+                    in.string(out.error);
+                } else {
+                    const char* start = in.position();
+                    in.skip_value();
+                    out.error.assign(start, in.position());
+                }
+            } else if (key == "done") {
+                out.done = in.boolean();
+            } else if (key == "eval_count") {
+                out.eval_count = in.integer();
+            } else if (key == "eval_duration") {
+                out.eval_duration = in.integer();
+            } else if (key == "prompt_eval_count") {
+                out.prompt_eval_count = in.integer();
+            } else if (key == "prompt_eval_duration") {
+                out.prompt_eval_duration = in.integer();
+            } else if (key == "load_duration") {
+                out.load_duration = in.integer();
+            } else if (key == "total_duration") {
+                out.total_duration = in.integer();
+            } else if (key == "context" && next == '[') {
+                if (keep_context) {
+                    in.int_array(out.context);
+                } else {
+                    in.skip_flat_array();
+                }
+            } else {
+                in.skip_value();
+            }
+        } while (in.consume(','));
+        in.expect('}', "expected ',' or '}'");
+    }
+    if (!in.at_end()) in.fail("trailing characters");
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// The fields memoraxx uses from one /api/generate response object: the
+// whole non-streamed body, or one line of a streamed one
+struct GenerateResponse {
+    std::string response;
+    bool has_response = false;
+    std::string error; // Server-side error, as text
+    bool done = false;
+    long long eval_count = 0;
+    long long eval_duration = 0; // Nanoseconds
+    long long prompt_eval_count = 0;
+    long long prompt_eval_duration = 0; // Nanoseconds
+    long long load_duration = 0; // Nanoseconds
+    long long total_duration = 0; // Nanoseconds
+    std::vector<int> context; // Empty unless asked for
+};
+
+// Decode a generate response in one pass without building a JSON tree.
+// Strings are unescaped straight into `out`, whose buffers are reused
+// across calls; every other field is skipped. The KV `context` array, most
+// of a final response's bytes, is only converted when `keep_context` is
+// set and is otherwise skipped with a plain byte scan. Invalid UTF-8 is
+// passed through. Throws std::runtime_error on malformed JSON.
+void decode_generate_response(const char* begin, const char* end, GenerateResponse& out, bool keep_context);
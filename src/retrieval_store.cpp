@@ -0,0 +1,183 @@
+#include "retrieval_store.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Fixed part of a turn record; prompt, response and the embedding follow
+struct RecordHeader {
+    uint32_t payload_size; // Bytes after this field
+    int32_t token_count;
+    uint32_t prompt_size;
+    uint32_t response_size;
+    uint32_t dim;
+};
+
+const size_t HNSW_M = 16;
+const size_t HNSW_EF_CONSTRUCTION = 100;
+const size_t HNSW_EF_SEARCH = 64;
+
+} // namespace
+
+RetrievalStore::RetrievalStore(std::string base_path)
+    : log_path(base_path + ".vectors"), index_path(base_path + ".hnsw") {}
+
+RetrievalStore::~RetrievalStore() {
+    try {
+        save_index();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to save vector index: " << e.what() << std::endl;
+    }
+    if (out) std::fclose(out);
+}
+
+void RetrievalStore::open() {
+    std::ifstream in(log_path, std::ios::binary);
+    if (in.is_open()) {
+        in.seekg(0, std::ios::end);
+        const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+        in.seekg(0);
+
+        // Records past the graph snapshot have to be inserted again
+        uint64_t offset = 0;
+        std::vector<float> embedding;
+        RecordHeader header;
+        while (offset + sizeof(header) <= file_size) {
+            in.seekg(static_cast<std::streamoff>(offset));
+            if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) break;
+            const uint64_t expected = sizeof(header) - sizeof(uint32_t) + uint64_t(header.prompt_size) +
+                                      header.response_size + uint64_t(header.dim) * sizeof(float);
+            if (header.payload_size != expected || offset + sizeof(uint32_t) + header.payload_size > file_size) break;
+
+            if (!index) {
+                index = std::make_unique<HnswIndex>(header.dim, HNSW_M, HNSW_EF_CONSTRUCTION);
+                if (index->load(index_path)) {
+                    indexed_at_snapshot = index->size();
+                } else {
+                    index = std::make_unique<HnswIndex>(header.dim, HNSW_M, HNSW_EF_CONSTRUCTION);
+                    indexed_at_snapshot = 0;
+                }
+            }
+            if (header.dim != index->dimension()) break;
+            if (offsets.size() >= index->size()) {
+                embedding.resize(header.dim);
+                in.seekg(static_cast<std::streamoff>(offset + sizeof(header) + header.prompt_size + header.response_size));
+                if (!in.read(reinterpret_cast<char*>(embedding.data()), embedding.size() * sizeof(float))) break;
+                index->add(embedding.data());
+            }
+            offsets.push_back(offset);
+            offset += sizeof(uint32_t) + header.payload_size;
+        }
+        in.close();
+
+        if (index && index->size() != offsets.size()) {
+            // The snapshot covers turns the log lost; rebuild from the log
+            std::cerr << "Warning: Vector index does not match the turn log, rebuilding." << std::endl;
+            offsets.clear();
+            index.reset();
+            indexed_at_snapshot = 0;
+            std::filesystem::remove(index_path);
+            return open();
+        }
+        if (offset < file_size) {
+            std::cerr << "Warning: Truncating corrupt turn log tail at byte " << offset << std::endl;
+            std::filesystem::resize_file(log_path, offset);
+        }
+    }
+
+    out = std::fopen(log_path.c_str(), "ab");
+    if (!out) {
+        throw std::runtime_error("cannot open turn log " + log_path);
+    }
+    reader.open(log_path, std::ios::binary);
+}
+
+void RetrievalStore::add(const Interaction& interaction, const std::vector<float>& embedding) {
+    if (embedding.empty()) return;
+    if (index && embedding.size() != index->dimension()) {
+        std::cerr << "Warning: Embedding dimension changed, discarding stored turns." << std::endl;
+        clear();
+    }
+    if (!index) {
+        index = std::make_unique<HnswIndex>(embedding.size(), HNSW_M, HNSW_EF_CONSTRUCTION);
+    }
+
+    RecordHeader header;
+    header.token_count = interaction.token_count;
+    header.prompt_size = static_cast<uint32_t>(interaction.prompt.size());
+    header.response_size = static_cast<uint32_t>(interaction.response.size());
+    header.dim = static_cast<uint32_t>(embedding.size());
+    header.payload_size = static_cast<uint32_t>(sizeof(header) - sizeof(uint32_t) + header.prompt_size +
+                                                header.response_size + embedding.size() * sizeof(float));
+
+    std::fseek(out, 0, SEEK_END);
+    const uint64_t offset = static_cast<uint64_t>(std::ftell(out));
+    std::fwrite(&header, sizeof(header), 1, out);
+    std::fwrite(interaction.prompt.data(), 1, interaction.prompt.size(), out);
+    std::fwrite(interaction.response.data(), 1, interaction.response.size(), out);
+    std::fwrite(embedding.data(), sizeof(float), embedding.size(), out);
+    if (std::fflush(out) != 0 || std::ferror(out)) {
+        throw std::runtime_error("failed to append to turn log " + log_path);
+    }
+    offsets.push_back(offset);
+    index->add(embedding.data());
+}
+
+std::vector<std::pair<float, uint32_t>> RetrievalStore::search(const std::vector<float>& query, size_t k, size_t limit) const {
+    if (!index || query.size() != index->dimension() || limit == 0) return {};
+    // Over-fetch by the number of excluded recent turns, then filter them out
+    const size_t excluded = offsets.size() - std::min(limit, offsets.size());
+    auto results = index->search(query.data(), k + excluded, HNSW_EF_SEARCH + excluded);
+    std::vector<std::pair<float, uint32_t>> out;
+    for (const auto& result : results) {
+        if (result.second < limit && out.size() < k) out.push_back(result);
+    }
+    return out;
+}
+
+Interaction RetrievalStore::read(uint32_t id) const {
+    RecordHeader header;
+    reader.clear();
+    reader.seekg(static_cast<std::streamoff>(offsets.at(id)));
+    if (!reader.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        throw std::runtime_error("failed to read turn log " + log_path);
+    }
+    Interaction interaction{std::string(header.prompt_size, '\0'), std::string(header.response_size, '\0'), header.token_count};
+    reader.read(interaction.prompt.data(), header.prompt_size);
+    reader.read(interaction.response.data(), header.response_size);
+    if (!reader) {
+        throw std::runtime_error("failed to read turn log " + log_path);
+    }
+    return interaction;
+}
+
+void RetrievalStore::reset_files() {
+    if (out) std::fclose(out);
+    reader.close();
+    std::error_code ec;
+    std::filesystem::remove(index_path, ec);
+    out = std::fopen(log_path.c_str(), "wb");
+    if (!out) {
+        throw std::runtime_error("cannot open turn log " + log_path);
+    }
+    reader.open(log_path, std::ios::binary);
+}
+
+void RetrievalStore::clear() {
+    index.reset();
+    offsets.clear();
+    indexed_at_snapshot = 0;
+    reset_files();
+}
+
+void RetrievalStore::save_index() {
+    if (!index || index->size() == indexed_at_snapshot) return;
+    // Write to a temporary file so a crash never leaves a torn snapshot
+    const std::string tmp_path = index_path + ".tmp";
+    index->save(tmp_path);
+    std::filesystem::rename(tmp_path, index_path);
+    indexed_at_snapshot = index->size();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "interaction.hpp"
+#include "vector_index.hpp"
+
+// Every stored turn with its embedding, for relevance-based context.
+// Turns are appended to `<base>.vectors` (one binary record per turn) and
+// indexed by an HnswIndex whose graph is snapshotted to `<base>.hnsw`, so
+// startup only re-inserts turns added after the last snapshot. Turn text
+// stays on disk and is read back only for the turns a search returns.
+class RetrievalStore {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX; // Id of a turn that is not stored
+
+    explicit RetrievalStore(std::string base_path);
+    ~RetrievalStore();
+    RetrievalStore(const RetrievalStore&) = delete;
+    RetrievalStore& operator=(const RetrievalStore&) = delete;
+
+    // Load the turn log and graph snapshot; a torn tail is truncated
+    void open();
+
+    size_t size() const { return offsets.size(); }
+
+    // Store a turn under `embedding`. A dimension change means the embedding
+    // model changed, which discards the existing turns.
+    void add(const Interaction& interaction, const std::vector<float>& embedding);
+
+    // Ids of the `k` turns most similar to `query` among ids < `limit`,
+    // as (distance, id), closest first
+    std::vector<std::pair<float, uint32_t>> search(const std::vector<float>& query, size_t k, size_t limit) const;
+
+    Interaction read(uint32_t id) const;
+
+    void clear();
+
+    // Snapshot the graph so the next start does not re-insert every turn
+    void save_index();
+
+private:
+    void reset_files();
+
+    std::string log_path;
+    std::string index_path;
+    std::unique_ptr<HnswIndex> index; // Created with the first embedding's dimension
+    std::vector<uint64_t> offsets; // File offset of each turn record
+    std::FILE* out = nullptr;
+    mutable std::ifstream reader;
+    size_t indexed_at_snapshot = 0; // Turns covered by the saved graph
+};
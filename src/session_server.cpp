@@ -0,0 +1,831 @@
+#include "session_server.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+const size_t MAX_HEADER_BYTES = 16 * 1024;
+const size_t MAX_BODY_BYTES = 16 << 20;
+const size_t READ_BLOCK = 64 * 1024;
+const size_t MAX_SESSION_ID = 128;
+const size_t MAX_SEARCH_RESULTS = 100; // Hits returned by one search
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL; // A vanished client must not raise SIGPIPE
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+const char* status_text(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 504: return "Gateway Timeout";
+        default: return "Internal Server Error";
+    }
+}
+
+std::string http_response(int status, const std::string& body, bool keep_alive,
+                          const char* content_type = "application/json") {
+    std::string out = "HTTP/1.1 " + std::to_string(status) + " " + status_text(status) +
+                      "\r\nContent-Type: " + content_type + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+    if (!keep_alive) out += "Connection: close\r\n";
+    out += "\r\n";
+    out += body;
+    return out;
+}
+
+std::string to_lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+    return text;
+}
+
+std::string trim(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t");
+    if (start == std::string::npos) return "";
+    return text.substr(start, text.find_last_not_of(" \t") - start + 1);
+}
+
+// Split "/v1/sessions/{id}/{action}"; false for other paths
+bool session_path(const std::string& path, std::string& id, std::string& action) {
+    const std::string prefix = "/v1/sessions/";
+    if (path.rfind(prefix, 0) != 0) return false;
+    const std::string rest = path.substr(prefix.size());
+    const size_t slash = rest.find('/');
+    id = rest.substr(0, slash);
+    action = slash == std::string::npos ? "" : rest.substr(slash + 1);
+    return true;
+}
+
+// Ids name files in the session directory, so only a safe alphabet is allowed
+bool valid_session_id(const std::string& id) {
+    if (id.empty() || id.size() > MAX_SESSION_ID || id[0] == '.') return false;
+    return std::all_of(id.begin(), id.end(), [](unsigned char c) {
+        return std::isalnum(c) || c == '-' || c == '_' || c == '.';
+    });
+}
+
+#ifndef _WIN32
+// 127.0.0.0/8, ::1 and IPv4-mapped 127.0.0.0/8
+bool is_loopback(const sockaddr* address) {
+    if (address->sa_family == AF_INET) {
+        return (ntohl(reinterpret_cast<const sockaddr_in*>(address)->sin_addr.s_addr) >> 24) == 127;
+    }
+    if (address->sa_family == AF_INET6) {
+        const in6_addr& ip = reinterpret_cast<const sockaddr_in6*>(address)->sin6_addr;
+        return IN6_IS_ADDR_LOOPBACK(&ip) || (IN6_IS_ADDR_V4MAPPED(&ip) && ip.s6_addr[12] == 127);
+    }
+    return false;
+}
+
+void set_nonblocking(int fd) {
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+#endif
+
+} // namespace
+
+Endpoint Endpoint::parse(const std::string& text) {
+    Endpoint endpoint;
+    if (text.rfind("unix:", 0) == 0) {
+        endpoint.unix_path = text.substr(5);
+        if (endpoint.unix_path.empty()) throw std::invalid_argument("empty socket path in " + text);
+        return endpoint;
+    }
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        throw std::invalid_argument("expected unix:PATH or HOST:PORT, got " + text);
+    }
+    endpoint.host = text.substr(0, colon);
+    if (endpoint.host.size() > 2 && endpoint.host.front() == '[' && endpoint.host.back() == ']') {
+        endpoint.host = endpoint.host.substr(1, endpoint.host.size() - 2);
+    }
+    unsigned port = 0;
+    const char* first = text.data() + colon + 1;
+    const char* last = text.data() + text.size();
+    auto [end, ec] = std::from_chars(first, last, port);
+    if (ec != std::errc() || end != last || first == last || port > 65535) {
+        throw std::invalid_argument("invalid port in " + text);
+    }
+    endpoint.port = static_cast<uint16_t>(port);
+    return endpoint;
+}
+
+SessionServer::SessionServer(DaemonOptions options, StackFactory factory, Metrics* metrics)
+    : options(std::move(options)), factory(std::move(factory)), metrics(metrics) {}
+
+SessionServer::~SessionServer() {
+    stop();
+}
+
+SessionServer::Counters SessionServer::counters() const {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    return counts;
+}
+
+std::string SessionServer::memory_file(const std::string& id) const {
+    return (std::filesystem::path(options.session_dir) / (id + ".json")).string();
+}
+
+#ifdef _WIN32
+
+void SessionServer::start() {
+    throw std::runtime_error("daemon mode is not supported on Windows");
+}
+
+void SessionServer::stop() {}
+
+#else
+
+void SessionServer::start() {
+    endpoint = Endpoint::parse(options.listen);
+    std::filesystem::create_directories(options.session_dir);
+
+    if (!endpoint.unix_path.empty()) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (endpoint.unix_path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("socket path too long: " + endpoint.unix_path);
+        }
+        std::memcpy(address.sun_path, endpoint.unix_path.c_str(), endpoint.unix_path.size() + 1);
+        // A socket file left by a daemon that did not shut down cleanly is
+        // reused; one that still accepts connections belongs to a live daemon
+        struct stat info;
+        if (::lstat(endpoint.unix_path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+            int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            bool live = probe >= 0 && ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+            if (probe >= 0) ::close(probe);
+            if (live) throw std::runtime_error("another daemon is listening on " + endpoint.unix_path);
+            ::unlink(endpoint.unix_path.c_str());
+        }
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 || ::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            std::string error = std::strerror(errno);
+            if (listen_fd >= 0) ::close(listen_fd);
+            listen_fd = -1;
+            throw std::runtime_error("cannot listen on " + options.listen + ": " + error);
+        }
+    } else {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* found = nullptr;
+        int resolved = ::getaddrinfo(endpoint.host.c_str(), std::to_string(endpoint.port).c_str(), &hints, &found);
+        if (resolved != 0) {
+            throw std::runtime_error("cannot resolve " + endpoint.host + ": " + ::gai_strerror(resolved));
+        }
+        // Sessions run shell tools, so only local clients get in by default
+        bool remote = false;
+        for (addrinfo* candidate = found; candidate; candidate = candidate->ai_next) {
+            remote = remote || !is_loopback(candidate->ai_addr);
+        }
+        if (remote && !options.allow_remote) {
+            ::freeaddrinfo(found);
+            throw std::runtime_error("refusing to listen on " + options.listen +
+                                     ": not a loopback address, and sessions can run shell commands. "
+                                     "Use 127.0.0.1, ::1, localhost or a Unix socket, or pass --allow-remote");
+        }
+        if (remote) {
+            std::cerr << "Warning: Listening on " << options.listen
+                      << ", which is reachable from other hosts. Anyone who can connect can run shell commands "
+                         "through the run_command tool." << std::endl;
+        }
+        std::string error = "no address";
+        for (addrinfo* candidate = found; candidate; candidate = candidate->ai_next) {
+            listen_fd = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+            if (listen_fd < 0) continue;
+            int one = 1;
+            ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (::bind(listen_fd, candidate->ai_addr, candidate->ai_addrlen) == 0) break;
+            error = std::strerror(errno);
+            ::close(listen_fd);
+            listen_fd = -1;
+        }
+        ::freeaddrinfo(found);
+        if (listen_fd < 0) throw std::runtime_error("cannot listen on " + options.listen + ": " + error);
+        sockaddr_storage bound{};
+        socklen_t length = sizeof(bound);
+        ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&bound), &length);
+        bound_port = ntohs(bound.ss_family == AF_INET6 ? reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port
+                                                       : reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+    }
+    if (::listen(listen_fd, SOMAXCONN) != 0 || ::pipe(wake_fds) != 0) {
+        throw std::runtime_error("cannot listen on " + options.listen + ": " + std::strerror(errno));
+    }
+    set_nonblocking(listen_fd);
+    set_nonblocking(wake_fds[0]);
+    set_nonblocking(wake_fds[1]);
+
+    last_sweep = Clock::now();
+    io_thread = std::thread(&SessionServer::io_loop, this);
+    for (size_t i = 0; i < std::max<size_t>(options.workers, 1); ++i) {
+        workers.emplace_back(&SessionServer::work, this);
+    }
+}
+
+void SessionServer::stop() {
+    if (listen_fd < 0 || stopping.exchange(true)) return;
+    queue_ready.notify_all();
+    char byte = 0;
+    (void)!::write(wake_fds[1], &byte, 1);
+    if (io_thread.joinable()) io_thread.join();
+    // Queued requests still run, so every accepted turn reaches memory
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+
+    for (auto& [id, connection] : connections) ::close(connection.fd);
+    connections.clear();
+    ::close(listen_fd);
+    ::close(wake_fds[0]);
+    ::close(wake_fds[1]);
+    if (!endpoint.unix_path.empty()) ::unlink(endpoint.unix_path.c_str());
+    unload_all();
+}
+
+void SessionServer::io_loop() {
+    std::vector<pollfd> fds;
+    std::vector<uint64_t> ids; // Connection of each fds entry past the first two
+    while (!stopping) {
+        fds.clear();
+        ids.clear();
+        fds.push_back({listen_fd, POLLIN, 0});
+        fds.push_back({wake_fds[0], POLLIN, 0});
+        for (auto& [id, connection] : connections) {
+            short events = 0;
+            // A busy connection is not read, so its next request waits in the kernel
+            if (!connection.busy && !connection.closing) events |= POLLIN;
+            if (connection.out_offset < connection.out.size()) events |= POLLOUT;
+            fds.push_back({connection.fd, events, 0});
+            ids.push_back(id);
+        }
+        if (::poll(fds.data(), fds.size(), 1000) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Warning: Daemon poll failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char drain[256];
+            while (::read(wake_fds[0], drain, sizeof(drain)) > 0) {}
+            std::vector<std::pair<uint64_t, std::string>> done;
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                done.swap(finished);
+            }
+            for (auto& [id, response] : done) {
+                auto it = connections.find(id);
+                if (it == connections.end()) continue;
+                Connection& connection = it->second;
+                connection.busy = false;
+                connection.out += response;
+                write_to(connection);
+                parse_request(id, connection); // Pipelined requests already received
+            }
+        }
+        if (fds[0].revents & POLLIN) accept_connections();
+        for (size_t i = 2; i < fds.size(); ++i) {
+            if (fds[i].revents == 0) continue;
+            auto it = connections.find(ids[i - 2]);
+            if (it == connections.end()) continue;
+            if (fds[i].revents & POLLOUT) write_to(it->second);
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) read_from(it->first, it->second);
+        }
+
+        for (auto it = connections.begin(); it != connections.end();) {
+            const Connection& connection = it->second;
+            if (connection.closing && !connection.busy && connection.out_offset >= connection.out.size()) {
+                ::close(connection.fd);
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void SessionServer::accept_connections() {
+    while (true) {
+        int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return; // EAGAIN, or out of descriptors until some close
+        }
+        set_nonblocking(fd);
+        int one = 1;
+#ifdef SO_NOSIGPIPE
+        ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        if (endpoint.unix_path.empty()) ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        connections[next_connection++].fd = fd;
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        ++counts.connections;
+    }
+}
+
+void SessionServer::read_from(uint64_t id, Connection& connection) {
+    char buffer[READ_BLOCK];
+    bool peer_closed = false;
+    while (true) {
+        ssize_t n = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            connection.in.append(buffer, static_cast<size_t>(n));
+            if (connection.in.size() > MAX_HEADER_BYTES + MAX_BODY_BYTES) break; // Rejected by parse_request
+            continue;
+        }
+        if (n == 0) {
+            peer_closed = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            connection.in.clear();
+            peer_closed = true;
+        }
+        break;
+    }
+    // A request sent before a half-close is still answered
+    parse_request(id, connection);
+    if (peer_closed) connection.closing = true;
+}
+
+void SessionServer::write_to(Connection& connection) {
+    while (connection.out_offset < connection.out.size()) {
+        ssize_t n = ::send(connection.fd, connection.out.data() + connection.out_offset,
+                           connection.out.size() - connection.out_offset, SEND_FLAGS);
+        if (n > 0) {
+            connection.out_offset += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        // The client is gone; drop what it will never read
+        connection.out.clear();
+        connection.out_offset = 0;
+        connection.in.clear();
+        connection.closing = true;
+        return;
+    }
+    connection.out.clear();
+    connection.out_offset = 0;
+    if (!connection.keep_alive && !connection.busy) connection.closing = true;
+}
+
+void SessionServer::parse_request(uint64_t id, Connection& connection) {
+    if (connection.busy || connection.closing) return;
+    auto reject = [&](int status, const std::string& message) {
+        connection.in.clear();
+        connection.keep_alive = false;
+        connection.out += http_response(status, json{{"error", message}}.dump(), false);
+        write_to(connection);
+        connection.closing = true;
+    };
+
+    const size_t header_end = connection.in.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        if (connection.in.size() > MAX_HEADER_BYTES) reject(413, "request header too large");
+        return;
+    }
+
+    Request request;
+    request.connection = id;
+    std::istringstream head(connection.in.substr(0, header_end));
+    std::string line;
+    std::getline(head, line);
+    std::istringstream request_line(line);
+    std::string version;
+    request_line >> request.method >> request.target >> version;
+    if (request.method.empty() || request.target.empty() || version.rfind("HTTP/1.", 0) != 0) {
+        reject(400, "malformed request line");
+        return;
+    }
+    request.keep_alive = version != "HTTP/1.0";
+    size_t content_length = 0;
+    bool expect_continue = false;
+    while (std::getline(head, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        const std::string name = to_lower(trim(line.substr(0, colon)));
+        const std::string value = trim(line.substr(colon + 1));
+        if (name == "content-length") {
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), content_length);
+            if (ec != std::errc() || end != value.data() + value.size()) {
+                reject(400, "invalid Content-Length");
+                return;
+            }
+        } else if (name == "connection") {
+            const std::string option = to_lower(value);
+            if (option == "close") request.keep_alive = false;
+            if (option == "keep-alive") request.keep_alive = true;
+        } else if (name == "transfer-encoding") {
+            reject(501, "chunked request bodies are not supported");
+            return;
+        } else if (name == "expect") {
+            expect_continue = to_lower(value) == "100-continue";
+        }
+    }
+    if (content_length > MAX_BODY_BYTES) {
+        reject(413, "request body too large");
+        return;
+    }
+
+    const size_t total = header_end + 4 + content_length;
+    if (connection.in.size() < total) {
+        if (expect_continue && !connection.continue_sent) {
+            connection.out += "HTTP/1.1 100 Continue\r\n\r\n";
+            connection.continue_sent = true;
+            write_to(connection);
+        }
+        return;
+    }
+    request.body = connection.in.substr(header_end + 4, content_length);
+    connection.in.erase(0, total);
+    connection.continue_sent = false;
+    connection.keep_alive = request.keep_alive;
+    // A cancel must not wait for a worker behind the turns it cancels, so
+    // it is answered right here; it only flips a flag
+    const std::string path = request.target.substr(0, request.target.find('?'));
+    if (request.method == "POST" && path.size() > 7 && path.compare(path.size() - 7, 7, "/cancel") == 0) {
+        connection.out += dispatch(request);
+        write_to(connection);
+        parse_request(id, connection); // Pipelined requests already received
+        return;
+    }
+    connection.busy = true;
+    // Session requests wait in their session's queue, which one worker at
+    // a time drains; pinning keeps the session from being unloaded meanwhile
+    std::string session_id, action;
+    std::shared_ptr<Session> session;
+    if (request.method == "POST" && session_path(path, session_id, action) && valid_session_id(session_id)) {
+        session = acquire(session_id);
+        request.session = session;
+        if (action == "completion") request.cancel = std::make_shared<CancelToken>();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!session) {
+            queue.push_back(std::move(request));
+        } else {
+            session->pending.push_back(std::move(request));
+            if (!session->scheduled) {
+                session->scheduled = true;
+                ready.push_back(session);
+            }
+        }
+    }
+    queue_ready.notify_one();
+}
+
+void SessionServer::work() {
+    while (true) {
+        Request request;
+        std::shared_ptr<Session> session;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_ready.wait_for(lock, std::chrono::seconds(1),
+                                 [this]() { return stopping || !queue.empty() || !ready.empty(); });
+            if (!queue.empty()) {
+                request = std::move(queue.front());
+                queue.pop_front();
+            } else if (!ready.empty()) {
+                session = std::move(ready.front());
+                ready.pop_front();
+                request = std::move(session->pending.front());
+                session->pending.pop_front();
+                session->running = request.cancel;
+            } else {
+                if (stopping) return;
+                lock.unlock();
+                unload_idle(); // Woke for the idle timer
+                continue;
+            }
+        }
+
+        std::string response = dispatch(request);
+        bool requeued = false;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            finished.emplace_back(request.connection, std::move(response));
+            if (session) {
+                session->running.reset();
+                // Back of the line, so a session with a long queue takes turns with the others
+                requeued = !session->pending.empty();
+                if (requeued) {
+                    ready.push_back(session);
+                } else {
+                    session->scheduled = false;
+                }
+            }
+        }
+        if (requeued) queue_ready.notify_one();
+        char byte = 1;
+        (void)!::write(wake_fds[1], &byte, 1);
+        unload_idle();
+    }
+}
+
+#endif
+
+std::string SessionServer::dispatch(const Request& request) {
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        ++counts.requests;
+    }
+    const std::string path = request.target.substr(0, request.target.find('?'));
+    std::string id, action;
+    int status = 200;
+    json reply;
+    try {
+        if (path == "/metrics" && request.method == "GET") {
+            std::string text;
+            if (metrics) {
+                std::lock_guard<std::mutex> lock(metrics_mutex);
+                text = metrics->prometheus();
+            }
+            const Counters now = counters();
+            text += "# TYPE memoraxx_daemon_requests_total counter\nmemoraxx_daemon_requests_total " +
+                    std::to_string(now.requests) + "\n" +
+                    "# TYPE memoraxx_daemon_sessions_loaded gauge\nmemoraxx_daemon_sessions_loaded " +
+                    std::to_string(now.sessions_loaded) + "\n" +
+                    "# TYPE memoraxx_daemon_session_unloads_total counter\nmemoraxx_daemon_session_unloads_total " +
+                    std::to_string(now.session_unloads) + "\n" +
+                    "# TYPE memoraxx_daemon_session_bytes gauge\nmemoraxx_daemon_session_bytes " +
+                    std::to_string(now.loaded_bytes) + "\n";
+            return http_response(200, text, request.keep_alive, "text/plain; version=0.0.4");
+        } else if (path == "/v1/stats" && request.method == "GET") {
+            const Counters now = counters();
+            reply = {
+                {"requests", now.requests},
+                {"connections", now.connections},
+                {"sessions_loaded", now.sessions_loaded},
+                {"session_loads", now.session_loads},
+                {"session_unloads", now.session_unloads},
+                {"session_bytes", now.loaded_bytes},
+                {"session_budget_bytes", options.memory_bytes},
+                {"workers", options.workers}
+            };
+            if (metrics) {
+                std::lock_guard<std::mutex> lock(metrics_mutex);
+                reply["summary"] = metrics->summary();
+            }
+        } else if (session_path(path, id, action)) {
+            if (!valid_session_id(id)) {
+                status = 400;
+                reply = {{"error", "invalid session id"}};
+            } else if (request.method != "POST") {
+                status = 405;
+                reply = {{"error", "use POST"}};
+            } else {
+                handle_session(id, action, request, status, reply);
+            }
+        } else {
+            status = 404;
+            reply = {{"error", "no such endpoint: " + request.method + " " + path}};
+        }
+    } catch (const std::exception& e) {
+        status = 500;
+        reply = {{"error", std::string("Error: ") + e.what()}};
+    }
+    return http_response(status, reply.dump(), request.keep_alive);
+}
+
+void SessionServer::handle_session(const std::string& id, const std::string& action, const Request& request,
+                                   int& status, json& reply) {
+    if (action == "cancel") {
+        reply = {{"session", id}, {"cancelled", cancel_completion(id)}};
+        return;
+    }
+    const std::shared_ptr<Session>& session = request.session;
+    auto reject = [&](int code, const std::string& error) {
+        status = code;
+        reply = {{"error", error}};
+        release(id, session, false, false, 0);
+    };
+    std::string prompt;
+    bool use_cache = true;
+    RequestControl control;
+    std::string query;
+    size_t k = 0;
+    std::vector<uint32_t> ids;
+    if (action == "search") {
+        json body = json::parse(request.body, nullptr, false);
+        if (body.is_discarded() || !body.is_object() || !body.contains("query") || !body["query"].is_string()) {
+            reject(400, "expected {\"query\": \"...\"}");
+            return;
+        }
+        query = body["query"].get<std::string>();
+        try {
+            k = std::min(body.value("k", size_t{10}), MAX_SEARCH_RESULTS);
+        } catch (const json::exception&) {
+            reject(400, "expected \"k\" to be a number");
+            return;
+        }
+    } else if (action == "recall") {
+        json body = json::parse(request.body, nullptr, false);
+        try {
+            ids = body.at("ids").get<std::vector<uint32_t>>();
+        } catch (const json::exception&) {
+            reject(400, "expected {\"ids\": [...]}");
+            return;
+        }
+    } else if (action == "completion") {
+        json body = json::parse(request.body, nullptr, false);
+        if (body.is_discarded() || !body.is_object() || !body.contains("prompt") || !body["prompt"].is_string()) {
+            reject(400, "expected {\"prompt\": \"...\"}");
+            return;
+        }
+        prompt = body["prompt"].get<std::string>();
+        try {
+            use_cache = body.value("cache", true);
+            control.timeout = std::chrono::milliseconds(body.value("timeout_ms", size_t{0}));
+        } catch (const json::exception&) {
+            reject(400, "expected \"cache\" to be a boolean and \"timeout_ms\" a number");
+            return;
+        }
+    } else if (action != "clear" && action != "export") {
+        reject(404, "no such session action: " + action);
+        return;
+    }
+
+    bool loaded_now = false;
+    bool has_stack = false;
+    size_t bytes = 0;
+    CompletionStats stats;
+    try {
+        // Uncontended: the session's requests are served one at a time
+        std::lock_guard<std::mutex> lock(session->mutex);
+        if (!session->stack) {
+            session->stack = factory(memory_file(id));
+            loaded_now = true;
+        }
+        has_stack = true;
+        LlamaStack& stack = *session->stack;
+        reply = {{"session", id}};
+        if (action == "completion") {
+            control.cancel = request.cancel.get();
+            std::string response = stack.completion(prompt, nullptr, use_cache, control);
+            stats = stack.last_stats();
+            reply[stats.failed ? "error" : "response"] = std::move(response);
+            reply["stats"] = stats;
+            if (stats.failed) status = stats.timed_out ? 504 : 502;
+        } else if (action == "search") {
+            reply["hits"] = stack.search_archive(query, k);
+        } else if (action == "recall") {
+            try {
+                reply["recalled"] = stack.recall_archived(ids);
+            } catch (const std::out_of_range& e) {
+                status = 400;
+                reply = {{"error", e.what()}};
+            }
+        } else if (action == "clear") {
+            stack.clear_memory();
+            reply["cleared"] = true;
+        } else {
+            stack.export_memory();
+            reply["memory_file"] = memory_file(id);
+        }
+        bytes = stack.memory_bytes();
+    } catch (...) {
+        release(id, session, has_stack, loaded_now, bytes);
+        throw;
+    }
+    release(id, session, has_stack, loaded_now, bytes);
+    if (metrics && action == "completion") {
+        std::lock_guard<std::mutex> lock(metrics_mutex);
+        metrics->record(stats);
+    }
+}
+
+bool SessionServer::cancel_completion(const std::string& id) {
+    std::shared_ptr<Session> session;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        auto it = sessions.find(id);
+        if (it == sessions.end()) return false;
+        session = it->second;
+    }
+    // The pending completions were sent before the cancel, so they go too
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    bool cancelled = false;
+    if (session->running) {
+        session->running->cancel();
+        cancelled = true;
+    }
+    for (const auto& pending : session->pending) {
+        if (!pending.cancel) continue;
+        pending.cancel->cancel();
+        cancelled = true;
+    }
+    return cancelled;
+}
+
+std::shared_ptr<SessionServer::Session> SessionServer::acquire(const std::string& id) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    std::shared_ptr<Session>& session = sessions[id];
+    if (!session) session = std::make_shared<Session>();
+    ++session->users;
+    return session;
+}
+
+void SessionServer::release(const std::string& id, const std::shared_ptr<Session>& session, bool has_stack,
+                            bool loaded_now, size_t bytes) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    --session->users;
+    if (loaded_now) ++counts.session_loads;
+    if (has_stack) {
+        if (!session->loaded) {
+            session->loaded = true;
+            ++counts.sessions_loaded;
+        }
+        counts.loaded_bytes = counts.loaded_bytes - session->bytes + bytes;
+        session->bytes = bytes;
+        session->last_used = Clock::now();
+    }
+    forget_if_unused(id, session);
+}
+
+void SessionServer::forget_if_unused(const std::string& id, const std::shared_ptr<Session>& session) {
+    if (session->users > 0 || session->loaded) return;
+    auto it = sessions.find(id);
+    if (it != sessions.end() && it->second == session) sessions.erase(it);
+}
+
+void SessionServer::unload_idle() {
+    while (true) {
+        std::shared_ptr<Session> victim;
+        std::string victim_id;
+        {
+            std::lock_guard<std::mutex> lock(sessions_mutex);
+            const auto now = Clock::now();
+            const bool over_budget = counts.loaded_bytes > options.memory_bytes;
+            const bool sweep_due = options.idle_seconds > 0 && now - last_sweep >= std::chrono::seconds(1);
+            if (!over_budget && !sweep_due) return;
+            // Least recently used session that no request is holding
+            for (const auto& [id, session] : sessions) {
+                if (!session->loaded || session->users > 0) continue;
+                if (!victim || session->last_used < victim->last_used) {
+                    victim = session;
+                    victim_id = id;
+                }
+            }
+            if (!victim || (!over_budget && now - victim->last_used < std::chrono::seconds(options.idle_seconds))) {
+                last_sweep = now;
+                return;
+            }
+            // Claimed, so no request reloads it until the stack is gone
+            ++victim->users;
+            victim->loaded = false;
+            counts.loaded_bytes -= victim->bytes;
+            victim->bytes = 0;
+            --counts.sessions_loaded;
+            ++counts.session_unloads;
+        }
+        {
+            // Every turn is already in the journal; the destructor saves the session context
+            std::lock_guard<std::mutex> session_lock(victim->mutex);
+            victim->stack.reset();
+        }
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        --victim->users;
+        forget_if_unused(victim_id, victim);
+    }
+}
+
+void SessionServer::unload_all() {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    for (auto& [id, session] : sessions) {
+        std::lock_guard<std::mutex> session_lock(session->mutex);
+        session->stack.reset();
+    }
+    sessions.clear();
+    counts.sessions_loaded = 0;
+    counts.loaded_bytes = 0;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "llama_stack.hpp"
+#include "metrics.hpp"
+
+// Where a daemon listens or a thin client connects: "unix:PATH" for a Unix
+// domain socket, otherwise "HOST:PORT" over TCP
+struct Endpoint {
+    std::string unix_path; // Set for Unix sockets
+    std::string host;
+    uint16_t port = 0;
+
+    // Throws std::invalid_argument on a malformed endpoint
+    static Endpoint parse(const std::string& text);
+};
+
+// Settings for daemon mode (--daemon), set from config.json
+struct DaemonOptions {
+    std::string listen = "unix:memoraxx.sock";
+    size_t workers = 8; // Requests served at once; the rest queue
+    std::string session_dir = "sessions"; // Memory of session `id` lives in `<session_dir>/<id>.json`
+    size_t memory_bytes = 256 << 20; // Loaded sessions beyond this are unloaded, least recently used first
+    size_t idle_seconds = 600; // Sessions unused this long are unloaded; 0 keeps them
+    // Allow TCP addresses other than loopback. Sessions can run the
+    // run_command tool, so that hands a shell to anyone who can connect.
+    bool allow_remote = false;
+};
+
+// Serves many clients from one process over HTTP/1.1, on a Unix domain
+// socket or TCP. Each session id has its own LlamaStack and memory files.
+// One thread multiplexes every connection with poll() and non-blocking
+// sockets; complete requests go to a fixed pool of workers, so a slow model
+// call never stalls other connections. Requests of one session queue in
+// arrival order and are served one at a time, by whichever worker is free,
+// so a busy session never ties up more than one worker. Idle sessions are unloaded to disk (their journal is already
+// there) and reloaded on their next request. POSIX only.
+//
+//   POST /v1/sessions/{id}/completion  {"prompt": "...", "cache": true, "timeout_ms": 0}
+//   POST /v1/sessions/{id}/cancel      Abort the session's completion in progress and those queued
+//   POST /v1/sessions/{id}/search      {"query": "...", "k": 10} Ranked turns from the archive
+//   POST /v1/sessions/{id}/recall      {"ids": [...]} Bring archived turns back into context
+//   POST /v1/sessions/{id}/clear
+//   POST /v1/sessions/{id}/export
+//   GET  /v1/stats                     Session counters and the metrics summary
+//   GET  /metrics                      Prometheus text format
+class SessionServer {
+public:
+    // Builds the stack of a session around its memory file
+    using StackFactory = std::function<std::unique_ptr<LlamaStack>(const std::string& memory_file)>;
+
+    SessionServer(DaemonOptions options, StackFactory factory, Metrics* metrics = nullptr);
+    ~SessionServer();
+    SessionServer(const SessionServer&) = delete;
+    SessionServer& operator=(const SessionServer&) = delete;
+
+    // Bind the endpoint and start the I/O thread and workers. Throws
+    // std::runtime_error if the endpoint cannot be bound, or is a TCP
+    // address other than loopback without `allow_remote`.
+    void start();
+
+    // Finish requests in progress, close every connection and unload all
+    // sessions
+    void stop();
+
+    // Bound TCP port, e.g. after listening on port 0
+    uint16_t port() const { return bound_port; }
+
+    struct Counters {
+        size_t requests = 0;
+        size_t connections = 0; // Accepted so far
+        size_t sessions_loaded = 0; // Sessions with a LlamaStack now
+        size_t session_loads = 0; // Stacks created, including reloads
+        size_t session_unloads = 0;
+        size_t loaded_bytes = 0; // Estimated memory of loaded sessions
+    };
+    Counters counters() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Session;
+
+    struct Request {
+        uint64_t connection = 0;
+        std::string method;
+        std::string target;
+        std::string body;
+        bool keep_alive = true;
+        std::shared_ptr<Session> session; // Pinned by acquire() while the request is pending or served
+        std::shared_ptr<CancelToken> cancel; // Completions only
+    };
+
+    struct Session {
+        std::mutex mutex; // Held while a request or an unload uses `stack`
+        std::unique_ptr<LlamaStack> stack; // Null while unloaded
+        // Guarded by `queue_mutex`
+        std::deque<Request> pending; // Waiting to be served, in arrival order
+        bool scheduled = false; // In `ready`, or a worker is serving one of its requests
+        std::shared_ptr<CancelToken> running; // Of the completion being served
+        // Guarded by `sessions_mutex`
+        size_t users = 0; // Requests pending or served, and unloads
+        bool loaded = false;
+        size_t bytes = 0;
+        Clock::time_point last_used;
+    };
+
+    struct Connection {
+        int fd = -1;
+        std::string in; // Received, not yet parsed
+        std::string out; // Response bytes not yet sent
+        size_t out_offset = 0;
+        bool busy = false; // A worker holds its request
+        bool keep_alive = true;
+        bool continue_sent = false; // "100 Continue" answered for the request in `in`
+        bool closing = false; // Close once `out` is sent
+    };
+
+    void io_loop();
+    void accept_connections();
+    void read_from(uint64_t id, Connection& connection);
+    void write_to(Connection& connection);
+    // Parse one complete request from `connection.in` and queue it
+    void parse_request(uint64_t id, Connection& connection);
+
+    void work();
+    // Route a request; returns the complete HTTP response
+    std::string dispatch(const Request& request);
+    void handle_session(const std::string& id, const std::string& action, const Request& request,
+                        int& status, nlohmann::json& reply);
+    // Cancel the session's completion in progress and those pending behind
+    // it; returns whether there were any
+    bool cancel_completion(const std::string& id);
+
+    // Pin the session so it is not unloaded; creates the entry if needed
+    std::shared_ptr<Session> acquire(const std::string& id);
+    // Unpin it, updating its memory estimate if it has a stack
+    void release(const std::string& id, const std::shared_ptr<Session>& session, bool has_stack, bool loaded_now,
+                 size_t bytes);
+    // Drop the entry of an unloaded session nobody holds; needs `sessions_mutex`
+    void forget_if_unused(const std::string& id, const std::shared_ptr<Session>& session);
+    // Unload least recently used idle sessions while over the memory budget,
+    // and any session idle for longer than `idle_seconds`
+    void unload_idle();
+    void unload_all();
+    std::string memory_file(const std::string& id) const;
+
+    DaemonOptions options;
+    StackFactory factory;
+    Metrics* metrics;
+    std::mutex metrics_mutex; // Metrics is not thread-safe
+    Endpoint endpoint;
+    int listen_fd = -1;
+    int wake_fds[2] = {-1, -1}; // Workers wake the I/O thread through this pipe
+    uint16_t bound_port = 0;
+    std::atomic<bool> stopping{false};
+    std::thread io_thread;
+    std::vector<std::thread> workers;
+    std::map<uint64_t, Connection> connections; // I/O thread only
+    uint64_t next_connection = 1;
+
+    std::mutex queue_mutex; // Guards `queue`, `ready`, `finished` and the sessions' queues
+    std::condition_variable queue_ready;
+    std::deque<Request> queue; // Requests outside any session
+    std::deque<std::shared_ptr<Session>> ready; // Sessions with pending requests and no worker, in turn
+    std::vector<std::pair<uint64_t, std::string>> finished; // Responses for the I/O thread to send
+
+    mutable std::mutex sessions_mutex; // Guards `sessions`, the Session bookkeeping and `counts`
+    std::unordered_map<std::string, std::shared_ptr<Session>> sessions;
+    Counters counts;
+    Clock::time_point last_sweep;
+};
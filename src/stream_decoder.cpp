@@ -0,0 +1,65 @@
+#include "stream_decoder.hpp"
+
+void StreamDecoder::feed(const char* data, size_t len) {
+    pending.append(data, len);
+    size_t line_start = 0;
+    size_t pos;
+    while ((pos = pending.find('\n', scan_from)) != std::string::npos) {
+        decode_line(pending.data() + line_start, pending.data() + pos);
+        line_start = pos + 1;
+        scan_from = line_start;
+    }
+    if (line_start > 0) {
+        pending.erase(0, line_start);
+    }
+    scan_from = pending.size();
+}
+
+void StreamDecoder::finish() {
+    if (!pending.empty()) {
+        decode_line(pending.data(), pending.data() + pending.size());
+        pending.clear();
+    }
+    scan_from = 0;
+}
+
+void StreamDecoder::decode_line(const char* begin, const char* end) {
+    while (begin < end && (end[-1] == '\r' || end[-1] == ' ')) --end;
+    if (begin == end) return;
+    auto parse_start = std::chrono::steady_clock::now();
+    decode_generate_response(begin, end, line, keep_context);
+    parse_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - parse_start).count();
+    if (!line.error.empty()) {
+        error = std::move(line.error);
+        return;
+    }
+    if (!line.response.empty()) {
+        if (!got_first_token) {
+            first_token_time = std::chrono::steady_clock::now();
+            got_first_token = true;
+        }
+        assembled += line.response;
+        if (on_token) on_token(line.response);
+    }
+    if (line.done) {
+        done = true;
+        eval_count = line.eval_count;
+        eval_duration = line.eval_duration;
+        prompt_eval_count = line.prompt_eval_count;
+        prompt_eval_duration = line.prompt_eval_duration;
+        load_duration = line.load_duration;
+        total_duration = line.total_duration;
+        context = std::move(line.context);
+    }
+}
+
+size_t StreamCallback(void* contents, size_t size, size_t nmemb, StreamDecoder* decoder) {
+    size_t total_size = size * nmemb;
+    try {
+        decoder->feed(static_cast<char*>(contents), total_size);
+    } catch (const std::exception& e) {
+        decoder->error = std::string("Malformed stream chunk: ") + e.what();
+        return 0; // Abort the transfer
+    }
+    return total_size;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "response_decoder.hpp"
+
+// Incremental decoder for Ollama's streamed NDJSON output.
+// Each complete line is parsed exactly once; partial lines stay in `pending`
+// and only the newly received bytes are scanned for the next newline. Lines
+// are decoded by decode_generate_response() into one reused buffer.
+struct StreamDecoder {
+    std::string pending; // Bytes received but not yet terminated by '\n'
+    size_t scan_from = 0; // Offset in `pending` already searched for '\n'
+    std::string assembled; // Concatenated `response` fragments
+    std::string error; // Server-side error reported in the stream
+    bool done = false;
+    long long eval_count = 0;
+    long long eval_duration = 0; // Nanoseconds
+    long long prompt_eval_count = 0;
+    long long prompt_eval_duration = 0; // Nanoseconds
+    long long load_duration = 0; // Nanoseconds
+    long long total_duration = 0; // Nanoseconds
+    double parse_ms = 0.0; // Time spent parsing lines
+    std::vector<int> context; // KV context returned with the final chunk
+    bool keep_context = true; // Clear to skip decoding `context`
+    std::chrono::steady_clock::time_point first_token_time;
+    bool got_first_token = false;
+    std::function<void(const std::string&)> on_token;
+
+    void feed(const char* data, size_t len);
+
+    // Flush a trailing line that was not newline-terminated
+    void finish();
+
+private:
+    void decode_line(const char* begin, const char* end);
+
+    GenerateResponse line; // Fields of the line being decoded
+};
+
+// Callback function to feed streamed cURL data into a StreamDecoder
+size_t StreamCallback(void* contents, size_t size, size_t nmemb, StreamDecoder* decoder);
@@ -0,0 +1,438 @@
+#include "tokenizer.hpp"
+
+#include <climits>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+// Character classes used by the pre-tokenizer
+enum CharClass : uint8_t { OTHER, LETTER, DIGIT, SPACE, NEWLINE };
+
+// Decode one UTF-8 code point at `i`, storing its length in `len`.
+// Invalid bytes decode as themselves with length 1.
+uint32_t decode_utf8(std::string_view s, size_t i, size_t& len) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    uint32_t cp;
+    if (c < 0x80) {
+        len = 1;
+        return c;
+    } else if ((c >> 5) == 0x6) {
+        len = 2;
+        cp = c & 0x1f;
+    } else if ((c >> 4) == 0xe) {
+        len = 3;
+        cp = c & 0x0f;
+    } else if ((c >> 3) == 0x1e) {
+        len = 4;
+        cp = c & 0x07;
+    } else {
+        len = 1;
+        return c;
+    }
+    if (i + len > s.size()) {
+        len = 1;
+        return c;
+    }
+    for (size_t k = 1; k < len; ++k) {
+        unsigned char cc = static_cast<unsigned char>(s[i + k]);
+        if ((cc >> 6) != 0x2) {
+            len = 1;
+            return c;
+        }
+        cp = (cp << 6) | (cc & 0x3f);
+    }
+    return cp;
+}
+
+// Approximates \p{L}, \p{N} and \s. Non-ASCII code points count as letters
+// except for the common Unicode space and punctuation blocks.
+CharClass classify(uint32_t cp) {
+    if (cp < 0x80) {
+        if (cp == '\n' || cp == '\r') return NEWLINE;
+        if (cp == ' ' || (cp >= '\t' && cp <= '\f')) return SPACE;
+        if ((cp | 0x20) >= 'a' && (cp | 0x20) <= 'z') return LETTER;
+        if (cp >= '0' && cp <= '9') return DIGIT;
+        return OTHER;
+    }
+    if (cp == 0x85 || cp == 0xa0 || cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200a) ||
+        cp == 0x2028 || cp == 0x2029 || cp == 0x202f || cp == 0x205f || cp == 0x3000) {
+        return SPACE;
+    }
+    if ((cp >= 0x80 && cp <= 0xbf && cp != 0xaa && cp != 0xb5 && cp != 0xba) || cp == 0xd7 || cp == 0xf7 ||
+        (cp >= 0x2000 && cp <= 0x2bff) || (cp >= 0x3000 && cp <= 0x303f) ||
+        (cp >= 0xfe30 && cp <= 0xfe4f) || (cp >= 0xff00 && cp <= 0xff0f) || (cp >= 0x1f000 && cp <= 0x1faff)) {
+        return OTHER;
+    }
+    if (cp >= 0xff10 && cp <= 0xff19) return DIGIT;
+    return LETTER;
+}
+
+// Classes of the ASCII range, looked up without decoding
+const struct AsciiClasses {
+    CharClass table[128];
+    AsciiClasses() {
+        for (uint32_t c = 0; c < 128; ++c) table[c] = classify(c);
+    }
+} ASCII_CLASSES;
+
+struct Scanner {
+    std::string_view s;
+
+    CharClass at(size_t i, size_t& len) const {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c < 0x80) {
+            len = 1;
+            return ASCII_CLASSES.table[c];
+        }
+        return classify(decode_utf8(s, i, len));
+    }
+
+    // End of the run of characters of class `cls` starting at `i`
+    size_t run(size_t i, CharClass cls) const {
+        size_t len;
+        while (i < s.size() && at(i, len) == cls) i += len;
+        return i;
+    }
+
+    bool is_space(size_t i, size_t& len) const {
+        CharClass cls = at(i, len);
+        return cls == SPACE || cls == NEWLINE;
+    }
+};
+
+// Length of a contraction ('s, 't, 're, 've, 'm, 'll, 'd) at `i`, or 0
+size_t contraction(std::string_view s, size_t i) {
+    if (s[i] != '\'' || i + 1 >= s.size()) return 0;
+    char a = static_cast<char>(s[i + 1] | 0x20);
+    if (a == 's' || a == 't' || a == 'm' || a == 'd') return 2;
+    if (i + 2 >= s.size()) return 0;
+    char b = static_cast<char>(s[i + 2] | 0x20);
+    if ((a == 'r' && b == 'e') || (a == 'v' && b == 'e') || (a == 'l' && b == 'l')) return 3;
+    return 0;
+}
+
+// GPT-2 byte-level alphabet: printable bytes map to themselves, the rest to U+0100 onwards
+int unicode_to_byte(uint32_t cp) {
+    static int table[324];
+    static bool initialized = [] {
+        for (int& entry : table) entry = -1;
+        int next = 256;
+        for (int b = 0; b < 256; ++b) {
+            bool printable = (b >= 33 && b <= 126) || (b >= 161 && b <= 172) || (b >= 174 && b <= 255);
+            table[printable ? b : next++] = b;
+        }
+        return true;
+    }();
+    (void)initialized;
+    return cp < 324 ? table[cp] : -1;
+}
+
+// Decode a byte-level vocabulary entry back to raw bytes
+bool decode_byte_level(const std::string& token, std::string& bytes) {
+    bytes.clear();
+    for (size_t i = 0; i < token.size();) {
+        size_t len;
+        int b = unicode_to_byte(decode_utf8(token, i, len));
+        if (b < 0) return false;
+        bytes += static_cast<char>(b);
+        i += len;
+    }
+    return true;
+}
+
+std::string decode_base64(std::string_view in) {
+    static const std::string ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    uint32_t buffer = 0;
+    int bits = 0;
+    for (char c : in) {
+        if (c == '=') break;
+        size_t v = ALPHABET.find(c);
+        if (v == std::string::npos) throw std::runtime_error("invalid base64 in tokenizer file");
+        buffer = (buffer << 6) | static_cast<uint32_t>(v);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out += static_cast<char>((buffer >> bits) & 0xff);
+        }
+    }
+    return out;
+}
+
+// Call `emit` with each pre-tokenization piece of `s`, following the Llama 3 split pattern
+template <typename Emit>
+void split_pieces(std::string_view s, Emit&& emit) {
+    Scanner sc{s};
+    size_t i = 0;
+    while (i < s.size()) {
+        size_t len;
+        CharClass cls = sc.at(i, len);
+        size_t end;
+        size_t next_len = 0;
+        CharClass next = i + len < s.size() ? sc.at(i + len, next_len) : OTHER;
+
+        if (size_t n = contraction(s, i)) {
+            // 's 't 're 've 'm 'll 'd
+            end = i + n;
+        } else if (cls == LETTER) {
+            // \p{L}+
+            end = sc.run(i, LETTER);
+        } else if (cls != NEWLINE && cls != DIGIT && next == LETTER) {
+            // [^\r\n\p{L}\p{N}]\p{L}+
+            end = sc.run(i + len, LETTER);
+        } else if (cls == DIGIT) {
+            // \p{N}{1,3}
+            end = i;
+            for (int k = 0; k < 3 && end < s.size() && sc.at(end, len) == DIGIT; ++k) end += len;
+        } else if (cls == OTHER || (s[i] == ' ' && next == OTHER)) {
+            // ' ?[^\s\p{L}\p{N}]+[\r\n]*'
+            end = cls == OTHER ? i : i + 1;
+            end = sc.run(end, OTHER);
+            end = sc.run(end, NEWLINE);
+        } else {
+            // Whitespace: \s*[\r\n]+ | \s+(?!\S) | \s+
+            size_t ws_end = i;
+            size_t last_newline_end = 0;
+            while (ws_end < s.size() && sc.is_space(ws_end, len)) {
+                if (s[ws_end] == '\n' || s[ws_end] == '\r') last_newline_end = ws_end + len;
+                ws_end += len;
+            }
+            if (last_newline_end > 0) {
+                end = last_newline_end;
+            } else if (ws_end == s.size()) {
+                end = ws_end;
+            } else {
+                // Leave the last whitespace character to prefix the next word
+                size_t last = ws_end - 1;
+                while (last > i && (static_cast<unsigned char>(s[last]) & 0xc0) == 0x80) --last;
+                end = last > i ? last : ws_end;
+            }
+        }
+        emit(s.substr(i, end - i));
+        i = end;
+    }
+}
+
+} // namespace
+
+void BpeTokenizer::pre_tokenize(std::string_view s, std::vector<std::string_view>& pieces) {
+    split_pieces(s, [&](std::string_view piece) { pieces.push_back(piece); });
+}
+
+void BpeTokenizer::MergeTable::reserve(size_t expected) {
+    size_t capacity = 16;
+    int bits = 4;
+    while (capacity < expected * 2) {
+        capacity <<= 1;
+        ++bits;
+    }
+    if (capacity <= keys.size()) return;
+    std::vector<uint64_t> old_keys = std::move(keys);
+    std::vector<Merge> old_values = std::move(values);
+    keys.assign(capacity, EMPTY);
+    values.assign(capacity, Merge{0, 0});
+    mask = capacity - 1;
+    shift = 64 - bits;
+    count = 0;
+    for (size_t i = 0; i < old_keys.size(); ++i) {
+        if (old_keys[i] != EMPTY) insert(old_keys[i], old_values[i]);
+    }
+}
+
+void BpeTokenizer::MergeTable::insert(uint64_t key, Merge merge) {
+    if ((count + 1) * 2 > keys.size()) reserve(count + 1);
+    for (size_t slot = hash(key);; slot = (slot + 1) & mask) {
+        if (keys[slot] == key) return;
+        if (keys[slot] == EMPTY) {
+            keys[slot] = key;
+            values[slot] = merge;
+            ++count;
+            return;
+        }
+    }
+}
+
+void BpeTokenizer::add_token(std::string bytes, int id) {
+    ids.emplace(std::move(bytes), id);
+}
+
+void BpeTokenizer::finalize() {
+    for (int b = 0; b < 256; ++b) {
+        auto it = ids.find(std::string(1, static_cast<char>(b)));
+        byte_ids[b] = it == ids.end() ? -1 : it->second;
+    }
+}
+
+void BpeTokenizer::merges_from_splits() {
+    // A pair (L, R) merges into L+R with the rank of L+R; every split of
+    // every token into two known tokens is such a pair.
+    merges.reserve(ids.size() * 2);
+    for (const auto& [bytes, id] : ids) {
+        const std::string_view view = bytes;
+        for (size_t k = 1; k < view.size(); ++k) {
+            auto left = ids.find(view.substr(0, k));
+            if (left == ids.end()) continue;
+            auto right = ids.find(view.substr(k));
+            if (right == ids.end()) continue;
+            merges.insert(pair_key(left->second, right->second), Merge{id, id});
+        }
+    }
+}
+
+std::unique_ptr<BpeTokenizer> BpeTokenizer::from_ranks(const std::vector<std::string>& tokens) {
+    auto tokenizer = std::unique_ptr<BpeTokenizer>(new BpeTokenizer());
+    tokenizer->ids.reserve(tokens.size());
+    for (size_t rank = 0; rank < tokens.size(); ++rank) {
+        tokenizer->add_token(tokens[rank], static_cast<int>(rank));
+    }
+    tokenizer->merges_from_splits();
+    tokenizer->finalize();
+    return tokenizer;
+}
+
+std::unique_ptr<BpeTokenizer> BpeTokenizer::load(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.is_open()) {
+        throw std::runtime_error("cannot open tokenizer file " + path);
+    }
+    std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    size_t first = data.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+        throw std::runtime_error("empty tokenizer file " + path);
+    }
+
+    if (data[first] != '{') {
+        // tiktoken: "<base64 token> <rank>" per line
+        std::vector<std::string> tokens;
+        std::istringstream lines(data);
+        std::string encoded;
+        size_t rank;
+        while (lines >> encoded >> rank) {
+            if (rank >= tokens.size()) tokens.resize(rank + 1);
+            tokens[rank] = decode_base64(encoded);
+        }
+        return from_ranks(tokens);
+    }
+
+    // Hugging Face tokenizer.json with a byte-level BPE model
+    json root = json::parse(data);
+    const json& model = root.at("model");
+    if (model.value("type", "BPE") != "BPE") {
+        throw std::runtime_error("tokenizer model is not BPE");
+    }
+    auto tokenizer = std::unique_ptr<BpeTokenizer>(new BpeTokenizer());
+    std::vector<std::string> by_id;
+    std::string bytes;
+    for (const auto& [token, id] : model.at("vocab").items()) {
+        if (!decode_byte_level(token, bytes)) {
+            throw std::runtime_error("tokenizer vocabulary is not byte-level BPE");
+        }
+        int token_id = id.get<int>();
+        if (token_id >= static_cast<int>(by_id.size())) by_id.resize(token_id + 1);
+        by_id[token_id] = bytes;
+        tokenizer->add_token(bytes, token_id);
+    }
+    int rank = 0;
+    std::string left, right;
+    for (const auto& merge : model.at("merges")) {
+        std::string a, b;
+        if (merge.is_array()) {
+            a = merge.at(0).get<std::string>();
+            b = merge.at(1).get<std::string>();
+        } else {
+            const std::string text = merge.get<std::string>();
+            size_t space = text.find(' ');
+            if (space == std::string::npos) continue;
+            a = text.substr(0, space);
+            b = text.substr(space + 1);
+        }
+        if (!decode_byte_level(a, left) || !decode_byte_level(b, right)) continue;
+        auto l = tokenizer->ids.find(left);
+        auto r = tokenizer->ids.find(right);
+        auto m = tokenizer->ids.find(left + right);
+        if (l == tokenizer->ids.end() || r == tokenizer->ids.end() || m == tokenizer->ids.end()) continue;
+        tokenizer->merges.insert(pair_key(l->second, r->second), Merge{rank++, m->second});
+    }
+    tokenizer->finalize();
+    return tokenizer;
+}
+
+void BpeTokenizer::encode_piece(std::string_view piece, std::vector<int>& out, std::vector<int>& scratch) const {
+    // Whole-piece hit: most common words are a single token
+    if (piece.size() > 1) {
+        auto it = ids.find(piece);
+        if (it != ids.end()) {
+            out.push_back(it->second);
+            return;
+        }
+    }
+
+    size_t start = out.size();
+    for (unsigned char c : piece) {
+        out.push_back(byte_ids[c]);
+    }
+    if (piece.size() < 2) return;
+
+    // rank[i] is the merge rank of (tokens[i], tokens[i + 1]); only the
+    // neighbours of a merge need to be looked up again.
+    int* tokens = out.data() + start;
+    size_t n = piece.size();
+    scratch.resize(2 * (n - 1));
+    int* rank = scratch.data();
+    int* merged = rank + (n - 1);
+    auto lookup = [&](size_t i) {
+        const Merge* merge = merges.find(pair_key(tokens[i], tokens[i + 1]));
+        if (!merge) {
+            rank[i] = INT_MAX;
+        } else {
+            rank[i] = merge->rank;
+            merged[i] = merge->id;
+        }
+    };
+    for (size_t i = 0; i + 1 < n; ++i) lookup(i);
+
+    while (n > 1) {
+        size_t best = 0;
+        for (size_t i = 1; i + 1 < n; ++i) {
+            if (rank[i] < rank[best]) best = i;
+        }
+        if (rank[best] == INT_MAX) break;
+        tokens[best] = merged[best];
+        for (size_t i = best + 1; i + 1 < n; ++i) {
+            tokens[i] = tokens[i + 1];
+            rank[i] = rank[i + 1];
+            merged[i] = merged[i + 1];
+        }
+        --n;
+        if (best + 1 < n) lookup(best);
+        else rank[best] = INT_MAX;
+        if (best > 0) lookup(best - 1);
+    }
+    out.resize(start + n);
+}
+
+std::vector<int> BpeTokenizer::encode(std::string_view text) const {
+    std::vector<int> out, scratch;
+    out.reserve(text.size() / 3 + 1);
+    split_pieces(text, [&](std::string_view piece) {
+        encode_piece(piece, out, scratch);
+    });
+    return out;
+}
+
+size_t BpeTokenizer::count(std::string_view text) const {
+    std::vector<int> tokens, scratch;
+    size_t total = 0;
+    split_pieces(text, [&](std::string_view piece) {
+        tokens.clear();
+        encode_piece(piece, tokens, scratch);
+        total += tokens.size();
+    });
+    return total;
+}
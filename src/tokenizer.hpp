@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Byte-level BPE tokenizer, compatible with the vocabularies of Llama 3 and
+// other tiktoken/GPT-style models.
+// Text is split by a hand-written pre-tokenizer that follows the Llama 3
+// split pattern, then each piece is merged bottom-up from single bytes using
+// a hash table keyed by adjacent token pairs.
+class BpeTokenizer {
+public:
+    // Load a Hugging Face `tokenizer.json` or a tiktoken rank file
+    // (`<base64 token> <rank>` per line). Throws std::runtime_error.
+    static std::unique_ptr<BpeTokenizer> load(const std::string& path);
+
+    // Build from raw byte tokens ordered by merge rank, tiktoken style
+    static std::unique_ptr<BpeTokenizer> from_ranks(const std::vector<std::string>& tokens);
+
+    std::vector<int> encode(std::string_view text) const;
+    size_t count(std::string_view text) const;
+    size_t vocab_size() const { return ids.size(); }
+
+    // Split text into pre-tokenization pieces
+    static void pre_tokenize(std::string_view text, std::vector<std::string_view>& pieces);
+
+private:
+    struct Merge {
+        int rank;
+        int id; // Token produced by the merge
+    };
+
+    // Open-addressing hash table from adjacent token pairs to their merge.
+    // Probed once per pair on the hot path, so it stays flat and branch-light.
+    class MergeTable {
+    public:
+        void reserve(size_t count);
+        // Keeps the first merge inserted for a pair
+        void insert(uint64_t key, Merge merge);
+        const Merge* find(uint64_t key) const {
+            if (keys.empty()) return nullptr;
+            for (size_t slot = hash(key);; slot = (slot + 1) & mask) {
+                if (keys[slot] == key) return &values[slot];
+                if (keys[slot] == EMPTY) return nullptr;
+            }
+        }
+        size_t size() const { return count; }
+
+    private:
+        static constexpr uint64_t EMPTY = ~0ULL;
+        // Fibonacci hashing: the top bits of the product mix both halves of the pair
+        size_t hash(uint64_t key) const { return static_cast<size_t>((key * 0x9e3779b97f4a7c15ULL) >> shift); }
+
+        std::vector<uint64_t> keys;
+        std::vector<Merge> values;
+        size_t mask = 0;
+        int shift = 64;
+        size_t count = 0;
+    };
+
+    static uint64_t pair_key(int left, int right) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(left)) << 32) | static_cast<uint32_t>(right);
+    }
+
+    void add_token(std::string bytes, int id);
+    void finalize();
+    void merges_from_splits(); // Derive pair merges from token ranks
+    void encode_piece(std::string_view piece, std::vector<int>& out, std::vector<int>& scratch) const;
+
+    // Allows looking up std::string keys by std::string_view without a copy
+    struct BytesHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view bytes) const { return std::hash<std::string_view>{}(bytes); }
+    };
+
+    std::unordered_map<std::string, int, BytesHash, std::equal_to<>> ids; // Raw token bytes -> id
+    MergeTable merges; // (left, right) -> merged token
+    int byte_ids[256];
+};
@@ -0,0 +1,221 @@
+#include "tool_executor.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <stdio.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+namespace {
+
+const size_t READ_BLOCK = 64 * 1024;
+
+// Keep what fits under the cap and count the rest
+void append_capped(ToolResult& result, const char* data, size_t len, size_t max_output) {
+    result.bytes += len;
+    size_t room = result.output.size() < max_output ? max_output - result.output.size() : 0;
+    if (len > room) result.truncated = true;
+    result.output.append(data, std::min(len, room));
+}
+
+} // namespace
+
+ToolExecutor::ToolExecutor(size_t workers, std::chrono::milliseconds timeout, size_t max_output)
+    : max_workers(std::max<size_t>(workers, 1)), default_timeout(timeout), max_output(max_output) {}
+
+ToolExecutor::~ToolExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ToolExecutor::add(const std::string& name, Handler handler, std::chrono::milliseconds timeout) {
+    tools[name] = {std::move(handler), timeout.count() > 0 ? timeout : default_timeout};
+}
+
+std::future<ToolResult> ToolExecutor::submit(ToolCall call, Clock::time_point deadline, const CancelToken* cancel) {
+    std::packaged_task<ToolResult()> task(
+        [this, call = std::move(call), deadline, cancel]() { return run(call, deadline, cancel); });
+    std::future<ToolResult> result = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(task));
+        if (idle < queue.size() && workers.size() < max_workers) {
+            workers.emplace_back(&ToolExecutor::work, this);
+        }
+    }
+    wake.notify_one();
+    return result;
+}
+
+std::vector<ToolResult> ToolExecutor::run_all(const std::vector<ToolCall>& calls, Clock::time_point deadline,
+                                              const CancelToken* cancel) {
+    std::vector<std::future<ToolResult>> pending;
+    pending.reserve(calls.size());
+    for (const auto& call : calls) pending.push_back(submit(call, deadline, cancel));
+    std::vector<ToolResult> results;
+    results.reserve(calls.size());
+    for (auto& result : pending) results.push_back(result.get());
+    return results;
+}
+
+ToolResult ToolExecutor::run(const ToolCall& call, Clock::time_point deadline, const CancelToken* cancel) {
+    auto start = Clock::now();
+    ToolResult result;
+    auto it = tools.find(call.name);
+    if (it == tools.end()) {
+        result.output = "Unknown tool: " + call.name;
+        result.failed = true;
+    } else if (cancel && cancel->cancelled()) {
+        // Cancelled while queued behind other calls
+        result.output = "Cancelled";
+        result.cancelled = true;
+        result.failed = true;
+    } else {
+        try {
+            // A zero timeout leaves only the caller's deadline
+            const auto timeout = it->second.timeout;
+            result = it->second.handler(call.arguments, timeout.count() > 0 ? std::min(start + timeout, deadline)
+                                                                            : deadline,
+                                        max_output, cancel);
+        } catch (const std::exception& e) {
+            result.output = "Error: " + std::string(e.what());
+            result.failed = true;
+        }
+    }
+    result.name = call.name;
+    result.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return result;
+}
+
+void ToolExecutor::work() {
+    while (true) {
+        std::packaged_task<ToolResult()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ++idle;
+            wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+            --idle;
+            if (queue.empty()) return;
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        task();
+    }
+}
+
+#ifdef _WIN32
+
+// Without process groups or pollable pipes the deadline is not enforced
+// here; the output cap and block reads still apply
+ToolResult run_shell_command(const std::string& command, ToolExecutor::Clock::time_point, size_t max_output,
+                             const CancelToken*) {
+    ToolResult result;
+    FILE* pipe = _popen(command.c_str(), "r");
+    if (!pipe) throw std::runtime_error("failed to run command");
+    std::vector<char> buffer(READ_BLOCK);
+    size_t n;
+    while ((n = std::fread(buffer.data(), 1, buffer.size(), pipe)) > 0) {
+        append_capped(result, buffer.data(), n, max_output);
+    }
+    int status = _pclose(pipe);
+    result.failed = status != 0;
+    return result;
+}
+
+#else
+
+ToolResult run_shell_command(const std::string& command, ToolExecutor::Clock::time_point deadline, size_t max_output,
+                             const CancelToken* cancel) {
+    // Close-on-exec, so commands spawned in parallel do not inherit each
+    // other's pipes and hold them open
+    int fds[2];
+#ifdef __linux__
+    if (::pipe2(fds, O_CLOEXEC) != 0) throw std::runtime_error("failed to create pipe");
+#else
+    if (::pipe(fds) != 0) throw std::runtime_error("failed to create pipe");
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+    // posix_spawn rather than fork: safe while other threads hold locks
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    // Own group, so a timeout or cancel kills its children too. That also
+    // keeps the terminal's SIGINT away from it, so a cancel kills it here.
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+    const char* argv[] = {"sh", "-c", command.c_str(), nullptr};
+    pid_t pid;
+    int spawned = posix_spawn(&pid, "/bin/sh", &actions, &attributes, const_cast<char**>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    ::close(fds[1]);
+    if (spawned != 0) {
+        ::close(fds[0]);
+        throw std::runtime_error("failed to run command");
+    }
+
+    ToolResult result;
+    std::vector<char> buffer(READ_BLOCK);
+    const long long poll_ms = cancel ? CancelToken::POLL_MS : 1000;
+    auto stopped = [&]() {
+        if (cancel && cancel->cancelled()) {
+            result.cancelled = true;
+        } else if (ToolExecutor::Clock::now() >= deadline) {
+            result.timed_out = true;
+        }
+        return result.cancelled || result.timed_out;
+    };
+    while (!stopped()) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - ToolExecutor::Clock::now());
+        pollfd pfd{fds[0], POLLIN, 0};
+        int ready = ::poll(&pfd, 1, static_cast<int>(std::clamp<long long>(remaining.count() + 1, 0, poll_ms)));
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) continue;
+        ssize_t n = ::read(fds[0], buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break; // EOF: the command closed its output
+        append_capped(result, buffer.data(), static_cast<size_t>(n), max_output);
+    }
+    ::close(fds[0]);
+
+    // The shell may outlive its output, so the deadline and cancel still apply
+    int status = 0;
+    while (!result.timed_out && !result.cancelled) {
+        pid_t done = ::waitpid(pid, &status, WNOHANG);
+        if (done == pid || (done < 0 && errno != EINTR)) break;
+        if (stopped()) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    const bool killed = result.timed_out || result.cancelled;
+    if (killed) {
+        ::kill(-pid, SIGKILL);
+        while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    }
+    result.failed = killed || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    if (!killed && WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        result.output += "\n[exit status " + std::to_string(WEXITSTATUS(status)) + "]";
+    }
+    return result;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cancel_token.hpp"
+
+// One tool invocation requested by the model
+struct ToolCall {
+    std::string name;
+    nlohmann::json arguments;
+};
+
+// Outcome of a ToolCall. `output` is what the model sees; it is capped at
+// the executor's output limit, while `bytes` counts everything produced.
+struct ToolResult {
+    std::string name;
+    std::string output;
+    double ms = 0.0;
+    size_t bytes = 0;
+    bool timed_out = false;
+    bool cancelled = false; // Stopped by the caller's CancelToken
+    bool truncated = false;
+    bool failed = false; // Unknown tool, bad arguments, non-zero exit, timeout or cancel
+};
+
+// Runs tool calls on a small pool of worker threads, each with a deadline
+// and an output cap. Workers start on first use, so a stack that never
+// calls a tool costs no threads.
+class ToolExecutor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Runs one call; must return by `deadline`, or soon after `cancel`
+    // fires when not null, and keep at most `max_output` bytes of output
+    using Handler = std::function<ToolResult(const nlohmann::json& args, Clock::time_point deadline, size_t max_output,
+                                             const CancelToken* cancel)>;
+
+    // `timeout` of zero puts no limit on a call beyond the caller's deadline
+    ToolExecutor(size_t workers, std::chrono::milliseconds timeout, size_t max_output);
+    ~ToolExecutor();
+    ToolExecutor(const ToolExecutor&) = delete;
+    ToolExecutor& operator=(const ToolExecutor&) = delete;
+
+    // Register a tool; `timeout` of zero uses the executor's default
+    void add(const std::string& name, Handler handler,
+             std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    bool has(const std::string& name) const { return tools.count(name) > 0; }
+
+    // Queue `call`. It stops at its tool's timeout or `deadline`, whichever
+    // comes first, or soon after `cancel` fires; `cancel` must outlive it.
+    std::future<ToolResult> submit(ToolCall call, Clock::time_point deadline = Clock::time_point::max(),
+                                   const CancelToken* cancel = nullptr);
+
+    // Run `calls` in parallel, as submit() does; results are in call order
+    std::vector<ToolResult> run_all(const std::vector<ToolCall>& calls,
+                                    Clock::time_point deadline = Clock::time_point::max(),
+                                    const CancelToken* cancel = nullptr);
+
+private:
+    struct Registered {
+        Handler handler;
+        std::chrono::milliseconds timeout;
+    };
+
+    ToolResult run(const ToolCall& call, Clock::time_point deadline, const CancelToken* cancel);
+    void work();
+
+    size_t max_workers;
+    std::chrono::milliseconds default_timeout;
+    size_t max_output;
+    std::map<std::string, Registered> tools;
+    std::mutex mutex; // Guards `queue`, `workers`, `idle` and `stopping`
+    std::condition_variable wake;
+    std::deque<std::packaged_task<ToolResult()>> queue;
+    std::vector<std::thread> workers;
+    size_t idle = 0; // Workers waiting for a task
+    bool stopping = false;
+};
+
+// Run `command` through the shell with stdin closed, reading stdout in large
+// blocks. The process group is killed at `deadline`, or within
+// CancelToken::POLL_MS of `cancel` firing. Output past `max_output` bytes
+// is counted and discarded.
+ToolResult run_shell_command(const std::string& command, ToolExecutor::Clock::time_point deadline, size_t max_output,
+                             const CancelToken* cancel = nullptr);
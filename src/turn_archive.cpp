@@ -0,0 +1,671 @@
+#include "turn_archive.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <iterator>
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+// Fixed part of a turn record; prompt and response follow
+struct RecordHeader {
+    uint32_t payload_size; // Bytes after this field
+    int32_t token_count;
+    int64_t time;
+    uint32_t prompt_size;
+    uint32_t response_size;
+};
+
+// Start of a segment file, followed by the term table (sorted by hash),
+// the archive offset and word count of each turn, and the postings: per
+// term, varint pairs of (id delta, term frequency), the first id relative
+// to `first`
+struct SegmentHeader {
+    char magic[8];
+    uint32_t first; // Id of the first turn covered
+    uint32_t count; // Turns covered
+    uint64_t archive_end; // Archive bytes covered by this and earlier segments
+    uint64_t term_count;
+    uint64_t total_length; // Words in the covered turns
+    uint64_t postings_size;
+};
+
+struct TermEntry {
+    uint64_t hash;
+    uint64_t offset; // Into the postings
+    uint32_t size; // Bytes of postings
+    uint32_t turns; // Turns containing the term
+};
+
+const char SEGMENT_MAGIC[8] = {'M', 'X', 'A', 'R', 'C', 'I', 'X', '1'};
+const size_t FLUSH_TURNS = 4096; // Turns indexed in memory before they become a segment
+const size_t MAX_QUERY_TERMS = 32;
+const size_t MAX_WORD_BYTES = 64; // Longer words are cut, e.g. base64 blobs
+const double BM25_K1 = 1.2;
+const double BM25_B = 0.75;
+
+// Hash of each word of `text`: runs of ASCII letters and digits or
+// non-ASCII bytes, compared without ASCII case. Single bytes are skipped.
+void add_words(std::string_view text, std::vector<uint64_t>& out) {
+    uint64_t hash = 0;
+    size_t length = 0;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        const unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+        const unsigned char lower = c | 0x20;
+        const bool letter = lower >= 'a' && lower <= 'z';
+        if (letter || (c >= '0' && c <= '9') || c >= 0x80) {
+            if (length == 0) hash = 1469598103934665603ULL; // FNV-1a
+            if (length++ < MAX_WORD_BYTES) hash = (hash ^ (letter ? lower : c)) * 1099511628211ULL;
+        } else {
+            if (length > 1) out.push_back(hash);
+            length = 0;
+        }
+    }
+}
+
+void put_varint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+bool get_varint(const unsigned char*& p, const unsigned char* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7) {
+        const unsigned char byte = *p++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Read-only view of a whole file. Mapped where mmap is available, so only
+// the pages a search touches are read; elsewhere read into memory.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifndef _WIN32
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + path);
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error("cannot map empty file " + path);
+        }
+        length = static_cast<size_t>(info.st_size);
+        void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) throw std::runtime_error("cannot map " + path);
+        bytes = static_cast<const char*>(mapped);
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in) throw std::runtime_error("cannot open " + path);
+        buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        bytes = buffer.data();
+        length = buffer.size();
+#endif
+    }
+    ~MappedFile() {
+#ifndef _WIN32
+        ::munmap(const_cast<char*>(bytes), length);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    std::string buffer;
+#endif
+};
+
+// Streams a segment file: turns first, then terms in hash order. The file
+// is written under a temporary name and renamed into place by finish().
+class SegmentWriter {
+public:
+    SegmentWriter(std::string path, uint32_t first, uint32_t count, uint64_t term_count, uint64_t archive_end)
+        : path(std::move(path)), tmp_path(this->path + ".tmp") {
+        std::memcpy(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+        header.first = first;
+        header.count = count;
+        header.archive_end = archive_end;
+        header.term_count = term_count;
+        header.total_length = 0;
+        header.postings_size = 0;
+        terms.reserve(term_count);
+        out = std::fopen(tmp_path.c_str(), "wb");
+        if (!out) throw std::runtime_error("cannot create archive index " + tmp_path);
+    }
+    ~SegmentWriter() {
+        if (out) {
+            std::fclose(out);
+            std::error_code ec;
+            std::filesystem::remove(tmp_path, ec);
+        }
+    }
+
+    // Append the offsets and word counts of the next `n` turns
+    void add_turns(const uint64_t* offsets, const uint32_t* lengths, size_t n) {
+        const uint64_t offsets_at = sizeof(SegmentHeader) + header.term_count * sizeof(TermEntry);
+        seek(offsets_at + turns_written * sizeof(uint64_t));
+        write(offsets, n * sizeof(uint64_t));
+        seek(offsets_at + uint64_t(header.count) * sizeof(uint64_t) + turns_written * sizeof(uint32_t));
+        write(lengths, n * sizeof(uint32_t));
+        for (size_t i = 0; i < n; ++i) header.total_length += lengths[i];
+        turns_written += n;
+    }
+
+    // Append a term whose postings were encoded relative to the segment
+    void add_term(uint64_t hash, uint32_t turns, std::string_view postings) {
+        if (terms.empty()) {
+            seek(sizeof(SegmentHeader) + header.term_count * sizeof(TermEntry) +
+                 uint64_t(header.count) * (sizeof(uint64_t) + sizeof(uint32_t)));
+        }
+        terms.push_back({hash, header.postings_size, static_cast<uint32_t>(postings.size()), turns});
+        write(postings.data(), postings.size());
+        header.postings_size += postings.size();
+    }
+
+    void finish() {
+        if (terms.size() != header.term_count || turns_written != header.count) {
+            throw std::logic_error("incomplete archive index segment");
+        }
+        seek(0);
+        write(&header, sizeof(header));
+        write(terms.data(), terms.size() * sizeof(TermEntry));
+        std::fflush(out);
+#ifndef _WIN32
+        fsync(fileno(out));
+#endif
+        const bool failed = std::ferror(out) != 0;
+        std::fclose(out);
+        out = nullptr;
+        if (failed) {
+            std::remove(tmp_path.c_str());
+            throw std::runtime_error("failed to write archive index " + tmp_path);
+        }
+        std::filesystem::rename(tmp_path, path);
+    }
+
+private:
+    void seek(uint64_t offset) {
+        if (std::fseek(out, static_cast<long>(offset), SEEK_SET) != 0) {
+            throw std::runtime_error("failed to write archive index " + tmp_path);
+        }
+    }
+    void write(const void* data, size_t size) {
+        if (size > 0 && std::fwrite(data, 1, size, out) != size) {
+            throw std::runtime_error("failed to write archive index " + tmp_path);
+        }
+    }
+
+    std::string path;
+    std::string tmp_path;
+    std::FILE* out = nullptr;
+    SegmentHeader header;
+    std::vector<TermEntry> terms;
+    size_t turns_written = 0;
+};
+
+} // namespace
+
+struct TurnArchive::Segment {
+    std::string path;
+    MappedFile file;
+    const SegmentHeader* header;
+    const TermEntry* terms;
+    const uint64_t* offsets;
+    const uint32_t* lengths;
+    const unsigned char* postings;
+
+    // Throws std::runtime_error unless the file is a complete segment
+    explicit Segment(std::string segment_path) : path(std::move(segment_path)), file(path) {
+        header = reinterpret_cast<const SegmentHeader*>(file.data());
+        if (file.size() < sizeof(SegmentHeader) || std::memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0) {
+            throw std::runtime_error("not an archive index: " + path);
+        }
+        const uint64_t expected = sizeof(SegmentHeader) + header->term_count * sizeof(TermEntry) +
+                                  uint64_t(header->count) * (sizeof(uint64_t) + sizeof(uint32_t)) + header->postings_size;
+        if (header->count == 0 || file.size() != expected) {
+            throw std::runtime_error("truncated archive index: " + path);
+        }
+        terms = reinterpret_cast<const TermEntry*>(file.data() + sizeof(SegmentHeader));
+        offsets = reinterpret_cast<const uint64_t*>(terms + header->term_count);
+        lengths = reinterpret_cast<const uint32_t*>(offsets + header->count);
+        postings = reinterpret_cast<const unsigned char*>(lengths + header->count);
+    }
+
+    uint32_t first() const { return header->first; }
+    uint32_t end() const { return header->first + header->count; }
+
+    const TermEntry* find(uint64_t hash) const {
+        const TermEntry* last = terms + header->term_count;
+        const TermEntry* it = std::lower_bound(terms, last, hash,
+                                               [](const TermEntry& entry, uint64_t h) { return entry.hash < h; });
+        return it != last && it->hash == hash ? it : nullptr;
+    }
+
+    // Call `fn(index, frequency)` for each turn containing the term, by
+    // index into this segment; stops at corrupt postings
+    template <typename Fn>
+    void for_each(const TermEntry& entry, Fn&& fn) const {
+        if (entry.offset + entry.size > header->postings_size) return;
+        const unsigned char* p = postings + entry.offset;
+        const unsigned char* end = p + entry.size;
+        uint32_t index = 0, delta = 0, frequency = 0;
+        for (bool first_posting = true; p < end; first_posting = false) {
+            if (!get_varint(p, end, delta) || !get_varint(p, end, frequency)) return;
+            index = first_posting ? delta : index + delta;
+            if (index >= header->count) return;
+            fn(index, frequency);
+        }
+    }
+};
+
+void to_json(json& out, const ArchiveHit& hit) {
+    out = {
+        {"id", hit.id},
+        {"score", hit.score},
+        {"time", hit.time},
+        {"prompt", hit.interaction.prompt},
+        {"response", hit.interaction.response},
+        {"token_count", hit.interaction.token_count}
+    };
+}
+
+void from_json(const json& in, ArchiveHit& hit) {
+    hit.id = in.value("id", uint32_t{0});
+    hit.score = in.value("score", 0.0);
+    hit.time = in.value("time", int64_t{0});
+    hit.interaction.prompt = in.value("prompt", "");
+    hit.interaction.response = in.value("response", "");
+    hit.interaction.token_count = in.value("token_count", 0);
+}
+
+TurnArchive::TurnArchive(std::string path) : path(std::move(path)), index_dir(this->path + ".index") {}
+
+TurnArchive::~TurnArchive() {
+    // Turns indexed in memory are indexed again on the next open, which is
+    // cheaper than leaving a small segment behind at every exit
+    if (out) std::fclose(out);
+}
+
+std::string TurnArchive::segment_path(uint32_t first, uint32_t end) const {
+    return (std::filesystem::path(index_dir) / (std::to_string(first) + "-" + std::to_string(end) + ".idx")).string();
+}
+
+void TurnArchive::open() {
+    namespace fs = std::filesystem;
+    std::vector<std::unique_ptr<Segment>> found;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(index_dir, ec)) {
+        if (entry.path().extension() == ".tmp") {
+            fs::remove(entry.path(), ec); // Left by an interrupted flush or merge
+        } else if (entry.path().extension() == ".idx") {
+            try {
+                found.push_back(std::make_unique<Segment>(entry.path().string()));
+            } catch (const std::exception& e) {
+                std::cerr << "Warning: Dropping archive index segment: " << e.what() << std::endl;
+                fs::remove(entry.path(), ec);
+            }
+        }
+    }
+
+    // Chain segments from id 0. An interrupted merge leaves its inputs next
+    // to the merged segment; the larger one wins and the rest are deleted.
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+        return a->first() != b->first() ? a->first() < b->first() : a->end() > b->end();
+    });
+    uint64_t covered = 0;
+    for (auto& segment : found) {
+        if (segment->first() == indexed_turns && segment->header->archive_end > covered) {
+            indexed_turns = segment->end();
+            indexed_length += segment->header->total_length;
+            covered = segment->header->archive_end;
+            segments.push_back(std::move(segment));
+        } else {
+            fs::remove(segment->path, ec);
+        }
+    }
+    const uint64_t archive_size = fs::exists(path, ec) ? fs::file_size(path, ec) : 0;
+    if (covered > archive_size) {
+        std::cerr << "Warning: Archive index does not match the archive, rebuilding." << std::endl;
+        drop_segments();
+        covered = 0;
+    }
+
+    // Index turns appended since the last segment
+    file_size = covered;
+    std::ifstream in(path, std::ios::binary);
+    if (in.is_open()) {
+        in.seekg(static_cast<std::streamoff>(covered));
+        RecordHeader header;
+        Interaction interaction;
+        while (file_size + sizeof(header) <= archive_size) {
+            if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) break;
+            const uint64_t expected = sizeof(header) - sizeof(uint32_t) + uint64_t(header.prompt_size) + header.response_size;
+            if (header.payload_size != expected || file_size + sizeof(uint32_t) + header.payload_size > archive_size) break;
+            interaction.prompt.resize(header.prompt_size);
+            interaction.response.resize(header.response_size);
+            if (!in.read(interaction.prompt.data(), header.prompt_size) ||
+                !in.read(interaction.response.data(), header.response_size)) {
+                break;
+            }
+            const uint64_t offset = file_size;
+            file_size += sizeof(uint32_t) + header.payload_size;
+            index_turn(interaction, offset);
+        }
+        in.close();
+        if (file_size < archive_size) {
+            std::cerr << "Warning: Truncating corrupt archive tail at byte " << file_size << std::endl;
+            fs::resize_file(path, file_size);
+        }
+    }
+
+    out = std::fopen(path.c_str(), "ab");
+    if (!out) {
+        throw std::runtime_error("cannot open archive " + path);
+    }
+    reader.open(path, std::ios::binary);
+}
+
+uint32_t TurnArchive::append(const Interaction& interaction, int64_t time) {
+    RecordHeader header;
+    header.token_count = interaction.token_count;
+    header.time = time;
+    header.prompt_size = static_cast<uint32_t>(interaction.prompt.size());
+    header.response_size = static_cast<uint32_t>(interaction.response.size());
+    header.payload_size = static_cast<uint32_t>(sizeof(header) - sizeof(uint32_t) + header.prompt_size + header.response_size);
+
+    std::fwrite(&header, sizeof(header), 1, out);
+    std::fwrite(interaction.prompt.data(), 1, interaction.prompt.size(), out);
+    std::fwrite(interaction.response.data(), 1, interaction.response.size(), out);
+    if (std::fflush(out) != 0 || std::ferror(out)) {
+        throw std::runtime_error("failed to append to archive " + path);
+    }
+    const uint64_t offset = file_size;
+    file_size += sizeof(uint32_t) + header.payload_size;
+    const auto id = static_cast<uint32_t>(size());
+    index_turn(interaction, offset);
+    return id;
+}
+
+void TurnArchive::index_turn(const Interaction& interaction, uint64_t offset) {
+    std::vector<uint64_t> words;
+    add_words(interaction.prompt, words);
+    add_words(interaction.response, words);
+    std::sort(words.begin(), words.end());
+    const auto id = static_cast<uint32_t>(size());
+    for (size_t i = 0; i < words.size();) {
+        size_t j = i + 1;
+        while (j < words.size() && words[j] == words[i]) ++j;
+        tail[words[i]].emplace_back(id, static_cast<uint32_t>(j - i));
+        i = j;
+    }
+    tail_offsets.push_back(offset);
+    tail_lengths.push_back(static_cast<uint32_t>(words.size()));
+    tail_length += words.size();
+    if (tail_offsets.size() >= FLUSH_TURNS) {
+        flush();
+    }
+}
+
+void TurnArchive::flush() {
+    if (tail_offsets.empty()) return;
+    const auto first = static_cast<uint32_t>(indexed_turns);
+    const auto count = static_cast<uint32_t>(tail_offsets.size());
+    std::vector<uint64_t> hashes;
+    hashes.reserve(tail.size());
+    for (const auto& term : tail) hashes.push_back(term.first);
+    std::sort(hashes.begin(), hashes.end());
+
+    std::filesystem::create_directories(index_dir);
+    const std::string segment_file = segment_path(first, first + count);
+    {
+        SegmentWriter writer(segment_file, first, count, hashes.size(), file_size);
+        writer.add_turns(tail_offsets.data(), tail_lengths.data(), count);
+        std::string encoded;
+        for (uint64_t hash : hashes) {
+            const Postings& postings = tail.at(hash);
+            encoded.clear();
+            uint32_t previous = first;
+            for (const auto& [id, frequency] : postings) {
+                put_varint(encoded, id - previous);
+                put_varint(encoded, frequency);
+                previous = id;
+            }
+            writer.add_term(hash, static_cast<uint32_t>(postings.size()), encoded);
+        }
+        writer.finish();
+    }
+    segments.push_back(std::make_unique<Segment>(segment_file));
+    indexed_turns += count;
+    indexed_length += tail_length;
+    tail.clear();
+    tail_offsets.clear();
+    tail_lengths.clear();
+    tail_length = 0;
+    merge_segments();
+}
+
+void TurnArchive::merge_segments() {
+    while (segments.size() >= 2) {
+        const Segment& older = *segments[segments.size() - 2];
+        const Segment& newer = *segments.back();
+        if (older.header->count > newer.header->count) break;
+
+        // Union of the two sorted term tables
+        uint64_t term_count = 0;
+        for (uint64_t i = 0, j = 0; i < older.header->term_count || j < newer.header->term_count; ++term_count) {
+            if (j == newer.header->term_count ||
+                (i < older.header->term_count && older.terms[i].hash < newer.terms[j].hash)) {
+                ++i;
+            } else if (i == older.header->term_count || newer.terms[j].hash < older.terms[i].hash) {
+                ++j;
+            } else {
+                ++i;
+                ++j;
+            }
+        }
+
+        const std::string merged_file = segment_path(older.first(), newer.end());
+        {
+            SegmentWriter writer(merged_file, older.first(), older.header->count + newer.header->count, term_count,
+                                 newer.header->archive_end);
+            writer.add_turns(older.offsets, older.lengths, older.header->count);
+            writer.add_turns(newer.offsets, newer.lengths, newer.header->count);
+            std::string encoded;
+            uint32_t previous = 0, turns = 0;
+            auto append = [&](const Segment& segment, const TermEntry& entry, uint32_t shift) {
+                segment.for_each(entry, [&](uint32_t index, uint32_t frequency) {
+                    const uint32_t merged = index + shift;
+                    put_varint(encoded, turns == 0 ? merged : merged - previous);
+                    put_varint(encoded, frequency);
+                    previous = merged;
+                    ++turns;
+                });
+            };
+            for (uint64_t i = 0, j = 0; i < older.header->term_count || j < newer.header->term_count;) {
+                encoded.clear();
+                previous = turns = 0;
+                uint64_t hash;
+                if (j == newer.header->term_count ||
+                    (i < older.header->term_count && older.terms[i].hash < newer.terms[j].hash)) {
+                    hash = older.terms[i].hash;
+                    append(older, older.terms[i++], 0);
+                } else if (i == older.header->term_count || newer.terms[j].hash < older.terms[i].hash) {
+                    hash = newer.terms[j].hash;
+                    append(newer, newer.terms[j++], older.header->count);
+                } else {
+                    hash = older.terms[i].hash;
+                    append(older, older.terms[i++], 0);
+                    append(newer, newer.terms[j++], older.header->count);
+                }
+                writer.add_term(hash, turns, encoded);
+            }
+            writer.finish();
+        }
+
+        auto merged = std::make_unique<Segment>(merged_file);
+        std::error_code ec;
+        for (size_t k = 0; k < 2; ++k) {
+            std::filesystem::remove(segments.back()->path, ec);
+            segments.pop_back();
+        }
+        segments.push_back(std::move(merged));
+    }
+}
+
+void TurnArchive::drop_segments() {
+    std::error_code ec;
+    for (const auto& segment : segments) {
+        std::filesystem::remove(segment->path, ec);
+    }
+    segments.clear();
+    indexed_turns = 0;
+    indexed_length = 0;
+}
+
+uint64_t TurnArchive::record_offset(uint32_t id) const {
+    if (id >= size()) throw std::out_of_range("no archived turn " + std::to_string(id));
+    if (id >= indexed_turns) return tail_offsets[id - indexed_turns];
+    auto it = std::upper_bound(segments.begin(), segments.end(), id,
+                               [](uint32_t value, const auto& segment) { return value < segment->first(); });
+    const Segment& segment = **(it - 1);
+    return segment.offsets[id - segment.first()];
+}
+
+ArchiveHit TurnArchive::read(uint32_t id) const {
+    RecordHeader header;
+    reader.clear();
+    reader.seekg(static_cast<std::streamoff>(record_offset(id)));
+    if (!reader.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        throw std::runtime_error("failed to read archive " + path);
+    }
+    ArchiveHit hit;
+    hit.id = id;
+    hit.time = header.time;
+    hit.interaction = {std::string(header.prompt_size, '\0'), std::string(header.response_size, '\0'), header.token_count};
+    reader.read(hit.interaction.prompt.data(), header.prompt_size);
+    reader.read(hit.interaction.response.data(), header.response_size);
+    if (!reader) {
+        throw std::runtime_error("failed to read archive " + path);
+    }
+    return hit;
+}
+
+std::vector<ArchiveHit> TurnArchive::search(std::string_view query, size_t k) const {
+    std::vector<uint64_t> words;
+    add_words(query, words);
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    if (words.size() > MAX_QUERY_TERMS) words.resize(MAX_QUERY_TERMS);
+    const size_t total = size();
+    if (words.empty() || total == 0 || k == 0) return {};
+
+    // Inverse document frequency over the whole archive
+    struct QueryTerm {
+        double idf = 0.0;
+        std::vector<const TermEntry*> entries; // Per segment, null where absent
+        const Postings* tail = nullptr;
+    };
+    std::vector<QueryTerm> query_terms;
+    for (uint64_t hash : words) {
+        QueryTerm term;
+        uint64_t turns = 0;
+        for (const auto& segment : segments) {
+            term.entries.push_back(segment->find(hash));
+            if (term.entries.back()) turns += term.entries.back()->turns;
+        }
+        auto it = tail.find(hash);
+        if (it != tail.end()) {
+            term.tail = &it->second;
+            turns += it->second.size();
+        }
+        if (turns == 0) continue;
+        term.idf = std::log(1.0 + (total - turns + 0.5) / (turns + 0.5));
+        query_terms.push_back(std::move(term));
+    }
+    if (query_terms.empty()) return {};
+
+    const double average_length = std::max(1.0, static_cast<double>(indexed_length + tail_length) / total);
+    auto weight = [&](double idf, uint32_t frequency, uint32_t length) {
+        const double norm = BM25_K1 * (1.0 - BM25_B + BM25_B * length / average_length);
+        return idf * frequency * (BM25_K1 + 1.0) / (frequency + norm);
+    };
+
+    // Scores accumulate densely per segment; the best `k` stay in a min-heap
+    std::vector<std::pair<double, uint32_t>> best;
+    auto worse = [](const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) {
+        return a.first != b.first ? a.first > b.first : a.second > b.second; // Newer wins ties
+    };
+    std::vector<float> scores;
+    std::vector<uint32_t> touched;
+    auto collect = [&](uint32_t first) {
+        for (uint32_t index : touched) {
+            const std::pair<double, uint32_t> candidate{scores[index], first + index};
+            scores[index] = 0.0f;
+            if (best.size() < k) {
+                best.push_back(candidate);
+                std::push_heap(best.begin(), best.end(), worse);
+            } else if (worse(candidate, best.front())) {
+                std::pop_heap(best.begin(), best.end(), worse);
+                best.back() = candidate;
+                std::push_heap(best.begin(), best.end(), worse);
+            }
+        }
+        touched.clear();
+    };
+    for (size_t s = 0; s < segments.size(); ++s) {
+        const Segment& segment = *segments[s];
+        if (scores.size() < segment.header->count) scores.resize(segment.header->count, 0.0f);
+        for (const auto& term : query_terms) {
+            if (!term.entries[s]) continue;
+            segment.for_each(*term.entries[s], [&](uint32_t index, uint32_t frequency) {
+                if (scores[index] == 0.0f) touched.push_back(index);
+                scores[index] += static_cast<float>(weight(term.idf, frequency, segment.lengths[index]));
+            });
+        }
+        collect(segment.first());
+    }
+    if (scores.size() < tail_offsets.size()) scores.resize(tail_offsets.size(), 0.0f);
+    for (const auto& term : query_terms) {
+        if (!term.tail) continue;
+        for (const auto& [id, frequency] : *term.tail) {
+            const uint32_t index = id - static_cast<uint32_t>(indexed_turns);
+            if (scores[index] == 0.0f) touched.push_back(index);
+            scores[index] += static_cast<float>(weight(term.idf, frequency, tail_lengths[index]));
+        }
+    }
+    collect(static_cast<uint32_t>(indexed_turns));
+
+    std::sort(best.begin(), best.end(), worse);
+    std::vector<ArchiveHit> hits;
+    for (const auto& [score, id] : best) {
+        ArchiveHit hit = read(id);
+        hit.score = score;
+        hits.push_back(std::move(hit));
+    }
+    return hits;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <nlohmann/json_fwd.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "interaction.hpp"
+
+// One archived turn returned by a search
+struct ArchiveHit {
+    uint32_t id = 0; // Position in the archive, oldest first
+    double score = 0.0; // BM25 relevance to the query
+    int64_t time = 0; // Unix time the turn was stored
+    Interaction interaction;
+};
+
+// JSON form of a hit, as returned by the daemon
+void to_json(nlohmann::json& out, const ArchiveHit& hit);
+void from_json(const nlohmann::json& in, ArchiveHit& hit);
+
+// Every turn ever stored, searchable by keywords. Turns are appended to
+// `path` (one binary record per turn) and never evicted. An inverted index
+// over their words lives in immutable segment files in `<path>.index/`,
+// each mapped into memory on open, so startup reads neither the archive
+// nor the postings. New turns are indexed in
+// memory and written out as a segment every few thousand turns; segments
+// of similar size are merged, so a few dozen cover millions of turns.
+// Search ranks turns by BM25 over all segments. Not thread-safe; each
+// LlamaStack owns the archive of its memory file.
+class TurnArchive {
+public:
+    explicit TurnArchive(std::string path);
+    ~TurnArchive();
+    TurnArchive(const TurnArchive&) = delete;
+    TurnArchive& operator=(const TurnArchive&) = delete;
+
+    // Map the index segments and index turns appended after the last one;
+    // a torn tail is truncated
+    void open();
+
+    size_t size() const { return indexed_turns + tail_offsets.size(); }
+    size_t segment_count() const { return segments.size(); }
+
+    // Store a turn stored at Unix time `time`; returns its id
+    uint32_t append(const Interaction& interaction, int64_t time);
+
+    // The `k` turns most relevant to the words of `query`, best first
+    std::vector<ArchiveHit> search(std::string_view query, size_t k) const;
+
+    ArchiveHit read(uint32_t id) const;
+
+    // Write the turns indexed in memory out as a segment
+    void flush();
+
+private:
+    struct Segment;
+    using Postings = std::vector<std::pair<uint32_t, uint32_t>>; // (id, term frequency), by id
+
+    uint64_t record_offset(uint32_t id) const;
+    void index_turn(const Interaction& interaction, uint64_t offset);
+    std::string segment_path(uint32_t first, uint32_t end) const;
+    // Merge the two newest segments while the older is no larger than the newer
+    void merge_segments();
+    // Unmap and delete every segment, so the index is rebuilt from the archive
+    void drop_segments();
+
+    std::string path;
+    std::string index_dir;
+    std::vector<std::unique_ptr<Segment>> segments; // Consecutive id ranges, oldest first
+    size_t indexed_turns = 0; // Turns covered by segments
+    uint64_t indexed_length = 0; // Words in those turns
+    std::FILE* out = nullptr;
+    uint64_t file_size = 0;
+    mutable std::ifstream reader;
+
+    // Turns not yet in a segment
+    std::unordered_map<uint64_t, Postings> tail; // By term hash; docs are archive ids
+    std::vector<uint64_t> tail_offsets;
+    std::vector<uint32_t> tail_lengths;
+    uint64_t tail_length = 0;
+};
@@ -0,0 +1,202 @@
+#include "turn_store.hpp"
+
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#ifdef MEMORAXX_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+const size_t COMPRESS_MIN_BYTES = 256; // Shorter turns barely shrink
+const size_t SHARE_MIN_BYTES = 1024;
+const size_t RELEASE_MIN_BYTES = 64 * 1024; // Spare arena capacity worth giving back
+
+#ifdef MEMORAXX_HAVE_ZSTD
+const int COMPRESSION_LEVEL = 1;
+
+// Contexts reused by every store on the thread
+ZSTD_CCtx* compression_context() {
+    thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    return context.get();
+}
+
+ZSTD_DCtx* decompression_context() {
+    thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    return context.get();
+}
+#endif
+
+// Append `text` to `out`, compressed if that saves at least an eighth;
+// returns whether it was compressed
+bool pack(std::string& out, std::string_view text) {
+#ifdef MEMORAXX_HAVE_ZSTD
+    const size_t start = out.size();
+    const size_t bound = ZSTD_compressBound(text.size());
+    out.resize(start + bound);
+    const size_t written = ZSTD_compressCCtx(compression_context(), out.data() + start, bound, text.data(),
+                                             text.size(), COMPRESSION_LEVEL);
+    if (!ZSTD_isError(written) && written < text.size() - text.size() / 8) {
+        out.resize(start + written);
+        return true;
+    }
+    out.resize(start);
+#endif
+    out.append(text);
+    return false;
+}
+
+// Append `stored`, which holds `size` bytes once unpacked, to `out`
+void unpack(std::string& out, std::string_view stored, size_t size, bool compressed) {
+    if (!compressed) {
+        out.append(stored);
+        return;
+    }
+#ifdef MEMORAXX_HAVE_ZSTD
+    const size_t start = out.size();
+    out.resize(start + size);
+    const size_t written =
+        ZSTD_decompressDCtx(decompression_context(), out.data() + start, size, stored.data(), stored.size());
+    if (ZSTD_isError(written) || written != size) {
+        throw std::runtime_error("Corrupt compressed turn in memory");
+    }
+#else
+    (void)size;
+    throw std::logic_error("Compressed turn in a build without zstd");
+#endif
+}
+
+} // namespace
+
+TurnStore::TurnStore(bool compress) : compress(compress && compression_available()) {}
+
+bool TurnStore::compression_available() {
+#ifdef MEMORAXX_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TurnStore::push_back(const Interaction& interaction) {
+    Turn turn{};
+    turn.prompt_size = static_cast<uint32_t>(interaction.prompt.size());
+    turn.response_size = static_cast<uint32_t>(interaction.response.size());
+    turn.token_count = interaction.token_count;
+    std::string_view response = interaction.response;
+    if (response.size() >= SHARE_MIN_BYTES && share(response, turn.shared_key)) {
+        turn.shared = true;
+        response = {};
+    }
+
+    turn.offset = arena.size();
+    if (compress && interaction.prompt.size() + response.size() >= COMPRESS_MIN_BYTES) {
+        thread_local std::string joined;
+        joined.assign(interaction.prompt);
+        joined.append(response);
+        turn.compressed = pack(arena, joined);
+    } else {
+        arena.append(interaction.prompt);
+        arena.append(response);
+    }
+    turn.stored_size = static_cast<uint32_t>(arena.size() - turn.offset);
+    turns.push_back(turn);
+}
+
+void TurnStore::pop_front() {
+    if (turns.empty()) return;
+    if (turns.front().shared) unshare(turns.front().shared_key);
+    turns.pop_front();
+    head = turns.empty() ? arena.size() : turns.front().offset;
+    // Reclaim dead bytes once they outweigh the live ones (amortized O(1))
+    if (head > arena.size() - head) {
+        arena.erase(0, head);
+        for (auto& turn : turns) turn.offset -= head;
+        head = 0;
+        // Give back what a burst of long turns left behind
+        if (arena.capacity() > RELEASE_MIN_BYTES && arena.capacity() > 4 * arena.size()) {
+            arena.shrink_to_fit();
+        }
+    }
+}
+
+void TurnStore::clear() {
+    turns.clear();
+    arena.clear();
+    arena.shrink_to_fit();
+    head = 0;
+    shared.clear();
+    shared_bytes = 0;
+}
+
+std::pair<std::string_view, std::string_view> TurnStore::view(size_t i, std::string& scratch) const {
+    const Turn& turn = turns[i];
+    const std::string_view stored(arena.data() + turn.offset, turn.stored_size);
+    const SharedText* response = turn.shared ? &shared.at(turn.shared_key) : nullptr;
+    if (!turn.compressed && !(response && response->compressed)) {
+        return {stored.substr(0, turn.prompt_size), response ? std::string_view(response->text)
+                                                             : stored.substr(turn.prompt_size)};
+    }
+    scratch.clear();
+    unpack(scratch, stored, turn.shared ? turn.prompt_size : turn.prompt_size + turn.response_size, turn.compressed);
+    if (response) unpack(scratch, response->text, response->size, response->compressed);
+    const std::string_view text(scratch);
+    return {text.substr(0, turn.prompt_size), text.substr(turn.prompt_size)};
+}
+
+Interaction TurnStore::at(size_t i) const {
+    std::string scratch;
+    const auto [prompt, response] = view(i, scratch);
+    return {std::string(prompt), std::string(response), turns[i].token_count};
+}
+
+TurnStoreUsage TurnStore::usage() const {
+    TurnStoreUsage usage;
+    usage.turns = turns.size();
+    for (const auto& turn : turns) {
+        usage.text_bytes += turn.prompt_size + turn.response_size;
+        if (turn.compressed) ++usage.compressed_turns;
+        if (turn.shared) ++usage.shared_turns;
+    }
+    usage.arena_bytes = arena.size() - head;
+    usage.arena_capacity = arena.capacity();
+    usage.shared_responses = shared.size();
+    usage.shared_bytes = shared_bytes;
+    usage.record_bytes = turns.size() * sizeof(Turn);
+    return usage;
+}
+
+bool TurnStore::share(std::string_view response, uint64_t& key) {
+    key = std::hash<std::string_view>()(response);
+    auto it = shared.find(key);
+    if (it == shared.end()) {
+        SharedText text{{}, static_cast<uint32_t>(response.size()), false, 1};
+        if (compress) {
+            text.compressed = pack(text.text, response);
+        } else {
+            text.text.assign(response);
+        }
+        shared_bytes += text.text.size();
+        shared.emplace(key, std::move(text));
+        return true;
+    }
+    // Only the same text is shared; a hash collision is stored inline
+    SharedText& text = it->second;
+    if (text.compressed) {
+        std::string existing;
+        unpack(existing, text.text, text.size, true);
+        if (existing != response) return false;
+    } else if (text.text != response) {
+        return false;
+    }
+    ++text.refs;
+    return true;
+}
+
+void TurnStore::unshare(uint64_t key) {
+    auto it = shared.find(key);
+    if (it == shared.end() || --it->second.refs > 0) return;
+    shared_bytes -= it->second.text.size();
+    shared.erase(it);
+}
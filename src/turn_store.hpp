@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "interaction.hpp"
+
+// Where the bytes of a TurnStore go, for the memory report
+struct TurnStoreUsage {
+    size_t turns = 0;
+    size_t text_bytes = 0; // Prompt and response text of every turn, uncompressed and unshared
+    size_t arena_bytes = 0; // Live bytes in the arena
+    size_t arena_capacity = 0;
+    size_t compressed_turns = 0;
+    size_t shared_responses = 0; // Distinct long responses kept once
+    size_t shared_bytes = 0; // Their stored bytes
+    size_t shared_turns = 0; // Turns pointing at a shared response
+    size_t record_bytes = 0; // Per-turn bookkeeping
+};
+
+// The recent turns, oldest first, in one contiguous arena instead of two
+// heap strings per turn. A turn's prompt and response sit back to back in
+// the arena, behind a small fixed-size record; evicting from the front
+// only moves a read offset, and the dead prefix is dropped once it
+// outweighs the live bytes (amortized O(1)), as in ContextRenderer.
+//
+// Requests are built from the rendered history, so stored turns are only
+// read back for journal compaction, export, summaries and rebuilds. That
+// makes all of them cold: with `compress` (and zstd at build time) each
+// turn of 256 bytes or more is zstd-compressed on the way in. Responses
+// of 1 KiB or more, typically tool output, are kept once in a refcounted
+// pool and shared by every turn that repeats them.
+class TurnStore {
+public:
+    explicit TurnStore(bool compress = false);
+    TurnStore(const TurnStore&) = delete;
+    TurnStore& operator=(const TurnStore&) = delete;
+
+    // True when built with zstd, so `compress` has an effect
+    static bool compression_available();
+
+    size_t size() const { return turns.size(); }
+    bool empty() const { return turns.empty(); }
+
+    void push_back(const Interaction& interaction);
+    void pop_front();
+    void clear();
+
+    int token_count(size_t i) const { return turns[i].token_count; }
+
+    // Prompt and response of turn `i`. They point into the store, or into
+    // `scratch` for compressed text, and are valid until either changes.
+    std::pair<std::string_view, std::string_view> view(size_t i, std::string& scratch) const;
+
+    // Turn `i`, copied out
+    Interaction at(size_t i) const;
+    Interaction front() const { return at(0); }
+    Interaction back() const { return at(turns.size() - 1); }
+
+    // Call `fn(prompt, response, token_count)` on each turn, oldest first
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        std::string scratch;
+        for (size_t i = 0; i < turns.size(); ++i) {
+            const auto [prompt, response] = view(i, scratch);
+            fn(prompt, response, turns[i].token_count);
+        }
+    }
+
+    // Live heap bytes: stored text, shared responses and records. The
+    // arena's spare capacity is not counted; it is released once it
+    // dwarfs the live bytes.
+    size_t bytes() const { return arena.size() - head + shared_bytes + turns.size() * sizeof(Turn); }
+
+    TurnStoreUsage usage() const;
+
+private:
+    struct Turn {
+        size_t offset; // Of the turn's bytes in `arena`
+        uint32_t stored_size; // Bytes in `arena`: prompt and unshared response, maybe compressed
+        uint32_t prompt_size;
+        uint32_t response_size;
+        int token_count;
+        bool compressed;
+        bool shared; // Response is `shared[shared_key]`
+        uint64_t shared_key;
+    };
+
+    struct SharedText {
+        std::string text; // Maybe compressed
+        uint32_t size; // Uncompressed
+        bool compressed;
+        size_t refs;
+    };
+
+    // Key of a shared copy of `response`, adding one if needed; false when
+    // another text already has its hash
+    bool share(std::string_view response, uint64_t& key);
+    void unshare(uint64_t key);
+
+    bool compress;
+    std::string arena;
+    size_t head = 0; // Start of the live bytes in `arena`
+    std::deque<Turn> turns;
+    std::unordered_map<uint64_t, SharedText> shared;
+    size_t shared_bytes = 0;
+};
@@ -0,0 +1,360 @@
+#include "vector_index.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MEMORAXX_HAVE_AVX2_KERNEL 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MEMORAXX_HAVE_NEON_KERNEL 1
+#endif
+
+namespace {
+
+float dot_scalar(const float* a, const float* b, size_t dim) {
+    // Four independent accumulators so the compiler can vectorize
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= dim; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < dim; ++i) s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef MEMORAXX_HAVE_AVX2_KERNEL
+__attribute__((target("avx2,fma"))) float dot_avx2(const float* a, const float* b, size_t dim) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= dim; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= dim; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    float result = _mm_cvtss_f32(sum);
+    for (; i < dim; ++i) result += a[i] * b[i];
+    return result;
+}
+#endif
+
+#ifdef MEMORAXX_HAVE_NEON_KERNEL
+float dot_neon(const float* a, const float* b, size_t dim) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= dim; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float result = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < dim; ++i) result += a[i] * b[i];
+    return result;
+}
+#endif
+
+using DotFn = float (*)(const float*, const float*, size_t);
+
+DotFn select_dot() {
+#ifdef MEMORAXX_HAVE_AVX2_KERNEL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return dot_avx2;
+#endif
+#ifdef MEMORAXX_HAVE_NEON_KERNEL
+    return dot_neon;
+#endif
+    return dot_scalar;
+}
+
+const DotFn DOT = select_dot();
+
+const char INDEX_MAGIC[8] = {'M', 'X', 'H', 'N', 'S', 'W', '1', '\0'};
+
+template <typename T>
+void write_pod(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool read_pod(std::ifstream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+} // namespace
+
+float dot_product(const float* a, const float* b, size_t dim) {
+    return DOT(a, b, dim);
+}
+
+HnswIndex::HnswIndex(size_t dim, size_t m, size_t ef_construction)
+    : dim(dim), m(m), max_m0(2 * m), ef_construction(ef_construction), level_mult(1.0 / std::log(double(m))) {}
+
+uint32_t* HnswIndex::links(uint32_t id, int level) {
+    if (level == 0) return level0.data() + static_cast<size_t>(id) * (max_m0 + 1);
+    return upper[id].data() + static_cast<size_t>(level - 1) * (m + 1);
+}
+
+const uint32_t* HnswIndex::links(uint32_t id, int level) const {
+    return const_cast<HnswIndex*>(this)->links(id, level);
+}
+
+int HnswIndex::random_level() {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double r = uniform(rng);
+    return static_cast<int>(-std::log(std::max(r, 1e-12)) * level_mult);
+}
+
+std::vector<HnswIndex::Candidate> HnswIndex::search_layer(const float* query, uint32_t entry, size_t ef, int level) const {
+    if (visited.size() < count) visited.resize(count, 0);
+    if (++visit_epoch == 0) {
+        std::fill(visited.begin(), visited.end(), 0);
+        visit_epoch = 1;
+    }
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates; // Closest first
+    std::priority_queue<Candidate> results; // Farthest first
+
+    float d = distance(query, entry);
+    candidates.emplace(d, entry);
+    results.emplace(d, entry);
+    visited[entry] = visit_epoch;
+
+    while (!candidates.empty()) {
+        Candidate current = candidates.top();
+        if (current.first > results.top().first && results.size() >= ef) break;
+        candidates.pop();
+        const uint32_t* neighbors = links(current.second, level);
+        for (uint32_t i = 1; i <= neighbors[0]; ++i) {
+            uint32_t neighbor = neighbors[i];
+            if (visited[neighbor] == visit_epoch) continue;
+            visited[neighbor] = visit_epoch;
+            float nd = distance(query, neighbor);
+            if (results.size() < ef || nd < results.top().first) {
+                candidates.emplace(nd, neighbor);
+                results.emplace(nd, neighbor);
+                if (results.size() > ef) results.pop();
+            }
+        }
+    }
+
+    std::vector<Candidate> out(results.size());
+    for (size_t i = out.size(); i-- > 0;) {
+        out[i] = results.top();
+        results.pop();
+    }
+    return out;
+}
+
+void HnswIndex::select_neighbors(std::vector<Candidate>& candidates, size_t limit) const {
+    // Keep a candidate only if it is closer to the base than to every
+    // neighbour already kept, which spreads links across directions.
+    std::sort(candidates.begin(), candidates.end());
+    if (candidates.size() <= limit) return;
+    std::vector<Candidate> selected;
+    selected.reserve(limit);
+    for (const auto& candidate : candidates) {
+        if (selected.size() >= limit) break;
+        bool keep = true;
+        for (const auto& kept : selected) {
+            if (distance(vector(candidate.second), kept.second) < candidate.first) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) selected.push_back(candidate);
+    }
+    candidates.swap(selected);
+}
+
+void HnswIndex::connect(uint32_t id, uint32_t neighbor, int level) {
+    uint32_t* list = links(id, level);
+    size_t limit = max_links(level);
+    if (list[0] < limit) {
+        list[++list[0]] = neighbor;
+        return;
+    }
+    std::vector<Candidate> candidates;
+    candidates.reserve(limit + 1);
+    const float* base = vector(id);
+    candidates.emplace_back(distance(base, neighbor), neighbor);
+    for (uint32_t i = 1; i <= list[0]; ++i) {
+        candidates.emplace_back(distance(base, list[i]), list[i]);
+    }
+    select_neighbors(candidates, limit);
+    list[0] = static_cast<uint32_t>(candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i) list[i + 1] = candidates[i].second;
+}
+
+uint32_t HnswIndex::add(const float* input) {
+    uint32_t id = static_cast<uint32_t>(count++);
+    float norm = std::sqrt(dot_product(input, input, dim));
+    float scale = norm > 0 ? 1.0f / norm : 0.0f;
+    for (size_t i = 0; i < dim; ++i) vectors.push_back(input[i] * scale);
+    const float* query = vector(id);
+
+    int level = random_level();
+    levels.push_back(level);
+    level0.resize(level0.size() + max_m0 + 1, 0);
+    upper.emplace_back(static_cast<size_t>(level) * (m + 1), 0);
+
+    if (max_level < 0) {
+        entry_point = id;
+        max_level = level;
+        return id;
+    }
+
+    // Greedy descent through the levels above the new node
+    uint32_t current = entry_point;
+    float current_distance = distance(query, current);
+    for (int l = max_level; l > level; --l) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            const uint32_t* neighbors = links(current, l);
+            for (uint32_t i = 1; i <= neighbors[0]; ++i) {
+                float d = distance(query, neighbors[i]);
+                if (d < current_distance) {
+                    current_distance = d;
+                    current = neighbors[i];
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (int l = std::min(level, max_level); l >= 0; --l) {
+        std::vector<Candidate> candidates = search_layer(query, current, ef_construction, l);
+        current = candidates.front().second;
+        select_neighbors(candidates, m);
+        uint32_t* list = links(id, l);
+        for (const auto& candidate : candidates) {
+            list[++list[0]] = candidate.second;
+            connect(candidate.second, id, l);
+        }
+    }
+    if (level > max_level) {
+        entry_point = id;
+        max_level = level;
+    }
+    return id;
+}
+
+std::vector<std::pair<float, uint32_t>> HnswIndex::search(const float* input, size_t k, size_t ef) const {
+    if (count == 0 || k == 0) return {};
+    std::vector<float> query(input, input + dim);
+    float norm = std::sqrt(dot_product(query.data(), query.data(), dim));
+    if (norm > 0) {
+        for (auto& value : query) value /= norm;
+    }
+
+    uint32_t current = entry_point;
+    float current_distance = distance(query.data(), current);
+    for (int l = max_level; l > 0; --l) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            const uint32_t* neighbors = links(current, l);
+            for (uint32_t i = 1; i <= neighbors[0]; ++i) {
+                float d = distance(query.data(), neighbors[i]);
+                if (d < current_distance) {
+                    current_distance = d;
+                    current = neighbors[i];
+                    changed = true;
+                }
+            }
+        }
+    }
+    std::vector<Candidate> results = search_layer(query.data(), current, std::max(ef, k), 0);
+    if (results.size() > k) results.resize(k);
+    return results;
+}
+
+std::vector<std::pair<float, uint32_t>> HnswIndex::search_exact(const float* input, size_t k) const {
+    std::vector<float> query(input, input + dim);
+    float norm = std::sqrt(dot_product(query.data(), query.data(), dim));
+    if (norm > 0) {
+        for (auto& value : query) value /= norm;
+    }
+    std::vector<Candidate> all;
+    all.reserve(count);
+    for (uint32_t id = 0; id < count; ++id) all.emplace_back(distance(query.data(), id), id);
+    k = std::min(k, all.size());
+    std::partial_sort(all.begin(), all.begin() + k, all.end());
+    all.resize(k);
+    return all;
+}
+
+void HnswIndex::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        throw std::runtime_error("cannot write vector index " + path);
+    }
+    out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    write_pod(out, static_cast<uint64_t>(dim));
+    write_pod(out, static_cast<uint64_t>(m));
+    write_pod(out, static_cast<uint64_t>(count));
+    write_pod(out, entry_point);
+    write_pod(out, static_cast<int32_t>(max_level));
+    out.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(int));
+    out.write(reinterpret_cast<const char*>(vectors.data()), vectors.size() * sizeof(float));
+    out.write(reinterpret_cast<const char*>(level0.data()), level0.size() * sizeof(uint32_t));
+    for (const auto& node : upper) {
+        out.write(reinterpret_cast<const char*>(node.data()), node.size() * sizeof(uint32_t));
+    }
+    if (!out) {
+        throw std::runtime_error("failed to write vector index " + path);
+    }
+}
+
+bool HnswIndex::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+    char magic[sizeof(INDEX_MAGIC)];
+    uint64_t file_dim, file_m, file_count;
+    uint32_t file_entry;
+    int32_t file_max_level;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0) return false;
+    if (!read_pod(in, file_dim) || !read_pod(in, file_m) || !read_pod(in, file_count) ||
+        !read_pod(in, file_entry) || !read_pod(in, file_max_level)) {
+        return false;
+    }
+    if (file_dim != dim || file_m != m) return false;
+
+    std::vector<int> file_levels(file_count);
+    std::vector<float> file_vectors(file_count * dim);
+    std::vector<uint32_t> file_level0(file_count * (max_m0 + 1));
+    in.read(reinterpret_cast<char*>(file_levels.data()), file_levels.size() * sizeof(int));
+    in.read(reinterpret_cast<char*>(file_vectors.data()), file_vectors.size() * sizeof(float));
+    in.read(reinterpret_cast<char*>(file_level0.data()), file_level0.size() * sizeof(uint32_t));
+    std::vector<std::vector<uint32_t>> file_upper(file_count);
+    for (size_t id = 0; id < file_count && in; ++id) {
+        file_upper[id].resize(static_cast<size_t>(std::max(file_levels[id], 0)) * (m + 1));
+        in.read(reinterpret_cast<char*>(file_upper[id].data()), file_upper[id].size() * sizeof(uint32_t));
+    }
+    if (!in) return false;
+
+    count = file_count;
+    entry_point = file_entry;
+    max_level = file_max_level;
+    levels = std::move(file_levels);
+    vectors = std::move(file_vectors);
+    level0 = std::move(file_level0);
+    upper = std::move(file_upper);
+    visited.assign(count, 0);
+    visit_epoch = 0;
+    return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Dot product of two float vectors, dispatched at runtime to AVX2/FMA or
+// NEON kernels where available
+float dot_product(const float* a, const float* b, size_t dim);
+
+// Approximate nearest-neighbour index over embeddings (HNSW).
+// Vectors are L2-normalized on insert, so the distance used is
+// 1 - cosine similarity. Not thread-safe.
+class HnswIndex {
+public:
+    explicit HnswIndex(size_t dim, size_t m = 16, size_t ef_construction = 100);
+
+    size_t dimension() const { return dim; }
+    size_t size() const { return count; }
+
+    // Insert a vector; ids are assigned sequentially from 0
+    uint32_t add(const float* vector);
+
+    // The `k` nearest stored vectors as (distance, id), closest first
+    std::vector<std::pair<float, uint32_t>> search(const float* query, size_t k, size_t ef = 64) const;
+
+    // Same, by exhaustive scan; used to measure recall
+    std::vector<std::pair<float, uint32_t>> search_exact(const float* query, size_t k) const;
+
+    // Persist the graph and vectors; load() returns false on a missing or
+    // incompatible file
+    void save(const std::string& path) const;
+    bool load(const std::string& path);
+
+private:
+    using Candidate = std::pair<float, uint32_t>; // (distance, id)
+
+    const float* vector(uint32_t id) const { return vectors.data() + static_cast<size_t>(id) * dim; }
+    float distance(const float* a, uint32_t id) const { return 1.0f - dot_product(a, vector(id), dim); }
+
+    // Neighbour list of `id` on `level`: slot 0 holds the count
+    uint32_t* links(uint32_t id, int level);
+    const uint32_t* links(uint32_t id, int level) const;
+    size_t max_links(int level) const { return level == 0 ? max_m0 : m; }
+
+    std::vector<Candidate> search_layer(const float* query, uint32_t entry, size_t ef, int level) const;
+    void select_neighbors(std::vector<Candidate>& candidates, size_t limit) const;
+    void connect(uint32_t id, uint32_t neighbor, int level);
+    int random_level();
+
+    size_t dim;
+    size_t m; // Links per node on upper levels
+    size_t max_m0; // Links per node on level 0
+    size_t ef_construction;
+    double level_mult;
+    size_t count = 0;
+    uint32_t entry_point = 0;
+    int max_level = -1;
+    std::vector<float> vectors; // Normalized vectors, `dim` floats each
+    std::vector<uint32_t> level0; // (max_m0 + 1) slots per node
+    std::vector<std::vector<uint32_t>> upper; // (m + 1) slots per upper level, per node
+    std::vector<int> levels;
+    std::mt19937 rng{42};
+    mutable std::vector<uint32_t> visited; // Epoch tag per node
+    mutable uint32_t visit_epoch = 0;
+};